@@ -0,0 +1,641 @@
+/*
+[CyoJSON] bench.cpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Measures the parser on a generated corpus of documents of several shapes,
+// in each parse mode. Run with --help for the options. The corpus is the
+// same on every run (for a given --size), so results can be saved as a
+// baseline and compared against later.
+
+#include "cyojson.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace cyojson;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Every allocation is counted, along with the peak number of bytes allocated
+// at once. Each block is preceded by its size...
+
+namespace
+{
+    const std::size_t c_header = 16; //keeps the block aligned
+
+    std::atomic<std::size_t> g_allocations(0);
+    std::atomic<std::size_t> g_bytes(0);
+    std::atomic<std::size_t> g_peakBytes(0);
+}
+
+void* operator new(std::size_t size)
+{
+    void* block = std::malloc(size + c_header);
+    if (!block)
+        throw std::bad_alloc();
+    *(std::size_t*)block = size;
+
+    ++g_allocations;
+    std::size_t bytes = (g_bytes += size);
+    std::size_t peak = g_peakBytes;
+    while (bytes > peak && !g_peakBytes.compare_exchange_weak(peak, bytes))
+    {
+    }
+
+    return (char*)block + c_header;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (!ptr)
+        return;
+    void* block = (char*)ptr - c_header;
+    g_bytes -= *(std::size_t*)block;
+    std::free(block);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+namespace
+{
+    // A small, fast generator with the same sequence on every platform
+    // (xorshift64*), unlike the std distributions.
+    class Random
+    {
+    public:
+        explicit Random(std::uint64_t seed)
+            : state_(seed)
+        {
+        }
+
+        std::uint64_t Next()
+        {
+            state_ ^= state_ >> 12;
+            state_ ^= state_ << 25;
+            state_ ^= state_ >> 27;
+            return state_ * 2685821657736338717ull;
+        }
+
+        // In [0, count).
+        unsigned Below(unsigned count) { return (unsigned)(Next() % count); }
+
+    private:
+        std::uint64_t state_;
+    };
+
+    // Generates the corpus: each shape as minified text, of about the given
+    // size, as the elements of an array in a root object.
+    class CorpusGenerator
+    {
+    public:
+        explicit CorpusGenerator(std::size_t size)
+            : size_(size)
+        {
+        }
+
+        // Integers and doubles, of all sizes.
+        std::string Numbers()
+        {
+            Random random(1);
+            std::string json = "{\"values\":[";
+            while (json.size() < size_)
+            {
+                switch (random.Below(4))
+                {
+                case 0:
+                    json += std::to_string(random.Below(1000));
+                    break;
+                case 1:
+                    json += std::to_string((std::int64_t)random.Next());
+                    break;
+                case 2:
+                    json += std::to_string(random.Below(100000)) + "." + std::to_string(random.Below(1000000));
+                    break;
+                case 3:
+                    json += "-" + std::to_string(random.Below(10)) + "." + std::to_string(random.Below(100000)) + "e" + std::to_string((int)random.Below(40) - 20);
+                    break;
+                }
+                json += ',';
+            }
+            json.back() = ']';
+            return json + "}";
+        }
+
+        // Text, with some escapes and \u sequences (including surrogate pairs).
+        std::string Strings()
+        {
+            static const char* const words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor" };
+            static const char* const escapes[] = { "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\u00e9", "\\u20ac", "\\ud83d\\ude00" };
+            Random random(2);
+            std::string json = "{\"text\":[";
+            while (json.size() < size_)
+            {
+                json += '\"';
+                unsigned count = 1 + random.Below(40);
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    if (i != 0)
+                        json += ' ';
+                    json += words[random.Below(sizeof(words) / sizeof(words[0]))];
+                    if (random.Below(8) == 0)
+                        json += escapes[random.Below(sizeof(escapes) / sizeof(escapes[0]))];
+                }
+                json += "\",";
+            }
+            json.back() = ']';
+            return json + "}";
+        }
+
+        // Objects nested up to 64 deep.
+        std::string Nested()
+        {
+            Random random(3);
+            std::string json = "{\"trees\":[";
+            while (json.size() < size_)
+            {
+                unsigned depth = 1 + random.Below(64);
+                for (unsigned i = 0; i < depth; ++i)
+                    json += "{\"id\":" + std::to_string(i) + ",\"child\":";
+                json += "null";
+                for (unsigned i = 0; i < depth; ++i)
+                    json += '}';
+                json += ',';
+            }
+            json.back() = ']';
+            return json + "}";
+        }
+
+        // Objects with hundreds of keys.
+        std::string Wide()
+        {
+            Random random(4);
+            std::string json = "{\"rows\":[";
+            while (json.size() < size_)
+            {
+                json += '{';
+                for (unsigned i = 0; i < 200; ++i)
+                {
+                    json += "\"field" + std::to_string(i) + "\":";
+                    switch (random.Below(4))
+                    {
+                    case 0:
+                        json += std::to_string(random.Below(100000));
+                        break;
+                    case 1:
+                        json += "\"value" + std::to_string(random.Below(1000)) + "\"";
+                        break;
+                    case 2:
+                        json += (random.Below(2) ? "true" : "false");
+                        break;
+                    case 3:
+                        json += "null";
+                        break;
+                    }
+                    json += ',';
+                }
+                json.back() = '}';
+                json += ',';
+            }
+            json.back() = ']';
+            return json + "}";
+        }
+
+        // Reformats minified text, with a line for each value and key, and
+        // an indent of two spaces per level.
+        static std::string Pretty(const std::string& minified)
+        {
+            std::string json;
+            json.reserve(minified.size() * 2);
+            int depth = 0;
+            bool inString = false;
+            for (std::size_t i = 0; i < minified.size(); ++i)
+            {
+                char ch = minified[i];
+                if (inString)
+                {
+                    json += ch;
+                    if (ch == '\\')
+                        json += minified[++i];
+                    else if (ch == '\"')
+                        inString = false;
+                    continue;
+                }
+
+                switch (ch)
+                {
+                case '{':
+                case '[':
+                    json += ch;
+                    if (minified[i + 1] == '}' || minified[i + 1] == ']')
+                        json += minified[++i];
+                    else
+                        NewLine(json, ++depth);
+                    break;
+                case '}':
+                case ']':
+                    NewLine(json, --depth);
+                    json += ch;
+                    break;
+                case ',':
+                    json += ch;
+                    NewLine(json, depth);
+                    break;
+                case ':':
+                    json += ": ";
+                    break;
+                case '\"':
+                    inString = true;
+                    json += ch;
+                    break;
+                default:
+                    json += ch;
+                    break;
+                }
+            }
+            return json + "\n";
+        }
+
+    private:
+        const std::size_t size_;
+
+        static void NewLine(std::string& json, int depth)
+        {
+            json += '\n';
+            json.append(2 * (std::size_t)depth, ' ');
+        }
+    };
+
+    struct Corpus
+    {
+        std::string name;
+        std::string json;
+    };
+
+    std::vector<Corpus> GenerateCorpus(std::size_t size)
+    {
+        CorpusGenerator generator(size);
+        std::vector<Corpus> corpus;
+        corpus.push_back({ "numbers", generator.Numbers() });
+        corpus.push_back({ "strings", generator.Strings() });
+        corpus.push_back({ "nested", generator.Nested() });
+        corpus.push_back({ "wide", generator.Wide() });
+
+        for (std::size_t i = 0, count = corpus.size(); i < count; ++i)
+            corpus.push_back({ corpus[i].name + "-pretty", CorpusGenerator::Pretty(corpus[i].json) });
+        return corpus;
+    }
+
+    // Counts the events, without converting numbers.
+    class CountingCallbacks final : public Parser::Callbacks
+    {
+    public:
+        std::size_t count = 0;
+
+        void ObjectStart(const char*) override { ++count; }
+        void ObjectEnd(const char*) override { ++count; }
+        void ArrayStart(const char*) override { ++count; }
+        void ArrayEnd(const char*) override { ++count; }
+        void Key(const char*, const char*, std::size_t) override { ++count; }
+        void String(const char*, const char*, std::size_t) override { ++count; }
+        void Number(const char*, const char*, std::size_t) override { ++count; }
+        void Value(const char*, const char*) override { ++count; }
+    };
+
+    // Counts the events, converting numbers.
+    class TypedCallbacks final : public Parser::Callbacks
+    {
+    public:
+        std::size_t count = 0;
+
+        void ObjectStart(const char*) override { ++count; }
+        void ObjectEnd(const char*) override { ++count; }
+        void ArrayStart(const char*) override { ++count; }
+        void ArrayEnd(const char*) override { ++count; }
+        void Key(const char*, const char*, std::size_t) override { ++count; }
+        void String(const char*, const char*, std::size_t) override { ++count; }
+        void Int64(const char*, std::int64_t, const char*, std::size_t) override { ++count; }
+        void UInt64(const char*, std::uint64_t, const char*, std::size_t) override { ++count; }
+        void Double(const char*, double, const char*, std::size_t) override { ++count; }
+        void Bool(const char*, bool) override { ++count; }
+        void Null(const char*) override { ++count; }
+    };
+
+    // Counts the events as a static handler, without paths.
+    struct CountingHandler
+    {
+        static const bool c_usesPaths = false;
+        std::size_t count = 0;
+
+        void ObjectStart(const char*) { ++count; }
+        void ObjectEnd(const char*) { ++count; }
+        void ArrayStart(const char*) { ++count; }
+        void ArrayEnd(const char*) { ++count; }
+        void Key(const char*, const char*, std::size_t) { ++count; }
+        void String(const char*, const char*, std::size_t) { ++count; }
+        void Number(const char*, const char*, std::size_t) { ++count; }
+        void Value(const char*, const char*) { ++count; }
+    };
+
+    // Each parse mode parses a document, returning false on error.
+    struct Mode
+    {
+        const char* name;
+        std::function<bool(const std::string&)> parse;
+    };
+
+    std::vector<Mode> GetModes()
+    {
+        std::vector<Mode> modes;
+        modes.push_back({ "callbacks", [](const std::string& json) {
+            Parser parser;
+            CountingCallbacks callbacks;
+            return parser.Parse(json.c_str(), callbacks);
+        } });
+        modes.push_back({ "reused", [](const std::string& json) {
+            static Parser parser; //keeps its buffers from one parse to the next
+            CountingCallbacks callbacks;
+            return parser.Parse(json.c_str(), callbacks);
+        } });
+        modes.push_back({ "typed", [](const std::string& json) {
+            Parser parser;
+            TypedCallbacks callbacks;
+            return parser.Parse(json.c_str(), callbacks);
+        } });
+        modes.push_back({ "static", [](const std::string& json) {
+            Parser parser;
+            CountingHandler handler;
+            return parser.Parse(json.c_str(), handler);
+        } });
+        modes.push_back({ "structural", [](const std::string& json) {
+            Parser parser;
+            parser.setEngine(Parser::Engine::StructuralIndex);
+            CountingCallbacks callbacks;
+            return parser.Parse(json.c_str(), callbacks);
+        } });
+        modes.push_back({ "validate", [](const std::string& json) {
+            Parser parser;
+            return parser.Validate(json.data(), json.size());
+        } });
+        modes.push_back({ "stream", [](const std::string& json) {
+            CountingCallbacks callbacks;
+            StreamParser parser(callbacks);
+            const std::size_t c_pieceSize = 64 * 1024;
+            for (std::size_t offset = 0; offset < json.size(); offset += c_pieceSize)
+            {
+                if (!parser.Feed(json.data() + offset, std::min(c_pieceSize, json.size() - offset)))
+                    return false;
+            }
+            return parser.Finish();
+        } });
+        modes.push_back({ "parallel", [](const std::string& json) {
+            Parser parser;
+            parser.setThreads(0);
+            CountingCallbacks callbacks;
+            return parser.Parse(json.c_str(), callbacks);
+        } });
+        modes.push_back({ "document", [](const std::string& json) {
+            static Document document; //keeps its memory, and its parser's buffers
+            return document.Parse(json.c_str());
+        } });
+        return modes;
+    }
+
+    struct Result
+    {
+        double mbPerSecond;
+        double eventsPerSecond;
+        std::size_t allocations; //per document
+        std::size_t peakBytes;   //above that allocated before parsing
+    };
+
+    // Parses the document the given number of times, taking the fastest.
+    Result Measure(const Mode& mode, const std::string& json, std::size_t events, int iterations)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        Result result = Result();
+        double best = 0;
+        for (int i = 0; i < iterations; ++i)
+        {
+            const std::size_t allocations = g_allocations;
+            const std::size_t bytes = g_bytes;
+            g_peakBytes = bytes;
+
+            const Clock::time_point start = Clock::now();
+            if (!mode.parse(json))
+                throw std::runtime_error(std::string("Failed to parse the corpus in mode ") + mode.name);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (i == 0 || seconds < best)
+                best = seconds;
+            result.allocations = g_allocations - allocations;
+            result.peakBytes = g_peakBytes - bytes;
+        }
+
+        result.mbPerSecond = (double)json.size() / (1024 * 1024) / best;
+        result.eventsPerSecond = (double)events / best;
+        return result;
+    }
+
+    // A baseline has a line for each corpus and mode: "corpus mode MB/s".
+    typedef std::map<std::string, double> Baseline;
+
+    std::string BaselineKey(const std::string& corpus, const std::string& mode)
+    {
+        return corpus + " " + mode;
+    }
+
+    Baseline LoadBaseline(const char* filename)
+    {
+        std::ifstream in(filename);
+        if (!in)
+            throw std::runtime_error(std::string("Unable to open baseline ") + filename);
+
+        Baseline baseline;
+        std::string corpus, mode;
+        double mbPerSecond;
+        while (in >> corpus >> mode >> mbPerSecond)
+            baseline[BaselineKey(corpus, mode)] = mbPerSecond;
+        return baseline;
+    }
+
+    void Usage()
+    {
+        std::cout << "Usage: runbench [options]\n"
+            "  --size MB          size of each document in the corpus (default 16)\n"
+            "  --iterations N     parses of each document per mode, taking the fastest (default 5)\n"
+            "  --corpus NAME      only this document (e.g. numbers, strings-pretty)\n"
+            "  --mode NAME        only this mode (callbacks, typed, static, structural,\n"
+            "                     validate, stream, parallel, document)\n"
+            "  --save FILE        save the MB/s of each document and mode as a baseline\n"
+            "  --compare FILE     compare against a saved baseline\n"
+            "  --threshold PCT    slowdown that counts as a regression (default 5)\n"
+            "  --write DIR        also write the corpus to DIR, as <name>.json\n"
+            "\n"
+            "Exits with 2 if there are any regressions against the baseline.\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::size_t size = 16;
+        int iterations = 5;
+        std::string onlyCorpus, onlyMode;
+        const char* saveFile = nullptr;
+        const char* compareFile = nullptr;
+        double threshold = 5;
+        const char* writeDir = nullptr;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--help")
+            {
+                Usage();
+                return 0;
+            }
+            if (i + 1 == argc)
+                throw std::runtime_error("Missing value for " + arg);
+
+            const char* value = argv[++i];
+            if (arg == "--size")
+                size = (std::size_t)std::atoi(value);
+            else if (arg == "--iterations")
+                iterations = std::max(1, std::atoi(value));
+            else if (arg == "--corpus")
+                onlyCorpus = value;
+            else if (arg == "--mode")
+                onlyMode = value;
+            else if (arg == "--save")
+                saveFile = value;
+            else if (arg == "--compare")
+                compareFile = value;
+            else if (arg == "--threshold")
+                threshold = std::atof(value);
+            else if (arg == "--write")
+                writeDir = value;
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+
+        Baseline baseline;
+        if (compareFile)
+            baseline = LoadBaseline(compareFile);
+
+        const std::vector<Corpus> corpus = GenerateCorpus(std::max<std::size_t>(size, 1) * 1024 * 1024);
+        const std::vector<Mode> modes = GetModes();
+
+        std::ostringstream saved;
+        int regressions = 0;
+        std::printf("%-16s %-11s %9s %11s %11s %10s", "corpus", "mode", "MB/s", "Mevents/s", "allocs/doc", "peak KB");
+        if (compareFile)
+            std::printf(" %9s %8s", "baseline", "change");
+        std::printf("\n");
+
+        for (const Corpus& document : corpus)
+        {
+            if (!onlyCorpus.empty() && document.name != onlyCorpus)
+                continue;
+
+            if (writeDir)
+            {
+                std::ofstream out(std::string(writeDir) + "/" + document.name + ".json", std::ios::binary);
+                out << document.json;
+            }
+
+            // Every mode delivers the same events...
+            Parser parser;
+            CountingCallbacks callbacks;
+            if (!parser.Parse(document.json.c_str(), callbacks))
+                throw std::runtime_error("Invalid corpus document " + document.name);
+
+            for (const Mode& mode : modes)
+            {
+                if (!onlyMode.empty() && onlyMode != mode.name)
+                    continue;
+
+                const Result result = Measure(mode, document.json, callbacks.count, iterations);
+                std::printf("%-16s %-11s %9.1f %11.2f %11zu %10zu", document.name.c_str(), mode.name,
+                    result.mbPerSecond, result.eventsPerSecond / 1e6, result.allocations, result.peakBytes / 1024);
+                saved << document.name << ' ' << mode.name << ' ' << result.mbPerSecond << '\n';
+
+                if (compareFile)
+                {
+                    Baseline::const_iterator it = baseline.find(BaselineKey(document.name, mode.name));
+                    if (it != baseline.end())
+                    {
+                        const double change = (result.mbPerSecond / it->second - 1) * 100;
+                        const bool regressed = (change < -threshold);
+                        std::printf(" %9.1f %+7.1f%%%s", it->second, change, (regressed ? " REGRESSION" : ""));
+                        if (regressed)
+                            ++regressions;
+                    }
+                }
+                std::printf("\n");
+                std::fflush(stdout);
+            }
+        }
+
+        if (saveFile)
+        {
+            std::ofstream out(saveFile);
+            out << saved.str();
+            if (!out)
+                throw std::runtime_error(std::string("Unable to save baseline ") + saveFile);
+        }
+
+        if (regressions != 0)
+        {
+            std::printf("%d regression(s) of more than %g%%\n", regressions, threshold);
+            return 2;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "ERROR: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1 @@
+g++ bench.cpp -o runbench -I../include --std=c++14 -O2 -pthread
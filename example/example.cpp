@@ -26,7 +26,6 @@ SOFTWARE.
 
 #include "cyojson.hpp"
 
-#include <fstream>
 #include <iostream>
 #include <ostream>
 #include <stdexcept>
@@ -65,18 +64,13 @@ int main(int argc, char* argv[])
         if (argc != 2)
             throw std::runtime_error("Missing filename");
 
-        std::ifstream file(argv[1]);
-        if (!file.is_open())
-            throw std::runtime_error("Unable to open file");
-
-        char contents[8 * 1024] = { 0 };
-        file.read(contents, sizeof(contents) - 1); //-1 for null termination
-
         Parser parser;
         OutputToStream callbacks(std::cout);
-        bool success = parser.Parse(contents, callbacks);
+        bool success = parser.ParseFile(argv[1], callbacks);
         if (success)
             std::cout << "Success" << std::endl;
+        else if (parser.getLine() == 0)
+            throw std::runtime_error("Unable to open file");
         else
         {
             std::cout << "Error on line " << parser.getLine()
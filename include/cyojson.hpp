@@ -27,41 +27,1108 @@ SOFTWARE.
 #ifndef __CYOJSON_HPP
 #define __CYOJSON_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) && defined(__has_include)
+#   if __has_include(<memory_resource>)
+#       include <memory_resource>
+#       define CYOJSON_HAS_MEMORY_RESOURCE
+#   endif
+#   if __has_include(<optional>)
+#       include <optional>
+#       define CYOJSON_HAS_OPTIONAL
+#   endif
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 namespace cyojson
 {
+    namespace detail
+    {
+        class DocumentBuilder;
+        class LazyScanner;
+        class MappedFile;
+        struct ParserBuffers;
+        template <typename Handler>
+        class Events;
+        class StreamParserImpl;
+        class WorkerPool;
+    }
+
+    // Interns paths, giving each distinct path a stable id (a small integer)
+    // for as long as the table lives, so it can be shared by any number of
+    // calls to Parse. Ids can also be obtained before parsing, e.g. for use
+    // in a switch statement.
+    class PathTable
+    {
+    public:
+        typedef std::uint32_t Id;
+
+        static const Id c_rootId = 0; //the path of the root object, ""
+
+        PathTable();
+        PathTable(const PathTable&) = delete;
+        void operator=(const PathTable&) = delete;
+
+        // Returns the id of a member of the given object, interning it if
+        // it's new. The key needn't be null-terminated.
+        Id Intern(Id parent, const char* key, std::size_t length);
+
+        // As above for a colon-joined path, such as "items:price" (so none of
+        // its keys may contain a colon).
+        Id Intern(const char* path);
+
+        const char* getPath(Id id) const { return entries_[id].path.c_str(); }
+        std::size_t getPathLength(Id id) const { return entries_[id].path.size(); }
+        Id getParent(Id id) const { return entries_[id].parent; }
+
+        // The last component of the path, i.e. its key (not null-terminated).
+        const char* getKey(Id id) const { return entries_[id].path.c_str() + entries_[id].keyOffset; }
+        std::size_t getKeyLength(Id id) const { return entries_[id].path.size() - entries_[id].keyOffset; }
+
+        std::size_t getCount() const { return entries_.size(); }
+
+        void Clear();
+
+    private:
+        struct Entry
+        {
+            Id parent;
+            std::size_t keyOffset;
+            std::string path;
+        };
+
+        std::vector<Entry> entries_;
+        std::vector<Id> slots_; //open addressing, hashing the parent id and key
+
+        static std::size_t Hash(Id parent, const char* key, std::size_t length);
+        void Grow();
+    };
+
+    // A source of memory for the buffers that a Parser keeps from one parse
+    // to the next (see Parser::setAllocator), and for a Writer's buffer, e.g.
+    // a pool or an arena.
+    // Allocate() must return memory aligned as by operator new, or throw
+    // std::bad_alloc.
+    class Allocator
+    {
+    public:
+        virtual ~Allocator() { }
+
+        virtual void* Allocate(std::size_t size) = 0;
+        virtual void Deallocate(void* p, std::size_t size) = 0;
+    };
+
+#ifdef CYOJSON_HAS_MEMORY_RESOURCE
+    // Allocates from a std::pmr::memory_resource (C++17), which must outlive
+    // the allocator.
+    class MemoryResourceAllocator final : public Allocator
+    {
+    public:
+        explicit MemoryResourceAllocator(std::pmr::memory_resource* resource)
+            : resource_(resource)
+        {
+        }
+
+        void* Allocate(std::size_t size) override { return resource_->allocate(size, alignof(std::max_align_t)); }
+        void Deallocate(void* p, std::size_t size) override { resource_->deallocate(p, size, alignof(std::max_align_t)); }
+
+        std::pmr::memory_resource* getResource() const { return resource_; }
+
+    private:
+        std::pmr::memory_resource* const resource_;
+    };
+#endif
+
+    // Where Parser reads text from, a block at a time, when it isn't all in
+    // memory (e.g. a pipe or a socket). Read() reads up to size bytes into
+    // the buffer, setting length to the number read, which is 0 at the end;
+    // it returns false on an error. The adapters below don't own what they
+    // read from, so don't close it.
+    class InputSource
+    {
+    public:
+        virtual ~InputSource() { }
+
+        virtual bool Read(char* buffer, std::size_t size, std::size_t& length) = 0;
+    };
+
+    class FileDescriptorSource final : public InputSource
+    {
+    public:
+        explicit FileDescriptorSource(int fd) : fd_(fd) { }
+
+        bool Read(char* buffer, std::size_t size, std::size_t& length) override;
+
+    private:
+        const int fd_;
+    };
+
+    class FileSource final : public InputSource
+    {
+    public:
+        explicit FileSource(std::FILE* file) : file_(file) { }
+
+        bool Read(char* buffer, std::size_t size, std::size_t& length) override;
+
+    private:
+        std::FILE* const file_;
+    };
+
+    class StreamSource final : public InputSource
+    {
+    public:
+        explicit StreamSource(std::istream& stream) : stream_(stream) { }
+
+        bool Read(char* buffer, std::size_t size, std::size_t& length) override;
+
+    private:
+        std::istream& stream_;
+    };
+
     class Parser
     {
     public:
+        Parser() = default;
+        Parser(const Parser&) = delete;
+        void operator=(const Parser&) = delete;
+        ~Parser();
+
+        // What a callback asks the parser to do next. Skip applies to
+        // ObjectStart and ArrayStart, whose contents are then skipped (though
+        // the ObjectEnd or ArrayEnd is still delivered), and to Key, whose
+        // value is then skipped without any events; from any other callback,
+        // it's the same as Continue. Skipped values are checked or not as
+        // for the subscriptions (see SkipMode). Stop ends the parse straight
+        // away, successfully, and IsStopped() then returns true.
+        enum class Action
+        {
+            Continue,
+            Skip,
+            Stop
+        };
+
         class Callbacks
         {
         public:
+            virtual ~Callbacks() { }
+
             virtual void ObjectStart(const char* path);
             virtual void ObjectEnd(const char* path);
             virtual void ArrayStart(const char* path);
             virtual void ArrayEnd(const char* path);
             virtual void Value(const char* path, const char* value);
+
+            // Zero-copy alternatives to Value: unless the string contains
+            // escapes, the value points straight into the JSON text, so it is
+            // NOT null-terminated and is only valid during the call. By
+            // default, these copy the value and call Value.
+            virtual void String(const char* path, const char* value, std::size_t length);
+            virtual void Number(const char* path, const char* value, std::size_t length);
+
+            // Called for each member of an object, before its value; the path
+            // is that of the object. The key is not null-terminated.
+            virtual void Key(const char* path, const char* key, std::size_t length);
+
+            // Typed alternatives to Number and Value. Integers are exact: Int64
+            // within the range of std::int64_t, UInt64 beyond that, otherwise
+            // (and for fractions, exponents and -0) a correctly rounded Double.
+            // The text of the number is also given, as for Number, which is
+            // what the defaults call; Bool and Null default to Value.
+            virtual void Int64(const char* path, std::int64_t value, const char* text, std::size_t length);
+            virtual void UInt64(const char* path, std::uint64_t value, const char* text, std::size_t length);
+            virtual void Double(const char* path, double value, const char* text, std::size_t length);
+            virtual void Bool(const char* path, bool value);
+            virtual void Null(const char* path);
+
+            // When parsing with a PathTable, the id of the current path (the
+            // path passed to each callback), otherwise PathTable::c_rootId.
+            PathTable::Id getPathId() const { return pathId_; }
+
+            // Called by a callback to ask for an Action other than Continue,
+            // which applies to that call alone.
+            void setAction(Action action) { action_ = action; }
+
+        private:
+            template <typename Handler>
+            friend class detail::Events;
+
+            std::string text_;
+            PathTable::Id pathId_ = PathTable::c_rootId;
+            Action action_ = Action::Continue;
+        };
+
+        // For ParseRecords: the events of each record are bracketed by calls
+        // to RecordStart and either RecordEnd or, if it's invalid, RecordError
+        // (after any events before the error). Records are identified by the
+        // offset of their first char, and errors are reported relative to the
+        // start of the record.
+        class RecordCallbacks : public Callbacks
+        {
+        public:
+            virtual void RecordStart(std::size_t offset);
+            virtual void RecordEnd(std::size_t offset);
+            virtual void RecordError(std::size_t offset, int line, int column);
+        };
+
+        // When parsing records with more than one thread, Ordered delivers
+        // them in the order of the input, whereas Unordered delivers each
+        // chunk of records as soon as it's parsed.
+        enum class Delivery
+        {
+            Ordered,
+            Unordered
+        };
+
+        // Both engines invoke the same callbacks and report errors at the same
+        // positions. StructuralIndex first indexes the structure of the whole
+        // document using vector instructions, then parses using the index;
+        // this is typically faster for large documents.
+        enum class Engine
+        {
+            RecursiveDescent,
+            StructuralIndex
+        };
+
+        // By default, the callbacks are invoked for every value. Subscribing
+        // restricts them to the given paths and everything beneath them, where
+        // a "*" component matches any one key (e.g. "users:*:name"; the
+        // elements of an array have the array's path); any subtree that can't match is skipped without building its paths or
+        // invoking any callbacks. Skipped subtrees are still checked, unless
+        // the skip mode is Unchecked, which only matches brackets and quotes
+        // and so is only suitable for trusted input.
+        enum class SkipMode
+        {
+            Checked,
+            Unchecked
+        };
+
+        void Subscribe(const char* path) { subscriptions_.push_back(path); }
+        void ClearSubscriptions() { subscriptions_.clear(); }
+
+        SkipMode getSkipMode() const { return skipMode_; }
+        void setSkipMode(SkipMode skipMode) { skipMode_ = skipMode; }
+
+        // By default, strings are passed on as they are, whether or not
+        // they're valid UTF-8. Checked mode also checks them, failing at the
+        // first byte that isn't valid, e.g. a truncated sequence, an overlong
+        // form, an encoded surrogate or a value above 0x10FFFF. (\u escapes
+        // are always checked, and always converted to valid UTF-8.)
+        enum class UTF8Mode
+        {
+            Unchecked,
+            Checked
         };
 
+        UTF8Mode getUTF8Mode() const { return utf8Mode_; }
+        void setUTF8Mode(UTF8Mode utf8Mode) { utf8Mode_ = utf8Mode; }
+
         bool Parse(const char* json, Callbacks& callbacks);
 
+        // As above for text that needn't be null-terminated: exactly length
+        // chars are parsed, and nothing beyond them is read (other than by
+        // aligned vector loads, which can't cross into another page). A null
+        // char within them is an error, like any other control char.
+        bool Parse(const char* json, std::size_t length, Callbacks& callbacks);
+
+        // Parses the whole of the given file. Where possible, the file is
+        // memory-mapped rather than read, so is parsed without copying it (the
+        // file mustn't be truncated meanwhile). Otherwise, e.g. if it's a pipe
+        // or too large for the address space, it's read a block at a time,
+        // as by Parse(InputSource&) below. If the file can't be opened,
+        // getLine() and getColumn() both return 0.
+        bool ParseFile(const char* filename, Callbacks& callbacks);
+
+        // Parses the text read from the source, a block at a time, using the
+        // StreamParser. Only two blocks are held at once (plus any token that
+        // spans them), however large the document. With read-ahead, the next
+        // block is read on a thread of its own while the current one is
+        // parsed, so reading and parsing overlap (a read in progress when
+        // the parse fails is waited for, but nothing more is read).
+        bool Parse(InputSource& source, Callbacks& callbacks);
+
+        std::size_t getBlockSize() const { return blockSize_; }
+        void setBlockSize(std::size_t blockSize) { blockSize_ = (blockSize != 0 ? blockSize : 1); }
+
+        bool getReadAhead() const { return readAhead_; }
+        void setReadAhead(bool readAhead) { readAhead_ = readAhead; }
+
+        // Only checks that the text is valid, as Parse would (including its
+        // UTF-8 mode), failing at the same position. Nothing is delivered, so
+        // there are no paths to build, no strings to unescape and no numbers
+        // to convert, and nothing is allocated. The engine, subscriptions and
+        // threads don't apply.
+        bool Validate(const char* json);
+        bool Validate(const char* json, std::size_t length);
+
+        // The Minify() and Reformat() transforms (see below), which don't
+        // check the text, but after validating it as above; if it isn't
+        // valid, out is left empty, with the position of the error given by
+        // getLine() and getColumn().
+        bool Minify(const char* json, std::size_t length, std::string& out);
+        bool Reformat(const char* json, std::size_t length, std::string& out, int indent = 4);
+
+        // Parses newline-delimited JSON (JSON Lines): a sequence of records,
+        // each an object on a line of its own; blank lines are ignored. An
+        // invalid record doesn't stop the rest from being parsed, but false
+        // is returned if any were invalid. Records are always parsed by the
+        // RecursiveDescent engine.
+        //
+        // With more than one thread, the text is split into chunks of records
+        // that are parsed concurrently, but the callbacks are still invoked
+        // on the calling thread, one at a time.
+        bool ParseRecords(const char* json, std::size_t length, RecordCallbacks& callbacks);
+        bool ParseRecordsFile(const char* filename, RecordCallbacks& callbacks);
+
+        // The number of threads used by ParseRecords, and by Parse for a
+        // document with a large array (whose slices are parsed concurrently);
+        // 0 for one per core. The threads are started by the first parse that
+        // needs them, and kept until the parser is destroyed (or
+        // ReleaseBuffers() is called).
+        unsigned getThreads() const { return threads_; }
+        void setThreads(unsigned threads) { threads_ = threads; }
+
+        Delivery getDelivery() const { return delivery_; }
+        void setDelivery(Delivery delivery) { delivery_ = delivery; }
+
+        // Alternatively, the handler can be any class with (some of) the same
+        // member functions as Callbacks, which needn't be virtual. The calls
+        // are then resolved at compile time, so can be inlined, and events
+        // that the handler doesn't define cost nothing (numbers are only
+        // converted if it defines Int64, UInt64 or Double). Undefined events
+        // fall back as for Callbacks, e.g. from Int64 to Number to Value. Any
+        // of them can return an Action, rather than void. To receive path
+        // ids, define setPathId(PathTable::Id), which is called whenever the
+        // current path changes. A handler that ignores the paths can declare
+        // "static const bool c_usesPaths = false;", so they aren't built (and
+        // are all "").
+        template <typename Handler>
+        typename std::enable_if<!std::is_base_of<Callbacks, Handler>::value, bool>::type
+            Parse(const char* json, Handler& handler)
+        {
+            return ParseWith(json, nullptr, handler);
+        }
+
+        template <typename Handler>
+        typename std::enable_if<!std::is_base_of<Callbacks, Handler>::value, bool>::type
+            Parse(const char* json, std::size_t length, Handler& handler)
+        {
+            return ParseWith(json, json + length, handler);
+        }
+
+        // Parses straight into an object of a type declared with
+        // CYOJSON_FIELDS (see below), without any callbacks: each member of
+        // the JSON object whose key names a field is converted to the type
+        // of the field, in place. Members with other keys are skipped (but
+        // still checked), and fields without a member keep their values. A
+        // value of the wrong type, such as a fraction or an integer out of
+        // range for an int field (or a number out of range for a float),
+        // fails at the start of the value. As with subscriptions, skipped
+        // values aren't counted in the statistics.
+        template <typename T>
+        bool ParseInto(const char* json, T& object);
+
+        template <typename T>
+        bool ParseInto(const char* json, std::size_t length, T& object);
+
+        // Interns the paths in the given table (which must outlive the calls
+        // to Parse), making their ids available to the callbacks; nullptr to
+        // stop.
+        PathTable* getPathTable() const { return pathTable_; }
+        void setPathTable(PathTable* pathTable) { pathTable_ = pathTable; }
+
+        Engine getEngine() const { return engine_; }
+        void setEngine(Engine engine) { engine_ = engine; }
+
+        int getLine() const { return line_; }
+        int getColumn() const { return column_; }
+
+        // Whether the last parse was ended by a callback asking to Stop, in
+        // which case getLine() and getColumn() give where it stopped (just
+        // after the value, key or bracket of that callback).
+        bool IsStopped() const { return stopped_; }
+
+        // Statistics of the last parse. These are only counted if
+        // CYOJSON_STATISTICS is defined before #including cyojson.hpp;
+        // otherwise they're always zero, and counting them compiles to
+        // nothing. Values skipped because of the subscriptions aren't
+        // counted, and nor is text parsed using StreamParser, from a source
+        // or by ParseFile (other than its bytes and time).
+        struct Statistics
+        {
+            std::size_t bytes = 0; //parsed, up to the end or the error
+            std::size_t objects = 0;
+            std::size_t arrays = 0;
+            std::size_t keys = 0;
+            std::size_t strings = 0;
+            std::size_t numbers = 0;
+            std::size_t bools = 0;
+            std::size_t nulls = 0;
+            std::size_t unescapedStrings = 0; //strings and keys with escapes
+            std::size_t unicodeEscapes = 0;   //\u escapes (so two per surrogate pair)
+            std::size_t maxDepth = 0;         //of objects and arrays
+            std::size_t pathGrowths = 0;      //reallocations of the path
+            std::size_t allocations = 0;      //by the parser, of its own buffers
+            double seconds = 0;               //wall time
+        };
+
+        const Statistics& getStatistics() const { return statistics_; }
+
+        // The buffers that parsing needs (for the path, unescaped strings and
+        // the structural index) are kept from one call to the next, so once
+        // they're large enough, parsing a series of documents doesn't
+        // allocate. They're allocated by the given allocator (which must
+        // outlive the parser), or the heap if it's nullptr. Setting it, or
+        // calling ReleaseBuffers(), frees them. (Worker threads have buffers
+        // of their own, which are kept in the same way.)
+        Allocator* getAllocator() const { return allocator_; }
+        void setAllocator(Allocator* allocator);
+        void ReleaseBuffers();
+
+    private:
+        Engine engine_ = Engine::RecursiveDescent;
+        std::vector<std::string> subscriptions_;
+        SkipMode skipMode_ = SkipMode::Checked;
+        UTF8Mode utf8Mode_ = UTF8Mode::Unchecked;
+        PathTable* pathTable_ = nullptr;
+        unsigned threads_ = 1;
+        Delivery delivery_ = Delivery::Ordered;
+        std::size_t blockSize_ = 64 * 1024;
+        bool readAhead_ = false;
+        int line_ = 0;
+        int column_ = 0;
+        bool stopped_ = false;
+        Statistics statistics_;
+        Allocator* allocator_ = nullptr;
+        detail::ParserBuffers* buffers_ = nullptr; //created by the first parse
+        detail::WorkerPool* workers_ = nullptr; //created by the first parallel parse
+
+        detail::ParserBuffers& getBuffers();
+        detail::WorkerPool& getWorkers();
+
+        template <typename Handler>
+        bool ParseWith(const char* json, const char* end, Handler& handler);
+
+        bool ParseRecordsAt(const char* json, const char* end, std::size_t offset, RecordCallbacks& callbacks);
+
+        bool ValidateWith(const char* json, const char* end);
+
+        bool ParseBlocks(InputSource& source, Callbacks& callbacks);
+
+        template <typename T>
+        bool ParseIntoWith(const char* json, const char* end, T& object);
+    };
+
+    // The fields of a type that Parser::ParseInto can parse into, as declared
+    // by CYOJSON_FIELDS at global scope, e.g.
+    //
+    //     struct Item { int id; std::string name; std::vector<Item> parts; };
+    //     CYOJSON_FIELDS(Item, id, name, parts)
+    //
+    // Each field is a public member, named as the key of its JSON member, and
+    // can be a bool, an integer, a float or double, a std::string, another
+    // such type, or a std::vector (or, with C++17, a std::optional, which a
+    // null resets) of any of these. There can be up to 64 fields.
+    template <typename T>
+    struct Fields
+    {
+        static const bool c_bound = false;
+    };
+
+#define CYOJSON_FIELDS(Type, ...) \
+    namespace cyojson \
+    { \
+        template <> \
+        struct Fields<Type> \
+        { \
+            static const bool c_bound = true; \
+            static const std::size_t c_count = CYOJSON_DETAIL_COUNT(__VA_ARGS__); \
+            static const char* Name(std::size_t index) \
+            { \
+                switch (index) \
+                { \
+                CYOJSON_DETAIL_FOR_EACH(CYOJSON_DETAIL_FIELD_NAME, __VA_ARGS__) \
+                } \
+                return nullptr; \
+            } \
+            template <typename Reader> \
+            static bool Read(Reader& reader, Type& object, std::size_t index) \
+            { \
+                switch (index) \
+                { \
+                CYOJSON_DETAIL_FOR_EACH(CYOJSON_DETAIL_FIELD_READ, __VA_ARGS__) \
+                } \
+                return false; \
+            } \
+        }; \
+    }
+
+    // Push-based parser for input that arrives in pieces (e.g. from a socket).
+    // Each call to Feed() may pass any number of bytes, splitting the document
+    // anywhere (even within a string or number), and the callbacks are invoked
+    // as soon as each value is complete. Finish() must be called after the
+    // last piece, to check that the document is complete. Once a callback
+    // asks to Stop, the rest of the document is ignored (and not checked).
+    class StreamParser
+    {
+    public:
+        explicit StreamParser(Parser::Callbacks& callbacks);
+        StreamParser(const StreamParser&) = delete;
+        void operator=(const StreamParser&) = delete;
+        ~StreamParser();
+
+        bool Feed(const char* data, std::size_t length);
+        bool Finish();
+        void Reset();
+
+        // As for Parser; set before feeding a document.
+        PathTable* getPathTable() const { return pathTable_; }
+        void setPathTable(PathTable* pathTable);
+
+        Parser::UTF8Mode getUTF8Mode() const { return utf8Mode_; }
+        void setUTF8Mode(Parser::UTF8Mode utf8Mode);
+
+        int getLine() const { return line_; }
+        int getColumn() const { return column_; }
+
+        bool IsStopped() const;
+
+    private:
+        std::unique_ptr<detail::StreamParserImpl> impl_;
+        PathTable* pathTable_ = nullptr;
+        Parser::UTF8Mode utf8Mode_ = Parser::UTF8Mode::Unchecked;
+        int line_ = 0;
+        int column_ = 0;
+    };
+
+    // A parsed document, held in a compact form: a "tape" of 64-bit entries,
+    // one for each value and key (two for a number), with the strings in a
+    // separate buffer. Objects and arrays record where they end, so skipping
+    // over one takes constant time. The memory is kept by Parse() and Clear(),
+    // as are the parser's buffers, so reusing a Document for each of a series
+    // of documents doesn't need to allocate once it's large enough.
+    class Document
+    {
+    public:
+        enum class Type
+        {
+            Object,
+            Array,
+            String,
+            Int64,
+            UInt64,
+            Double,
+            Bool,
+            Null
+        };
+
+        // A value within the document; only valid until the document is next
+        // parsed or cleared. An Element is invalid if there's no such value
+        // (e.g. from Find() if there's no such key).
+        class Element
+        {
+        public:
+            Element() = default;
+
+            bool IsValid() const { return document_ != nullptr; }
+            Type getType() const;
+
+            // Objects and arrays: getFirst() is the first element of an array
+            // or the value of the first member of an object, then getNext()
+            // is the next, skipping over any children.
+            std::size_t getSize() const;
+            Element getFirst() const;
+            Element getNext() const;
+            Element Find(const char* key) const;
+            Element Find(const char* key, std::size_t length) const;
+
+            // The key of a member of an object (null-terminated).
+            const char* getKey() const;
+            std::size_t getKeyLength() const;
+
+            const char* getString() const; //null-terminated
+            std::size_t getStringLength() const;
+            std::int64_t getInt64() const;
+            std::uint64_t getUInt64() const;
+            double getDouble() const; //any number
+            bool getBool() const;
+
+        private:
+            friend class Document;
+
+            const Document* document_ = nullptr;
+            std::uint32_t index_ = 0;
+            bool member_ = false;
+
+            Element(const Document* document, std::uint32_t index, bool member)
+                : document_(document),
+                index_(index),
+                member_(member)
+            {
+            }
+
+            Element At(std::uint32_t index, bool member) const;
+        };
+
+        Document() = default;
+        Document(const Document&) = delete;
+        void operator=(const Document&) = delete;
+
+        bool Parse(const char* json);
+        bool Parse(const char* json, std::size_t length);
+
+        // The root object, or invalid if not successfully parsed.
+        Element getRoot() const;
+
+        void Clear();
+
+        Parser::Engine getEngine() const { return engine_; }
+        void setEngine(Parser::Engine engine) { engine_ = engine; }
+
+        int getLine() const { return line_; }
+        int getColumn() const { return column_; }
+
+        // As for Parser, applying to the parser's buffers (the document's own
+        // memory is always from the heap). ReleaseBuffers() also clears the
+        // document, freeing its memory.
+        Allocator* getAllocator() const { return parser_.getAllocator(); }
+        void setAllocator(Allocator* allocator) { parser_.setAllocator(allocator); }
+        void ReleaseBuffers();
+
+    private:
+        friend class detail::DocumentBuilder;
+
+        std::vector<std::uint64_t> tape_;
+        std::vector<char> strings_;
+        std::vector<std::uint32_t> stack_; //the start of each open object or array
+        Parser parser_;                    //kept for its buffers
+        Parser::Engine engine_ = Parser::Engine::RecursiveDescent;
+        int line_ = 0;
+        int column_ = 0;
+
+        bool ParseWith(const char* json, const char* end);
+
+        std::uint64_t getEntry(std::uint32_t index) const { return tape_[index]; }
+        const char* getStringAt(std::uint64_t entry) const;
+        std::size_t getStringLengthAt(std::uint64_t entry) const;
+    };
+
+    // On-demand access to a document, which is only parsed as far as needed
+    // to find the values that are asked for, skipping over everything else
+    // (by matching brackets and quotes, unless the skip mode is Checked; note
+    // that this is the opposite of Parser's default). So only the parts of
+    // the document that are navigated are checked, and if they contain an
+    // error, the element is invalid and HasError() is true, with getLine()
+    // and getColumn() reporting its position as for Parser. The JSON text
+    // must outlive the LazyDocument.
+    class LazyDocument
+    {
+    public:
+        class Element
+        {
+        public:
+            Element() = default;
+
+            bool IsValid() const { return document_ != nullptr; }
+
+            // Fails (without an error) if the value isn't of the given type.
+            bool getType(Document::Type& type) const;
+            bool getInt64(std::int64_t& value) const;
+            bool getUInt64(std::uint64_t& value) const;
+            bool getDouble(double& value) const; //any number
+            bool getBool(bool& value) const;
+            bool IsNull() const;
+
+            // As for Callbacks::String, the string isn't null-terminated, and
+            // is only valid until the next call (to any element).
+            bool getString(const char*& str, std::size_t& length) const;
+
+            // The key of a member of an object (as for getString).
+            bool getKey(const char*& key, std::size_t& length) const;
+
+            // A member of an object, scanning its members in turn.
+            Element Find(const char* key) const;
+            Element operator[](const char* key) const { return Find(key); }
+
+            // The first element of an array or the first member of an object,
+            // then the next, skipping over the previous one.
+            Element getFirst() const;
+            Element getNext() const;
+
+        private:
+            friend class LazyDocument;
+
+            enum class Context
+            {
+                Root,
+                Member,
+                Element
+            };
+
+            LazyDocument* document_ = nullptr;
+            const char* next_ = nullptr;
+            int line_ = 0;
+            int column_ = 0;
+            const char* key_ = nullptr;
+            Context context_ = Context::Root;
+
+            Element(LazyDocument* document, const char* next, int line, int column, const char* key, Context context)
+                : document_(document),
+                next_(next),
+                line_(line),
+                column_(column),
+                key_(key),
+                context_(context)
+            {
+            }
+
+            Element ParseMember(detail::LazyScanner& scanner) const;
+            Element ParseElement(detail::LazyScanner& scanner, const char* key, Context context) const;
+        };
+
+        explicit LazyDocument(const char* json)
+            : json_(json)
+        {
+        }
+
+        // As above, for text of the given length, which needn't be
+        // null-terminated.
+        LazyDocument(const char* json, std::size_t length)
+            : json_(json),
+            end_(json + length)
+        {
+        }
+
+        LazyDocument(const LazyDocument&) = delete;
+        void operator=(const LazyDocument&) = delete;
+
+        // The root object.
+        Element getRoot();
+        Element operator[](const char* key) { return getRoot().Find(key); }
+
+        Parser::SkipMode getSkipMode() const { return skipMode_; }
+        void setSkipMode(Parser::SkipMode skipMode) { skipMode_ = skipMode; }
+
+        bool HasError() const { return error_; }
+        int getLine() const { return line_; }
+        int getColumn() const { return column_; }
+
+    private:
+        friend class detail::LazyScanner;
+
+        const char* const json_;
+        const char* const end_ = nullptr; //or null-terminated
+        Parser::SkipMode skipMode_ = Parser::SkipMode::Unchecked;
+        bool error_ = false;
+        int line_ = 0;
+        int column_ = 0;
+        std::string scratch_;
+    };
+
+    // Writes JSON text (without whitespace), either into a buffer that grows
+    // as needed, or through a fixed-size buffer to a sink. The calls are the
+    // same as the callbacks, without the paths, and must form a valid
+    // document: they aren't checked, other than that a key or string must be
+    // valid UTF-8 if it's to produce valid JSON (control chars, quotes and
+    // backslashes are escaped; everything else is copied). Doubles are
+    // written as the shortest text that reads back as the same value (with
+    // ".0" if they're whole, so that they read back as doubles), and as null
+    // if they're infinite or NaN.
+    //
+    // A Writer is also a Parser::Callbacks, which ignores the paths, so
+    // parsing with it rewrites the document; numbers are copied as they are.
+    class Writer final : public Parser::Callbacks
+    {
+    public:
+        // Receives the text as the buffer fills, and when it's flushed.
+        class Sink
+        {
+        public:
+            virtual ~Sink() { }
+
+            virtual void Write(const char* data, std::size_t length) = 0;
+        };
+
+        // The memory for the buffer comes from the allocator (which must
+        // outlive the writer), or the heap if it's nullptr.
+        explicit Writer(Allocator* allocator = nullptr);
+        explicit Writer(Sink& sink, Allocator* allocator = nullptr);
+        Writer(const Writer&) = delete;
+        void operator=(const Writer&) = delete;
+        ~Writer(); //flushes
+
+        // Without a sink, the text written so far (not null-terminated).
+        const char* getData() const { return buffer_; }
+        std::size_t getSize() const { return size_; }
+
+        // Writes the buffered text to the sink, if any.
+        void Flush();
+
+        // Discards the text (without flushing it), keeping the buffer, so as
+        // to write another document.
+        void Clear();
+
+        void ObjectStart();
+        void ObjectEnd();
+        void ArrayStart();
+        void ArrayEnd();
+        void Key(const char* key, std::size_t length);
+        void Key(const char* key);
+        void String(const char* value, std::size_t length);
+        void String(const char* value);
+        void Int64(std::int64_t value);
+        void UInt64(std::uint64_t value);
+        void Double(double value);
+        void Bool(bool value);
+        void Null();
+
+        // Writes the text of a number as it is, so it must be valid JSON.
+        void Number(const char* text, std::size_t length);
+
+        void ObjectStart(const char*) override { ObjectStart(); }
+        void ObjectEnd(const char*) override { ObjectEnd(); }
+        void ArrayStart(const char*) override { ArrayStart(); }
+        void ArrayEnd(const char*) override { ArrayEnd(); }
+        void Key(const char*, const char* key, std::size_t length) override { Key(key, length); }
+        void String(const char*, const char* value, std::size_t length) override { String(value, length); }
+        void Number(const char*, const char* value, std::size_t length) override { Number(value, length); }
+        void Int64(const char*, std::int64_t, const char* text, std::size_t length) override { Number(text, length); }
+        void UInt64(const char*, std::uint64_t, const char* text, std::size_t length) override { Number(text, length); }
+        void Double(const char*, double, const char* text, std::size_t length) override { Number(text, length); }
+        void Bool(const char*, bool value) override { Bool(value); }
+        void Null(const char*) override { Null(); }
+
+    private:
+        Sink* const sink_;
+        Allocator* const allocator_;
+        char* buffer_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t capacity_ = 0;
+        bool comma_ = false; //whether the next value or key follows another
+
+        char* Reserve(std::size_t length);
+        void Grow(std::size_t length);
+        void Append(const char* data, std::size_t length);
+        char* StartValue(std::size_t length);
+        void WriteString(const char* value, std::size_t length);
+    };
+
+    // A compact binary recording of the events of a document (a "tape"), which
+    // can be replayed into any callbacks without tokenising or unescaping
+    // anything: the keys and strings are stored unescaped, and the numbers
+    // both converted and as text. A tape can be saved to a file and loaded by
+    // mapping the file into memory, so it's replayed straight from the page
+    // cache. The format is native to the platform (it records the byte order,
+    // and a file from a different one fails to load).
+    class EventTape
+    {
+    public:
+        EventTape();
+        EventTape(const EventTape&) = delete;
+        void operator=(const EventTape&) = delete;
+        ~EventTape();
+
+        // Parses the text, recording its events in place of any held. If the
+        // text is invalid, the tape is left empty, and getLine() and
+        // getColumn() report the error as for Parser.
+        bool Record(const char* json, std::size_t length);
+
+        // Invokes the recorded events, just as parsing the text would have,
+        // on Parser::Callbacks or a static handler (see Parser). The paths
+        // are interned in the given table, if any, as for setPathTable. Does
+        // nothing if the tape is empty.
+        template <typename Handler>
+        void Replay(Handler& handler, PathTable* pathTable = nullptr);
+
+        // Saves the tape, writing a temporary file and renaming it, so
+        // another process never sees it partly written.
+        bool Save(const char* filename) const;
+
+        // Loads a saved tape, mapping the file where possible (so it mustn't
+        // be modified meanwhile, which Save() doesn't). Fails, leaving the
+        // tape empty, if the file isn't a tape, or its checksum doesn't match
+        // (e.g. if it's been truncated).
+        bool Load(const char* filename);
+
+        bool IsEmpty() const { return !events_; }
+        void Clear();
+
+        // Of the JSON text that was recorded (see HashContent).
+        std::uint64_t getContentHash() const { return contentHash_; }
+        std::size_t getContentLength() const { return contentLength_; }
+
+        // The serialised tape, as saved.
+        const char* getData() const { return data_; }
+        std::size_t getSize() const { return size_; }
+
+        // As for Parser, applying to Record().
+        Parser::Engine getEngine() const { return engine_; }
+        void setEngine(Parser::Engine engine) { engine_ = engine; }
+        Parser::UTF8Mode getUTF8Mode() const { return utf8Mode_; }
+        void setUTF8Mode(Parser::UTF8Mode utf8Mode) { utf8Mode_ = utf8Mode; }
+
+        // Where Record() ended, as for Parser; a saved tape keeps them.
         int getLine() const { return line_; }
         int getColumn() const { return column_; }
 
+        // A 64-bit hash of the text, by which tapes are identified.
+        static std::uint64_t HashContent(const char* json, std::size_t length);
+
     private:
+        Parser::Engine engine_ = Parser::Engine::RecursiveDescent;
+        Parser::UTF8Mode utf8Mode_ = Parser::UTF8Mode::Unchecked;
         int line_ = 0;
         int column_ = 0;
+        std::vector<char> buffer_;                 //the tape, unless mapped
+        std::unique_ptr<detail::MappedFile> file_; //the tape, if mapped
+        const char* data_ = nullptr;
+        std::size_t size_ = 0;
+        const char* events_ = nullptr;
+        const char* eventsEnd_ = nullptr;
+        std::uint64_t contentHash_ = 0;
+        std::size_t contentLength_ = 0;
+        PathTable paths_;                    //the recorded path ids
+        std::vector<PathTable::Id> ids_;     //their ids in the replay table
+
+        bool Open();
     };
 
+    // Caches the tapes of documents in a directory (which must exist), keyed
+    // by the hash and length of their text. A document that has been parsed
+    // before is replayed from its tape, rather than parsed; otherwise it's
+    // parsed into a tape, which is replayed and saved (if the text is
+    // valid). Any number of processes may share the directory. Reading the
+    // text (to hash it) is much faster than parsing it, but a cache can only
+    // help if parsing the text is slower than reading its tape.
+    class TapeCache
+    {
+    public:
+        explicit TapeCache(const char* directory)
+            : directory_(directory)
+        {
+        }
+
+        TapeCache(const TapeCache&) = delete;
+        void operator=(const TapeCache&) = delete;
+
+        bool Parse(const char* json, std::size_t length, Parser::Callbacks& callbacks);
+        bool ParseFile(const char* filename, Parser::Callbacks& callbacks);
+
+        // Whether the last parse was replayed from the cache.
+        bool IsHit() const { return hit_; }
+
+        // As for Parser. Tapes of text parsed with UTF-8 checking are kept
+        // apart from those without.
+        PathTable* getPathTable() const { return pathTable_; }
+        void setPathTable(PathTable* pathTable) { pathTable_ = pathTable; }
+        Parser::UTF8Mode getUTF8Mode() const { return utf8Mode_; }
+        void setUTF8Mode(Parser::UTF8Mode utf8Mode) { utf8Mode_ = utf8Mode; }
+
+        int getLine() const { return line_; }
+        int getColumn() const { return column_; }
+
+        // The file in which the tape of the given text is cached.
+        std::string getFilename(const char* json, std::size_t length) const;
+
+    private:
+        const std::string directory_;
+        PathTable* pathTable_ = nullptr;
+        Parser::UTF8Mode utf8Mode_ = Parser::UTF8Mode::Unchecked;
+        bool hit_ = false;
+        int line_ = 0;
+        int column_ = 0;
+
+        std::string getFilename(std::uint64_t hash, std::size_t length) const;
+    };
+
+    // Transforms that copy the tokens of a document straight through, without
+    // parsing the values, building paths or invoking callbacks, so they run
+    // at close to the speed of copying. The text isn't checked, so it must be
+    // valid JSON (otherwise the output is unspecified; see Parser::Minify
+    // and Parser::Reformat to check it first); as for Parse, nothing beyond
+    // the given length is read, other than by aligned vector loads.
+
+    // Removes the whitespace outside strings, writing at most length chars to
+    // out, which may be json itself (to minify in place). Returns the number
+    // of chars written.
+    std::size_t Minify(const char* json, std::size_t length, char* out);
+    void Minify(const char* json, std::size_t length, std::string& out);
+
+    // Puts each member and element on a line of its own, indented by the
+    // given number of spaces per level, with a space after each colon; empty
+    // objects and arrays stay as {} and []. Replaces the contents of out.
+    void Reformat(const char* json, std::size_t length, std::string& out, int indent = 4);
+
     inline void Parser::Callbacks::ObjectStart(const char*) { }
     inline void Parser::Callbacks::ObjectEnd(const char*) { }
     inline void Parser::Callbacks::ArrayStart(const char*) { }
     inline void Parser::Callbacks::ArrayEnd(const char*) { }
     inline void Parser::Callbacks::Value(const char*, const char*) { }
+    inline void Parser::Callbacks::Key(const char*, const char*, std::size_t) { }
+
+    inline void Parser::Callbacks::String(const char* path, const char* value, std::size_t length)
+    {
+        text_.assign(value, length);
+        Value(path, text_.c_str());
+    }
+
+    inline void Parser::Callbacks::Number(const char* path, const char* value, std::size_t length)
+    {
+        text_.assign(value, length);
+        Value(path, text_.c_str());
+    }
+
+    inline void Parser::Callbacks::Int64(const char* path, std::int64_t, const char* text, std::size_t length)
+    {
+        Number(path, text, length);
+    }
+
+    inline void Parser::Callbacks::UInt64(const char* path, std::uint64_t, const char* text, std::size_t length)
+    {
+        Number(path, text, length);
+    }
+
+    inline void Parser::Callbacks::Double(const char* path, double, const char* text, std::size_t length)
+    {
+        Number(path, text, length);
+    }
+
+    inline void Parser::Callbacks::Bool(const char* path, bool value)
+    {
+        Value(path, (value ? "true" : "false"));
+    }
+
+    inline void Parser::Callbacks::Null(const char* path)
+    {
+        Value(path, "null");
+    }
+
+    inline void Parser::RecordCallbacks::RecordStart(std::size_t) { }
+    inline void Parser::RecordCallbacks::RecordEnd(std::size_t) { }
+    inline void Parser::RecordCallbacks::RecordError(std::size_t, int, int) { }
 }
 
+#include "detail/path.hpp"
 #include "detail/parser.hpp"
+#include "detail/validator.hpp"
+#include "detail/binder.hpp"
+#include "detail/stream_parser.hpp"
+#include "detail/file.hpp"
+#include "detail/source.hpp"
+#include "detail/records.hpp"
+#include "detail/document.hpp"
+#include "detail/lazy.hpp"
+#include "detail/writer.hpp"
+#include "detail/transform.hpp"
+#include "detail/tape.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
 
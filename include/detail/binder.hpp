@@ -0,0 +1,558 @@
+/*
+[CyoJSON] detail/binder.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_BINDER_HPP
+#define __CYOJSON_DETAIL_BINDER_HPP
+
+#include "scanner.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Expands m(index, field) for each field, for CYOJSON_FIELDS; the indexes
+// count down to 0. (CYOJSON_DETAIL_EXPAND is for MSVC, which otherwise
+// passes __VA_ARGS__ on as a single argument.)
+#define CYOJSON_DETAIL_EXPAND(x) x
+#define CYOJSON_DETAIL_CONCAT(a, b) CYOJSON_DETAIL_CONCAT_(a, b)
+#define CYOJSON_DETAIL_CONCAT_(a, b) a##b
+
+#define CYOJSON_DETAIL_COUNT(...) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_COUNT_N(__VA_ARGS__, \
+    64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, \
+    48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, \
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, \
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, \
+    0))
+#define CYOJSON_DETAIL_COUNT_N( \
+    _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+    _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, \
+    _33, _34, _35, _36, _37, _38, _39, _40, _41, _42, _43, _44, _45, _46, _47, _48, \
+    _49, _50, _51, _52, _53, _54, _55, _56, _57, _58, _59, _60, _61, _62, _63, _64, \
+    N, ...) N
+
+#define CYOJSON_DETAIL_FOR_EACH(m, ...) \
+    CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_CONCAT(CYOJSON_DETAIL_FOR_EACH_, CYOJSON_DETAIL_COUNT(__VA_ARGS__))(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_1(m, x) m(0, x)
+#define CYOJSON_DETAIL_FOR_EACH_2(m, x, ...) m(1, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_1(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_3(m, x, ...) m(2, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_2(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_4(m, x, ...) m(3, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_3(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_5(m, x, ...) m(4, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_4(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_6(m, x, ...) m(5, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_5(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_7(m, x, ...) m(6, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_6(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_8(m, x, ...) m(7, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_7(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_9(m, x, ...) m(8, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_8(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_10(m, x, ...) m(9, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_9(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_11(m, x, ...) m(10, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_10(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_12(m, x, ...) m(11, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_11(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_13(m, x, ...) m(12, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_12(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_14(m, x, ...) m(13, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_13(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_15(m, x, ...) m(14, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_14(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_16(m, x, ...) m(15, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_15(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_17(m, x, ...) m(16, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_16(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_18(m, x, ...) m(17, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_17(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_19(m, x, ...) m(18, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_18(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_20(m, x, ...) m(19, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_19(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_21(m, x, ...) m(20, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_20(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_22(m, x, ...) m(21, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_21(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_23(m, x, ...) m(22, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_22(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_24(m, x, ...) m(23, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_23(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_25(m, x, ...) m(24, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_24(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_26(m, x, ...) m(25, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_25(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_27(m, x, ...) m(26, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_26(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_28(m, x, ...) m(27, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_27(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_29(m, x, ...) m(28, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_28(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_30(m, x, ...) m(29, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_29(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_31(m, x, ...) m(30, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_30(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_32(m, x, ...) m(31, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_31(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_33(m, x, ...) m(32, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_32(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_34(m, x, ...) m(33, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_33(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_35(m, x, ...) m(34, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_34(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_36(m, x, ...) m(35, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_35(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_37(m, x, ...) m(36, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_36(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_38(m, x, ...) m(37, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_37(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_39(m, x, ...) m(38, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_38(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_40(m, x, ...) m(39, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_39(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_41(m, x, ...) m(40, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_40(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_42(m, x, ...) m(41, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_41(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_43(m, x, ...) m(42, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_42(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_44(m, x, ...) m(43, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_43(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_45(m, x, ...) m(44, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_44(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_46(m, x, ...) m(45, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_45(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_47(m, x, ...) m(46, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_46(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_48(m, x, ...) m(47, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_47(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_49(m, x, ...) m(48, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_48(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_50(m, x, ...) m(49, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_49(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_51(m, x, ...) m(50, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_50(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_52(m, x, ...) m(51, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_51(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_53(m, x, ...) m(52, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_52(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_54(m, x, ...) m(53, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_53(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_55(m, x, ...) m(54, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_54(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_56(m, x, ...) m(55, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_55(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_57(m, x, ...) m(56, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_56(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_58(m, x, ...) m(57, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_57(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_59(m, x, ...) m(58, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_58(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_60(m, x, ...) m(59, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_59(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_61(m, x, ...) m(60, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_60(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_62(m, x, ...) m(61, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_61(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_63(m, x, ...) m(62, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_62(m, __VA_ARGS__))
+#define CYOJSON_DETAIL_FOR_EACH_64(m, x, ...) m(63, x) CYOJSON_DETAIL_EXPAND(CYOJSON_DETAIL_FOR_EACH_63(m, __VA_ARGS__))
+
+#define CYOJSON_DETAIL_FIELD_NAME(index, field) case index: return #field;
+#define CYOJSON_DETAIL_FIELD_READ(index, field) case index: return reader.Read(object.field);
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // A perfect hash of the names of the fields of a type: the seed is
+        // chosen so that no two names share a slot, so finding a key takes one
+        // hash and at most one comparison. It's built on first use, as the
+        // field names aren't known until then.
+        class FieldHash final
+        {
+        public:
+            static const std::size_t c_noField = 0xFFFF;
+
+            FieldHash(const char* (*name)(std::size_t index), std::size_t count)
+            {
+                assert(count < c_noField);
+
+                for (std::size_t index = 0; index < count; ++index)
+                {
+                    const char* const field = name(index);
+                    names_.push_back(field);
+                    lengths_.push_back(std::strlen(field));
+                }
+
+                // Try each seed in turn, with a larger table if none of them
+                // will do...
+                std::size_t size = 4;
+                while (size < 2 * count)
+                    size *= 2;
+                for (;;)
+                {
+                    for (seed_ = 1; seed_ <= c_maxSeeds; ++seed_)
+                    {
+                        if (Build(size))
+                            return;
+                    }
+                    size *= 2;
+                }
+            }
+
+            FieldHash(const FieldHash&) = delete;
+
+            void operator=(const FieldHash&) = delete;
+
+            std::size_t Find(const char* key, std::size_t length) const
+            {
+                const std::size_t index = slots_[Hash(key, length, seed_) & mask_];
+                if (index == c_noField || lengths_[index] != length || std::memcmp(names_[index], key, length) != 0)
+                    return c_noField;
+                return index;
+            }
+
+        private:
+            static const std::uint32_t c_maxSeeds = 256;
+
+            std::vector<const char*> names_;
+            std::vector<std::size_t> lengths_;
+            std::vector<std::uint16_t> slots_; //the index of each field, or c_noField
+            std::uint32_t mask_ = 0;
+            std::uint32_t seed_ = 0;
+
+            static std::uint32_t Hash(const char* key, std::size_t length, std::uint32_t seed)
+            {
+                // FNV-1a, starting from the seed...
+                std::uint32_t hash = seed ^ (std::uint32_t)length;
+                for (std::size_t i = 0; i < length; ++i)
+                    hash = (hash ^ (unsigned char)key[i]) * 0x01000193u;
+                return hash ^ (hash >> 16);
+            }
+
+            bool Build(std::size_t size)
+            {
+                slots_.assign(size, (std::uint16_t)c_noField);
+                mask_ = (std::uint32_t)(size - 1);
+                for (std::size_t index = 0; index < names_.size(); ++index)
+                {
+                    std::uint16_t& slot = slots_[Hash(names_[index], lengths_[index], seed_) & mask_];
+                    if (slot != c_noField)
+                    {
+                        if (lengths_[slot] == lengths_[index] && std::memcmp(names_[slot], names_[index], lengths_[index]) == 0)
+                            continue; //a repeated name, which only the first field gets
+                        return false;
+                    }
+                    slot = (std::uint16_t)index;
+                }
+                return true;
+            }
+        };
+
+        template <typename T>
+        inline const FieldHash& GetFieldHash()
+        {
+            static const FieldHash hash(&Fields<T>::Name, Fields<T>::c_count);
+            return hash;
+        }
+
+        // Whether the number fits in an integer of type T, which it's
+        // converted to if so.
+        template <typename T>
+        inline bool ToInteger(const NumberValue& number, T& value)
+        {
+            typedef std::numeric_limits<T> Limits;
+
+            switch (number.type)
+            {
+            case NumberValue::Type::Int64:
+                if (number.int64 < 0)
+                {
+                    if (!Limits::is_signed || number.int64 < (std::int64_t)Limits::min())
+                        return false;
+                }
+                else if ((std::uint64_t)number.int64 > (std::uint64_t)Limits::max())
+                {
+                    return false;
+                }
+                value = (T)number.int64;
+                return true;
+
+            case NumberValue::Type::UInt64:
+                if (number.uint64 > (std::uint64_t)Limits::max())
+                    return false;
+                value = (T)number.uint64;
+                return true;
+
+            default:
+                return false; //a fraction, an exponent or -0
+            }
+        }
+
+        // Whether the number is within the range of a floating-point type T
+        // (once rounded to it), which it's converted to if so. Infinities,
+        // from exponents beyond the range of a double, are kept.
+        template <typename T>
+        inline bool ToFloatingPoint(const NumberValue& number, T& value)
+        {
+            typedef std::numeric_limits<T> Limits;
+
+            switch (number.type)
+            {
+            case NumberValue::Type::Int64:
+                value = (T)number.int64;
+                return true;
+
+            case NumberValue::Type::UInt64:
+                value = (T)number.uint64;
+                return true;
+
+            default:
+                if (Limits::max_exponent < std::numeric_limits<double>::max_exponent && std::isfinite(number.dbl))
+                {
+                    // Halfway between the largest T and the next power of
+                    // two, which rounds to infinity...
+                    const double overflow = (double)Limits::max() + std::ldexp(1.0, Limits::max_exponent - Limits::digits - 1);
+                    if (std::fabs(number.dbl) >= overflow)
+                        return false;
+                }
+                value = (T)number.dbl;
+                return true;
+            }
+        }
+
+        // The engine behind Parser::ParseInto: the grammar of ParserImpl, and
+        // its error positions, but parsing each value straight into a field,
+        // chosen at compile time by its type.
+        class Binder final : private Scanner
+        {
+        public:
+            Binder(const char* next, const char* end, BufferString& scratch)
+                : Scanner(next, end, scratch)
+            {
+            }
+
+            Binder(const Binder&) = delete;
+
+            void operator=(const Binder&) = delete;
+
+            // Counts the statistics, as for ParserImpl (if c_statistics).
+            void setStatistics(Parser::Statistics* stats)
+            {
+                stats_ = stats;
+            }
+
+            void setUTF8Mode(Parser::UTF8Mode mode)
+            {
+                checkUTF8_ = (mode == Parser::UTF8Mode::Checked);
+            }
+
+            template <typename T>
+            bool Parse(T& object, int& line, int& column)
+            {
+                const char* const start = next_;
+                bool success = Read(object);
+                if (success)
+                {
+                    SkipWhitespace();
+                    success = IsEnd();
+                }
+
+                line = line_;
+                column = column_;
+                if (c_statistics && stats_)
+                    stats_->bytes += (std::size_t)(next_ - start);
+                return success;
+            }
+
+            // The value for each type of field (called by Fields<T>::Read)...
+
+            bool Read(bool& value)
+            {
+                if (IsNext(c_true))
+                    value = true;
+                else if (IsNext(c_false))
+                    value = false;
+                else
+                    return false;
+                Count(&Parser::Statistics::bools);
+                return true;
+            }
+
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value, bool>::type
+                Read(T& value)
+            {
+                SkipWhitespace();
+
+                const char* const start = next_;
+                const char* number;
+                std::size_t length;
+                NumberValue numberValue;
+                if (!ParseNumber(number, length, numberValue))
+                    return false;
+                if (!ToInteger(numberValue, value))
+                {
+                    column_ -= (int)(next_ - start);
+                    next_ = start;
+                    return false;
+                }
+                Count(&Parser::Statistics::numbers);
+                return true;
+            }
+
+            template <typename T>
+            typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+                Read(T& value)
+            {
+                SkipWhitespace();
+
+                const char* const start = next_;
+                const char* number;
+                std::size_t length;
+                NumberValue numberValue;
+                if (!ParseNumber(number, length, numberValue))
+                    return false;
+                if (!ToFloatingPoint(numberValue, value))
+                {
+                    column_ -= (int)(next_ - start);
+                    next_ = start;
+                    return false;
+                }
+                Count(&Parser::Statistics::numbers);
+                return true;
+            }
+
+            bool Read(std::string& value)
+            {
+                const char* str;
+                std::size_t length;
+                if (!ParseString(str, length))
+                    return false;
+                value.assign(str, length);
+                Count(&Parser::Statistics::strings);
+                return true;
+            }
+
+            template <typename T, typename Allocator>
+            bool Read(std::vector<T, Allocator>& values)
+            {
+                if (!IsNext('['))
+                    return false;
+
+                Count(&Parser::Statistics::arrays);
+                CountNested();
+                values.clear();
+
+                if (!IsNext(']'))
+                {
+                    do
+                    {
+                        values.emplace_back();
+                        if (!Read(values.back()))
+                            return false;
+                    }
+                    while (IsNext(','));
+
+                    if (!IsNext(']'))
+                        return false;
+                }
+
+                EndNested();
+                return true;
+            }
+
+            // (As std::vector<bool> has no bool& to read into.)
+            template <typename Allocator>
+            bool Read(std::vector<bool, Allocator>& values)
+            {
+                if (!IsNext('['))
+                    return false;
+
+                Count(&Parser::Statistics::arrays);
+                CountNested();
+                values.clear();
+
+                if (!IsNext(']'))
+                {
+                    do
+                    {
+                        bool value;
+                        if (!Read(value))
+                            return false;
+                        values.push_back(value);
+                    }
+                    while (IsNext(','));
+
+                    if (!IsNext(']'))
+                        return false;
+                }
+
+                EndNested();
+                return true;
+            }
+
+#ifdef CYOJSON_HAS_OPTIONAL
+            template <typename T>
+            bool Read(std::optional<T>& value)
+            {
+                if (IsNext(c_null))
+                {
+                    value.reset();
+                    Count(&Parser::Statistics::nulls);
+                    return true;
+                }
+                if (!value)
+                    value.emplace();
+                return Read(*value);
+            }
+#endif
+
+            template <typename T>
+            typename std::enable_if<Fields<T>::c_bound, bool>::type
+                Read(T& object)
+            {
+                if (!IsNext('{'))
+                    return false;
+
+                Count(&Parser::Statistics::objects);
+                CountNested();
+
+                if (!IsNext('}'))
+                {
+                    const FieldHash& fields = GetFieldHash<T>();
+                    do
+                    {
+                        const char* key;
+                        std::size_t keyLength;
+                        if (!ParseString(key, keyLength))
+                            return false;
+                        Count(&Parser::Statistics::keys);
+                        const std::size_t index = fields.Find(key, keyLength);
+
+                        if (!IsNext(':'))
+                            return false;
+
+                        if (index == FieldHash::c_noField ? !SkipValue() : !Fields<T>::Read(*this, object, index))
+                            return false;
+                    }
+                    while (IsNext(','));
+
+                    if (!IsNext('}'))
+                        return false;
+                }
+
+                EndNested();
+                return true;
+            }
+        };
+    }
+
+    template <typename T>
+    inline bool Parser::ParseInto(const char* json, T& object)
+    {
+        return ParseIntoWith(json, nullptr, object);
+    }
+
+    template <typename T>
+    inline bool Parser::ParseInto(const char* json, std::size_t length, T& object)
+    {
+        return ParseIntoWith(json, json + length, object);
+    }
+
+    template <typename T>
+    inline bool Parser::ParseIntoWith(const char* json, const char* end, T& object)
+    {
+        static_assert(Fields<T>::c_bound, "The type must be declared with CYOJSON_FIELDS");
+
+        statistics_ = Statistics();
+        stopped_ = false;
+        if (!json)
+            return false;
+
+        detail::StatisticsTimer timer(statistics_);
+        detail::Binder binder(json, end, getBuffers().scratch);
+        binder.setStatistics(detail::c_statistics ? &statistics_ : nullptr);
+        binder.setUTF8Mode(utf8Mode_);
+        return binder.Parse(object, line_, column_);
+    }
+}
+
+#endif //__CYOJSON_DETAIL_BINDER_HPP
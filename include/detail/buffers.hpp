@@ -0,0 +1,192 @@
+/*
+[CyoJSON] detail/buffers.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_BUFFERS_HPP
+#define __CYOJSON_DETAIL_BUFFERS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // A standard allocator that takes its memory from an Allocator, or
+        // from the heap if that's nullptr. Elements are default-initialised
+        // rather than value-initialised, so resizing a vector of ints doesn't
+        // zero them (and so doesn't touch pages that won't be used).
+        template <typename T>
+        class BufferAllocator
+        {
+        public:
+            typedef T value_type;
+            typedef std::true_type propagate_on_container_copy_assignment;
+            typedef std::true_type propagate_on_container_move_assignment;
+            typedef std::true_type propagate_on_container_swap;
+
+            explicit BufferAllocator(Allocator* allocator = nullptr)
+                : allocator_(allocator)
+            {
+            }
+
+            template <typename U>
+            BufferAllocator(const BufferAllocator<U>& other)
+                : allocator_(other.getAllocator())
+            {
+            }
+
+            Allocator* getAllocator() const { return allocator_; }
+
+            T* allocate(std::size_t count)
+            {
+                const std::size_t size = count * sizeof(T);
+                return static_cast<T*>(allocator_ ? allocator_->Allocate(size) : ::operator new(size));
+            }
+
+            void deallocate(T* p, std::size_t count)
+            {
+                if (allocator_)
+                    allocator_->Deallocate(p, count * sizeof(T));
+                else
+                    ::operator delete(p);
+            }
+
+            template <typename U>
+            void construct(U* p)
+            {
+                ::new ((void*)p) U;
+            }
+
+            template <typename U, typename... Args>
+            void construct(U* p, Args&&... args)
+            {
+                ::new ((void*)p) U(std::forward<Args>(args)...);
+            }
+
+        private:
+            Allocator* allocator_;
+        };
+
+        template <typename T, typename U>
+        inline bool operator==(const BufferAllocator<T>& lhs, const BufferAllocator<U>& rhs)
+        {
+            return (lhs.getAllocator() == rhs.getAllocator());
+        }
+
+        template <typename T, typename U>
+        inline bool operator!=(const BufferAllocator<T>& lhs, const BufferAllocator<U>& rhs)
+        {
+            return (lhs.getAllocator() != rhs.getAllocator());
+        }
+
+        typedef std::basic_string<char, std::char_traits<char>, BufferAllocator<char>> BufferString;
+
+        template <typename T>
+        using BufferVector = std::vector<T, BufferAllocator<T>>;
+
+        // Result of stage one: the offset of every structural char outside a
+        // string ({ } [ ] : ,), of every quote, of every backslash or control
+        // char within a string, and of the first char of every number or
+        // literal. Also counts the line breaks, for the final line and column.
+        struct StructuralIndex
+        {
+            explicit StructuralIndex(Allocator* allocator = nullptr)
+                : positions(BufferAllocator<std::uint32_t>(allocator))
+            {
+            }
+
+            BufferVector<std::uint32_t> positions; //its size is the capacity
+            std::size_t count = 0;
+            std::size_t lineBreaks = 0;
+            std::size_t lastLineStart = 0;
+        };
+
+        // What BulkArray finds: the largest array in the text, with the keys
+        // of its path, and the slices it's divided into.
+        struct BulkBuffers
+        {
+            struct Level
+            {
+                std::uint32_t open; //the index of the bracket in the structural index
+                std::uint32_t key;  //that of the key of which this is the value, if any
+            };
+
+            explicit BulkBuffers(Allocator* allocator = nullptr)
+                : levels(BufferAllocator<Level>(allocator)),
+                keyIndexes(BufferAllocator<std::uint32_t>(allocator)),
+                arrayKeyIndexes(BufferAllocator<std::uint32_t>(allocator)),
+                keys(BufferAllocator<std::pair<const char*, std::size_t>>(allocator)),
+                path(BufferAllocator<char>(allocator)),
+                slices(BufferAllocator<std::pair<const char*, const char*>>(allocator))
+            {
+            }
+
+            BufferVector<Level> levels;                                 //the open arrays and objects
+            BufferVector<std::uint32_t> keyIndexes;                     //the keys of their path
+            BufferVector<std::uint32_t> arrayKeyIndexes;                //of the largest array so far
+            BufferVector<std::pair<const char*, std::size_t>> keys;     //of the array found
+            BufferString path;                                          //the colon-joined keys
+            BufferVector<std::pair<const char*, const char*>> slices;
+        };
+
+        // The buffers that a parse needs, which a Parser keeps from one call
+        // to the next, so once they're large enough, it doesn't allocate.
+        struct ParserBuffers
+        {
+            explicit ParserBuffers(Allocator* allocator = nullptr)
+                : scratch(BufferAllocator<char>(allocator)),
+                path(BufferAllocator<char>(allocator)),
+                offsets(BufferAllocator<std::size_t>(allocator)),
+                index(allocator),
+                bulk(allocator)
+            {
+            }
+
+            ParserBuffers(const ParserBuffers&) = delete;
+
+            void operator=(const ParserBuffers&) = delete;
+
+            BufferString scratch;               //unescaped strings
+            BufferString path;                  //the colon-joined path
+            BufferVector<std::size_t> offsets;  //of each component of the path
+            StructuralIndex index;
+            BulkBuffers bulk;
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_BUFFERS_HPP
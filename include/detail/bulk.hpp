@@ -0,0 +1,258 @@
+/*
+[CyoJSON] detail/bulk.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_BULK_HPP
+#define __CYOJSON_DETAIL_BULK_HPP
+
+#include "filter.hpp"
+#include "structural.hpp"
+#include "workers.hpp"
+
+#ifndef CYOJSON_NO_THREADS
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // A large array within a document, divided into slices (each a run of
+        // its elements) that are parsed in parallel. The parser delivers the
+        // recorded events of each slice in turn when it reaches the array.
+        class BulkArray final : public ChunkWorkers
+        {
+        public:
+            BulkArray(const PathFilter& filter, PathTable* table, Parser::UTF8Mode utf8Mode, ParserBuffers& buffers)
+                : ChunkWorkers(true),
+                filter_(filter),
+                table_(table),
+                utf8Mode_(utf8Mode),
+                index_(buffers.index),
+                found_(buffers.bulk)
+            {
+            }
+
+            ~BulkArray()
+            {
+                Stop();
+            }
+
+            // Finds the largest array in the text, using the structural index
+            // (so commas within strings are ignored), and divides it at commas
+            // between its elements about c_chunkSize apart. Returns false if
+            // there's no array worth dividing. The index and what's found are
+            // kept in the parser's buffers, so the index can be reused.
+            bool Find(const char* json, std::size_t length)
+            {
+                if (length < 2 * c_chunkSize || length > UINT32_MAX)
+                    return false;
+
+                BuildStructuralIndex(json, length, GetScanFunctions(), index_);
+                indexed_ = true;
+                const std::uint32_t* const positions = index_.positions.data();
+
+                // Find the array, and the keys of its path (as the index of
+                // the opening quote of each)...
+                const std::uint32_t c_noKey = UINT32_MAX;
+                const std::uint32_t c_escapedKey = UINT32_MAX - 1;
+                BufferVector<BulkBuffers::Level>& levels = found_.levels;
+                levels.clear();
+                std::uint32_t key = c_noKey;
+                std::uint32_t open = 0, close = 0, span = 0;
+                for (std::uint32_t i = 0; i < (std::uint32_t)index_.count; ++i)
+                {
+                    switch (json[positions[i]])
+                    {
+                    case '{':
+                    case '[':
+                        levels.push_back(BulkBuffers::Level{ i, key });
+                        key = c_noKey;
+                        break;
+
+                    case '}':
+                    case ']':
+                    {
+                        if (levels.empty() || json[positions[levels.back().open]] != (json[positions[i]] == '}' ? '{' : '['))
+                            return false;
+                        const BulkBuffers::Level level = levels.back();
+                        if (json[positions[i]] == ']' && positions[i] - positions[level.open] > span)
+                        {
+                            BufferVector<std::uint32_t>& path = found_.keyIndexes;
+                            path.clear();
+                            for (const BulkBuffers::Level& parent : levels)
+                            {
+                                if (parent.key != c_noKey)
+                                    path.push_back(parent.key);
+                            }
+                            if (std::find(path.begin(), path.end(), c_escapedKey) == path.end())
+                            {
+                                open = level.open;
+                                close = i;
+                                span = positions[i] - positions[level.open];
+                                found_.arrayKeyIndexes.swap(path);
+                            }
+                        }
+                        levels.pop_back();
+                        key = c_noKey;
+                        break;
+                    }
+
+                    case ':':
+                        // A key with escapes has backslashes in the index
+                        // between its quotes...
+                        key = (i >= 2 && json[positions[i - 2]] == '\"' && json[positions[i - 1]] == '\"' ? i - 2 : c_escapedKey);
+                        break;
+
+                    default:
+                        key = c_noKey;
+                        break;
+                    }
+                }
+                if (span < 2 * c_chunkSize)
+                    return false;
+
+                found_.keys.clear();
+                found_.path.clear();
+                for (std::uint32_t quote : found_.arrayKeyIndexes)
+                {
+                    const char* str = json + positions[quote] + 1;
+                    std::size_t strLength = positions[quote + 1] - positions[quote] - 1;
+                    if (!found_.keys.empty())
+                        found_.path += ':';
+                    found_.keys.emplace_back(str, strLength);
+                    found_.path.append(str, strLength);
+                }
+                match_ = filter_.Match(found_.path.c_str(), found_.path.size());
+                if (match_ == PathMatch::Skip)
+                    return false;
+
+                // Divide it at the commas between its elements...
+                BufferVector<std::pair<const char*, const char*>>& slices = found_.slices;
+                slices.clear();
+                start_ = json + positions[open];
+                const char* begin = start_ + 1;
+                int depth = 0;
+                for (std::uint32_t i = open + 1; i < close; ++i)
+                {
+                    const char* next = json + positions[i];
+                    switch (*next)
+                    {
+                    case '{':
+                    case '[':
+                        ++depth;
+                        break;
+
+                    case '}':
+                    case ']':
+                        --depth;
+                        break;
+
+                    case ',':
+                        if (depth == 0 && (std::size_t)(next - begin) >= c_chunkSize)
+                        {
+                            slices.emplace_back(begin, next);
+                            begin = next + 1;
+                        }
+                        break;
+                    }
+                }
+                slices.emplace_back(begin, json + positions[close]);
+                return true;
+            }
+
+            // Whether Find() built the index (even if it then returned false),
+            // so the StructuralIndex engine needn't build it again.
+            bool IsIndexed() const { return indexed_; }
+
+            // The '[' of the array.
+            const char* getStart() const { return start_; }
+
+            const BufferString& getPath() const { return found_.path; }
+            PathMatch getMatch() const { return match_; }
+
+            // Delivers the events of a parsed slice, as though they were
+            // parsed by the parser using events (at the path of the array).
+            // Returns false if the handler asked to stop, with stoppedAt set
+            // to that event's position (relative to the start of the slice).
+            template <typename Handler>
+            bool Replay(Chunk& slice, Events<Handler>& events, bool usesPaths, const EventRecorder::Position*& stoppedAt)
+            {
+                NoRecords records;
+                std::size_t index = 0;
+                if (slice.recorder.Replay(events, records, table_, usesPaths, &index))
+                    return true;
+                stoppedAt = &slice.recorder.getPosition(index);
+                return false;
+            }
+
+        protected:
+            bool Claim(Chunk& chunk) override
+            {
+                if (nextSlice_ == found_.slices.size())
+                    return false;
+                chunk.begin = found_.slices[nextSlice_].first;
+                chunk.end = found_.slices[nextSlice_].second;
+                ++nextSlice_;
+                return true;
+            }
+
+            void ParseChunk(Chunk& chunk) override; //see parser.hpp
+
+        private:
+            struct NoRecords
+            {
+                void RecordStart(std::size_t) { }
+                void RecordEnd(std::size_t) { }
+                void RecordError(std::size_t, int, int) { }
+            };
+
+            const PathFilter& filter_;
+            PathTable* const table_;
+            const Parser::UTF8Mode utf8Mode_;
+            StructuralIndex& index_;
+            BulkBuffers& found_;
+            bool indexed_ = false;
+            const char* start_ = nullptr;
+            PathMatch match_ = PathMatch::Skip;
+            std::size_t nextSlice_ = 0;
+        };
+    }
+}
+
+#endif //CYOJSON_NO_THREADS
+
+#endif //__CYOJSON_DETAIL_BULK_HPP
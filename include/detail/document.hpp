@@ -0,0 +1,406 @@
+/*
+[CyoJSON] detail/document.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_DOCUMENT_HPP
+#define __CYOJSON_DETAIL_DOCUMENT_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Each entry of the tape is a tag (the top byte) and a payload:
+        //   '{' '[' - the index after the matching end entry (bits 0-31), and
+        //             the number of members/elements (bits 32-55, saturating)
+        //   '}' ']' - the index of the matching start entry
+        //   '"'     - the offset of the string in the string buffer, where it
+        //             follows its length (4 bytes) and is null-terminated
+        //   'l' 'u' 'd' - an int64, uint64 or double, in the following entry
+        //   't' 'f' 'n' - no payload
+        // Each member of an object is a '"' entry for the key, then the value.
+        namespace tape
+        {
+            const std::uint64_t c_countOne = (std::uint64_t)1 << 32;
+            const std::uint64_t c_countMask = (((std::uint64_t)1 << 24) - 1) << 32;
+
+            inline std::uint64_t Entry(char tag, std::uint64_t payload)
+            {
+                return (((std::uint64_t)(unsigned char)tag << 56) | payload);
+            }
+
+            inline char Tag(std::uint64_t entry)
+            {
+                return (char)(entry >> 56);
+            }
+
+            inline std::uint32_t Index(std::uint64_t entry)
+            {
+                return (std::uint32_t)entry;
+            }
+
+            inline std::size_t Count(std::uint64_t entry)
+            {
+                return (std::size_t)((entry & c_countMask) >> 32);
+            }
+
+            inline std::uint64_t Payload(std::uint64_t entry)
+            {
+                return (entry & (((std::uint64_t)1 << 56) - 1));
+            }
+        }
+
+        // The handler that builds a Document.
+        class DocumentBuilder
+        {
+        public:
+            static const bool c_usesPaths = false;
+
+            explicit DocumentBuilder(Document& document)
+                : tape_(document.tape_),
+                strings_(document.strings_),
+                stack_(document.stack_)
+            {
+            }
+
+            DocumentBuilder(const DocumentBuilder&) = delete;
+
+            void operator=(const DocumentBuilder&) = delete;
+
+            // More than 2^32 entries can't be indexed.
+            bool IsOverflow() const { return overflow_; }
+
+            void ObjectStart(const char*) { Start('{'); }
+            void ObjectEnd(const char*) { End('}'); }
+            void ArrayStart(const char*) { Start('['); }
+            void ArrayEnd(const char*) { End(']'); }
+
+            void Key(const char*, const char* key, std::size_t length)
+            {
+                AddString(key, length);
+            }
+
+            void String(const char*, const char* value, std::size_t length)
+            {
+                Count();
+                AddString(value, length);
+            }
+
+            void Int64(const char*, std::int64_t value, const char*, std::size_t)
+            {
+                Count();
+                tape_.push_back(tape::Entry('l', 0));
+                tape_.push_back((std::uint64_t)value);
+            }
+
+            void UInt64(const char*, std::uint64_t value, const char*, std::size_t)
+            {
+                Count();
+                tape_.push_back(tape::Entry('u', 0));
+                tape_.push_back(value);
+            }
+
+            void Double(const char*, double value, const char*, std::size_t)
+            {
+                Count();
+                std::uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                tape_.push_back(tape::Entry('d', 0));
+                tape_.push_back(bits);
+            }
+
+            void Bool(const char*, bool value)
+            {
+                Count();
+                tape_.push_back(tape::Entry((value ? 't' : 'f'), 0));
+            }
+
+            void Null(const char*)
+            {
+                Count();
+                tape_.push_back(tape::Entry('n', 0));
+            }
+
+        private:
+            std::vector<std::uint64_t>& tape_;
+            std::vector<char>& strings_;
+            std::vector<std::uint32_t>& stack_;
+            bool overflow_ = false;
+
+            // Counts a value in the enclosing object or array.
+            void Count()
+            {
+                if (stack_.empty())
+                    return;
+                std::uint64_t& start = tape_[stack_.back()];
+                if ((start & tape::c_countMask) != tape::c_countMask)
+                    start += tape::c_countOne;
+            }
+
+            void Start(char tag)
+            {
+                Count();
+                stack_.push_back((std::uint32_t)tape_.size());
+                tape_.push_back(tape::Entry(tag, 0));
+            }
+
+            void End(char tag)
+            {
+                std::uint32_t start = stack_.back();
+                stack_.pop_back();
+                std::size_t next = tape_.size() + 1;
+                if (next > UINT32_MAX)
+                    overflow_ = true;
+                tape_[start] |= (std::uint32_t)next;
+                tape_.push_back(tape::Entry(tag, start));
+            }
+
+            void AddString(const char* str, std::size_t length)
+            {
+                if (length > UINT32_MAX)
+                {
+                    overflow_ = true;
+                    length = 0;
+                }
+                std::size_t offset = strings_.size();
+                strings_.resize(offset + sizeof(std::uint32_t) + length + 1);
+                std::uint32_t length32 = (std::uint32_t)length;
+                std::memcpy(&strings_[offset], &length32, sizeof(length32));
+                std::memcpy(&strings_[offset + sizeof(length32)], str, length);
+                strings_[offset + sizeof(length32) + length] = '\0';
+                tape_.push_back(tape::Entry('\"', offset));
+            }
+        };
+    }
+
+    inline Document::Type Document::Element::getType() const
+    {
+        assert(IsValid());
+        switch (detail::tape::Tag(document_->getEntry(index_)))
+        {
+        case '{': return Type::Object;
+        case '[': return Type::Array;
+        case '\"': return Type::String;
+        case 'l': return Type::Int64;
+        case 'u': return Type::UInt64;
+        case 'd': return Type::Double;
+        case 'n': return Type::Null;
+        default: return Type::Bool;
+        }
+    }
+
+    inline std::size_t Document::Element::getSize() const
+    {
+        assert(getType() == Type::Object || getType() == Type::Array);
+        std::uint64_t entry = document_->getEntry(index_);
+        if ((entry & detail::tape::c_countMask) != detail::tape::c_countMask)
+            return detail::tape::Count(entry);
+
+        std::size_t size = 0;
+        for (Element element = getFirst(); element.IsValid(); element = element.getNext())
+            ++size;
+        return size;
+    }
+
+    inline Document::Element Document::Element::getFirst() const
+    {
+        assert(getType() == Type::Object || getType() == Type::Array);
+        return At(index_ + 1, (getType() == Type::Object));
+    }
+
+    inline Document::Element Document::Element::getNext() const
+    {
+        assert(IsValid());
+        std::uint64_t entry = document_->getEntry(index_);
+        switch (detail::tape::Tag(entry))
+        {
+        case '{':
+        case '[':
+            return At(detail::tape::Index(entry), member_);
+        case 'l':
+        case 'u':
+        case 'd':
+            return At(index_ + 2, member_);
+        default:
+            return At(index_ + 1, member_);
+        }
+    }
+
+    // The element at the given index or, for a member of an object, the value
+    // following the key at the index; invalid at the end of the object/array.
+    inline Document::Element Document::Element::At(std::uint32_t index, bool member) const
+    {
+        char tag = detail::tape::Tag(document_->getEntry(index));
+        if (tag == '}' || tag == ']')
+            return Element();
+        return Element(document_, (member ? index + 1 : index), member);
+    }
+
+    inline Document::Element Document::Element::Find(const char* key) const
+    {
+        return Find(key, std::strlen(key));
+    }
+
+    inline Document::Element Document::Element::Find(const char* key, std::size_t length) const
+    {
+        assert(getType() == Type::Object);
+        for (Element member = getFirst(); member.IsValid(); member = member.getNext())
+        {
+            if (member.getKeyLength() == length && std::memcmp(member.getKey(), key, length) == 0)
+                return member;
+        }
+        return Element();
+    }
+
+    inline const char* Document::Element::getKey() const
+    {
+        assert(member_);
+        return document_->getStringAt(document_->getEntry(index_ - 1));
+    }
+
+    inline std::size_t Document::Element::getKeyLength() const
+    {
+        assert(member_);
+        return document_->getStringLengthAt(document_->getEntry(index_ - 1));
+    }
+
+    inline const char* Document::Element::getString() const
+    {
+        assert(getType() == Type::String);
+        return document_->getStringAt(document_->getEntry(index_));
+    }
+
+    inline std::size_t Document::Element::getStringLength() const
+    {
+        assert(getType() == Type::String);
+        return document_->getStringLengthAt(document_->getEntry(index_));
+    }
+
+    inline std::int64_t Document::Element::getInt64() const
+    {
+        assert(getType() == Type::Int64);
+        return (std::int64_t)document_->getEntry(index_ + 1);
+    }
+
+    inline std::uint64_t Document::Element::getUInt64() const
+    {
+        assert(getType() == Type::UInt64);
+        return document_->getEntry(index_ + 1);
+    }
+
+    inline double Document::Element::getDouble() const
+    {
+        std::uint64_t bits = document_->getEntry(index_ + 1);
+        switch (getType())
+        {
+        case Type::Int64:
+            return (double)(std::int64_t)bits;
+        case Type::UInt64:
+            return (double)bits;
+        default:
+            assert(getType() == Type::Double);
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+
+    inline bool Document::Element::getBool() const
+    {
+        assert(getType() == Type::Bool);
+        return (detail::tape::Tag(document_->getEntry(index_)) == 't');
+    }
+
+    inline bool Document::Parse(const char* json)
+    {
+        return ParseWith(json, nullptr);
+    }
+
+    inline bool Document::Parse(const char* json, std::size_t length)
+    {
+        return ParseWith(json, json + length);
+    }
+
+    inline bool Document::ParseWith(const char* json, const char* end)
+    {
+        Clear();
+
+        detail::DocumentBuilder builder(*this);
+        parser_.setEngine(engine_);
+        bool success = (end ? parser_.Parse(json, (std::size_t)(end - json), builder) : parser_.Parse(json, builder));
+        success = (success && !builder.IsOverflow());
+        line_ = parser_.getLine();
+        column_ = parser_.getColumn();
+
+        if (!success)
+            Clear();
+        return success;
+    }
+
+    inline Document::Element Document::getRoot() const
+    {
+        return (tape_.empty() ? Element() : Element(this, 0, false));
+    }
+
+    inline void Document::Clear()
+    {
+        tape_.clear();
+        strings_.clear();
+        stack_.clear();
+    }
+
+    inline void Document::ReleaseBuffers()
+    {
+        std::vector<std::uint64_t>().swap(tape_);
+        std::vector<char>().swap(strings_);
+        std::vector<std::uint32_t>().swap(stack_);
+        parser_.ReleaseBuffers();
+    }
+
+    inline const char* Document::getStringAt(std::uint64_t entry) const
+    {
+        return &strings_[(std::size_t)detail::tape::Payload(entry) + sizeof(std::uint32_t)];
+    }
+
+    inline std::size_t Document::getStringLengthAt(std::uint64_t entry) const
+    {
+        std::uint32_t length;
+        std::memcpy(&length, &strings_[(std::size_t)detail::tape::Payload(entry)], sizeof(length));
+        return length;
+    }
+}
+
+#endif //__CYOJSON_DETAIL_DOCUMENT_HPP
@@ -0,0 +1,212 @@
+/*
+[CyoJSON] detail/events.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_EVENTS_HPP
+#define __CYOJSON_DETAIL_EVENTS_HPP
+
+#include "number.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Detects whether a handler defines each event...
+
+#define CYOJSON_HANDLER_TRAIT(Trait, Call) \
+        template <typename Handler, typename = void> \
+        struct Trait : std::false_type { }; \
+        template <typename Handler> \
+        struct Trait<Handler, decltype(std::declval<Handler&>().Call, void())> : std::true_type { };
+
+        CYOJSON_HANDLER_TRAIT(HasObjectStart, ObjectStart((const char*)nullptr))
+        CYOJSON_HANDLER_TRAIT(HasObjectEnd, ObjectEnd((const char*)nullptr))
+        CYOJSON_HANDLER_TRAIT(HasArrayStart, ArrayStart((const char*)nullptr))
+        CYOJSON_HANDLER_TRAIT(HasArrayEnd, ArrayEnd((const char*)nullptr))
+        CYOJSON_HANDLER_TRAIT(HasValue, Value((const char*)nullptr, (const char*)nullptr))
+        CYOJSON_HANDLER_TRAIT(HasString, String((const char*)nullptr, (const char*)nullptr, std::size_t()))
+        CYOJSON_HANDLER_TRAIT(HasNumber, Number((const char*)nullptr, (const char*)nullptr, std::size_t()))
+        CYOJSON_HANDLER_TRAIT(HasKey, Key((const char*)nullptr, (const char*)nullptr, std::size_t()))
+        CYOJSON_HANDLER_TRAIT(HasInt64, Int64((const char*)nullptr, std::int64_t(), (const char*)nullptr, std::size_t()))
+        CYOJSON_HANDLER_TRAIT(HasUInt64, UInt64((const char*)nullptr, std::uint64_t(), (const char*)nullptr, std::size_t()))
+        CYOJSON_HANDLER_TRAIT(HasDouble, Double((const char*)nullptr, double(), (const char*)nullptr, std::size_t()))
+        CYOJSON_HANDLER_TRAIT(HasBool, Bool((const char*)nullptr, bool()))
+        CYOJSON_HANDLER_TRAIT(HasNull, Null((const char*)nullptr))
+        CYOJSON_HANDLER_TRAIT(HasSetPathId, setPathId(PathTable::Id()))
+
+#undef CYOJSON_HANDLER_TRAIT
+
+        // A handler that ignores the path can declare (as a static member)
+        // c_usesPaths = false, so that paths needn't be built.
+        template <typename Handler, typename = void>
+        struct UsesPaths : std::true_type { };
+        template <typename Handler>
+        struct UsesPaths<Handler, typename std::enable_if<!Handler::c_usesPaths>::type> : std::false_type { };
+
+        // Invokes the events on a handler, resolved at compile time. An event
+        // the handler doesn't define falls back as for Parser::Callbacks (e.g.
+        // Int64 to Number, then to Value) and otherwise compiles to nothing,
+        // as do numeric conversions if the handler has no typed callbacks.
+        template <typename Handler>
+        class Events
+        {
+        public:
+            static const bool c_convertsNumbers = (HasInt64<Handler>::value || HasUInt64<Handler>::value || HasDouble<Handler>::value);
+            static const bool c_usesPaths = UsesPaths<Handler>::value;
+
+            explicit Events(Handler& handler)
+                : handler_(handler)
+            {
+            }
+
+            Events(const Events&) = delete;
+
+            void operator=(const Events&) = delete;
+
+            // Each event returns the action that the handler asks for, which
+            // is always Continue unless it's derived from Parser::Callbacks
+            // (and calls setAction) or its callback returns a Parser::Action.
+
+            Parser::Action ObjectStart(const char* path) { return ObjectStart(path, HasObjectStart<Handler>()); }
+            Parser::Action ObjectEnd(const char* path) { return ObjectEnd(path, HasObjectEnd<Handler>()); }
+            Parser::Action ArrayStart(const char* path) { return ArrayStart(path, HasArrayStart<Handler>()); }
+            Parser::Action ArrayEnd(const char* path) { return ArrayEnd(path, HasArrayEnd<Handler>()); }
+            Parser::Action Key(const char* path, const char* key, std::size_t length) { return Key(path, key, length, HasKey<Handler>()); }
+            Parser::Action String(const char* path, const char* value, std::size_t length) { return String(path, value, length, HasString<Handler>()); }
+            Parser::Action Number(const char* path, const char* text, std::size_t length) { return Number(path, text, length, HasNumber<Handler>()); }
+
+            Parser::Action Number(const char* path, const NumberValue& value, const char* text, std::size_t length)
+            {
+                switch (value.type)
+                {
+                case NumberValue::Type::Int64:
+                    return Int64(path, value.int64, text, length, HasInt64<Handler>());
+                case NumberValue::Type::UInt64:
+                    return UInt64(path, value.uint64, text, length, HasUInt64<Handler>());
+                default:
+                    return Double(path, value.dbl, text, length, HasDouble<Handler>());
+                }
+            }
+
+            // The literal is "true", "false" or "null".
+            Parser::Action Literal(const char* path, const char* literal)
+            {
+                if (*literal == 'n')
+                    return Null(path, literal, HasNull<Handler>());
+                else
+                    return Bool(path, literal, HasBool<Handler>());
+            }
+
+            void SetPathId(PathTable::Id id) { SetPathId(id, std::is_base_of<Parser::Callbacks, Handler>()); }
+
+            // The action that the handler asked for during a call that was
+            // made directly, rather than by these events.
+            Parser::Action TakeAction() { return TakeAction(std::is_base_of<Parser::Callbacks, Handler>()); }
+
+        private:
+            Handler& handler_;
+            std::string text_;
+
+            typedef Parser::Action Action;
+
+            // Invokes an event, returning the action that it asks for...
+
+            template <typename Call>
+            Action Invoke(Call call) { return Invoke(call, std::is_same<decltype(call()), Action>()); }
+            template <typename Call>
+            Action Invoke(Call call, std::true_type) { return call(); }
+            template <typename Call>
+            Action Invoke(Call call, std::false_type) { call(); return TakeAction(std::is_base_of<Parser::Callbacks, Handler>()); }
+
+            Action TakeAction(std::true_type)
+            {
+                Parser::Callbacks& callbacks = handler_;
+                const Action action = callbacks.action_;
+                callbacks.action_ = Action::Continue;
+                return action;
+            }
+
+            Action TakeAction(std::false_type) { return Action::Continue; }
+
+            Action ObjectStart(const char* path, std::true_type) { return Invoke([&] { return handler_.ObjectStart(path); }); }
+            Action ObjectStart(const char*, std::false_type) { return Action::Continue; }
+            Action ObjectEnd(const char* path, std::true_type) { return Invoke([&] { return handler_.ObjectEnd(path); }); }
+            Action ObjectEnd(const char*, std::false_type) { return Action::Continue; }
+            Action ArrayStart(const char* path, std::true_type) { return Invoke([&] { return handler_.ArrayStart(path); }); }
+            Action ArrayStart(const char*, std::false_type) { return Action::Continue; }
+            Action ArrayEnd(const char* path, std::true_type) { return Invoke([&] { return handler_.ArrayEnd(path); }); }
+            Action ArrayEnd(const char*, std::false_type) { return Action::Continue; }
+            Action Key(const char* path, const char* key, std::size_t length, std::true_type) { return Invoke([&] { return handler_.Key(path, key, length); }); }
+            Action Key(const char*, const char*, std::size_t, std::false_type) { return Action::Continue; }
+
+            Action String(const char* path, const char* value, std::size_t length, std::true_type) { return Invoke([&] { return handler_.String(path, value, length); }); }
+            Action String(const char* path, const char* value, std::size_t length, std::false_type) { return Value(path, value, length, HasValue<Handler>()); }
+            Action Number(const char* path, const char* text, std::size_t length, std::true_type) { return Invoke([&] { return handler_.Number(path, text, length); }); }
+            Action Number(const char* path, const char* text, std::size_t length, std::false_type) { return Value(path, text, length, HasValue<Handler>()); }
+
+            Action Int64(const char* path, std::int64_t value, const char* text, std::size_t length, std::true_type) { return Invoke([&] { return handler_.Int64(path, value, text, length); }); }
+            Action Int64(const char* path, std::int64_t, const char* text, std::size_t length, std::false_type) { return Number(path, text, length); }
+            Action UInt64(const char* path, std::uint64_t value, const char* text, std::size_t length, std::true_type) { return Invoke([&] { return handler_.UInt64(path, value, text, length); }); }
+            Action UInt64(const char* path, std::uint64_t, const char* text, std::size_t length, std::false_type) { return Number(path, text, length); }
+            Action Double(const char* path, double value, const char* text, std::size_t length, std::true_type) { return Invoke([&] { return handler_.Double(path, value, text, length); }); }
+            Action Double(const char* path, double, const char* text, std::size_t length, std::false_type) { return Number(path, text, length); }
+
+            Action Bool(const char* path, const char* literal, std::true_type) { return Invoke([&] { return handler_.Bool(path, (*literal == 't')); }); }
+            Action Bool(const char* path, const char* literal, std::false_type) { return Value(path, literal, HasValue<Handler>()); }
+            Action Null(const char* path, const char*, std::true_type) { return Invoke([&] { return handler_.Null(path); }); }
+            Action Null(const char* path, const char* literal, std::false_type) { return Value(path, literal, HasValue<Handler>()); }
+
+            // Value needs a null-terminated copy...
+            Action Value(const char* path, const char* value, std::size_t length, std::true_type)
+            {
+                text_.assign(value, length);
+                return Invoke([&] { return handler_.Value(path, text_.c_str()); });
+            }
+
+            Action Value(const char*, const char*, std::size_t, std::false_type) { return Action::Continue; }
+            Action Value(const char* path, const char* literal, std::true_type) { return Invoke([&] { return handler_.Value(path, literal); }); }
+            Action Value(const char*, const char*, std::false_type) { return Action::Continue; }
+
+            void SetPathId(PathTable::Id id, std::true_type) { static_cast<Parser::Callbacks&>(handler_).pathId_ = id; }
+            void SetPathId(PathTable::Id id, std::false_type) { SetHandlerPathId(id, HasSetPathId<Handler>()); }
+            void SetHandlerPathId(PathTable::Id id, std::true_type) { handler_.setPathId(id); }
+            void SetHandlerPathId(PathTable::Id, std::false_type) { }
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_EVENTS_HPP
@@ -0,0 +1,222 @@
+/*
+[CyoJSON] detail/file.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_FILE_HPP
+#define __CYOJSON_DETAIL_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(CYOJSON_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#   define CYOJSON_MMAP
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // A read-only, null-terminated view of a whole file. All but the last
+        // partial page are mapped from the file; that is read into a page of
+        // zeroes mapped after them, so the terminator is always there (even if
+        // the file grows meanwhile) and the vectorised scans can read up to
+        // the end of its page.
+        class MappedFile final
+        {
+        public:
+            MappedFile() = default;
+            MappedFile(const MappedFile&) = delete;
+            void operator=(const MappedFile&) = delete;
+
+            ~MappedFile()
+            {
+#ifdef CYOJSON_MMAP
+                if (base_)
+                    munmap(base_, length_);
+#endif
+            }
+
+            // Returns false if the file can't be mapped, e.g. if it isn't a
+            // regular file or is too large for the address space. The file is
+            // already open (and its position doesn't matter), so it can then
+            // be read instead, rather than opened again, which would lose what
+            // a pipe had written.
+            bool Map(std::FILE* file)
+            {
+#ifdef CYOJSON_MMAP
+                return Map(fileno(file));
+#else
+                (void)file;
+                return false;
+#endif
+            }
+
+            const char* getData() const { return (const char*)base_; }
+            std::size_t getSize() const { return size_; }
+
+        private:
+            void* base_ = nullptr;
+            std::size_t length_ = 0; //of the mapping
+            std::size_t size_ = 0;   //of the file
+
+#ifdef CYOJSON_MMAP
+            bool Map(int fd)
+            {
+                struct stat status;
+                if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+                    return false;
+
+                const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+                if ((std::uint64_t)status.st_size > (std::uint64_t)(SIZE_MAX - page))
+                    return false;
+                const std::size_t size = (std::size_t)status.st_size;
+                const std::size_t whole = size - size % page; //the whole pages
+
+                void* base = mmap(nullptr, whole + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (base == MAP_FAILED)
+                    return false;
+                base_ = base;
+                length_ = whole + page;
+
+                if (whole != 0)
+                {
+                    if (mmap(base, whole, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+                        return false;
+                    madvise(base, whole, MADV_SEQUENTIAL);
+                    madvise(base, whole, MADV_WILLNEED);
+                }
+
+                char* tail = (char*)base + whole;
+                std::size_t remaining = size - whole;
+                off_t offset = (off_t)whole;
+                while (remaining != 0)
+                {
+                    ssize_t count = pread(fd, tail, remaining, offset);
+                    if (count == -1 && errno == EINTR)
+                        continue;
+                    if (count <= 0)
+                        return false; //the file has shrunk
+                    tail += count;
+                    remaining -= (std::size_t)count;
+                    offset += count;
+                }
+                size_ = size;
+                return true;
+            }
+#endif
+        };
+
+        // Passes on only the events at or beneath the subscribed paths, for
+        // parsing a file that can't be mapped with the StreamParser (which
+        // doesn't skip anything itself).
+        class FilteredCallbacks final : public Parser::Callbacks
+        {
+        public:
+            FilteredCallbacks(Parser::Callbacks& callbacks, const PathFilter& filter)
+                : events_(callbacks),
+                callbacks_(callbacks),
+                filter_(filter)
+            {
+            }
+
+            FilteredCallbacks(const FilteredCallbacks&) = delete;
+
+            void operator=(const FilteredCallbacks&) = delete;
+
+            void ObjectStart(const char* path) override { if (Match(path)) { callbacks_.ObjectStart(path); PassAction(); } }
+            void ObjectEnd(const char* path) override { if (Match(path)) { callbacks_.ObjectEnd(path); PassAction(); } }
+            void ArrayStart(const char* path) override { if (Match(path)) { callbacks_.ArrayStart(path); PassAction(); } }
+            void ArrayEnd(const char* path) override { if (Match(path)) { callbacks_.ArrayEnd(path); PassAction(); } }
+            void Value(const char* path, const char* value) override { if (Match(path)) { callbacks_.Value(path, value); PassAction(); } }
+            void String(const char* path, const char* value, std::size_t length) override { if (Match(path)) { callbacks_.String(path, value, length); PassAction(); } }
+            void Number(const char* path, const char* value, std::size_t length) override { if (Match(path)) { callbacks_.Number(path, value, length); PassAction(); } }
+            void Key(const char* path, const char* key, std::size_t length) override { if (Match(path)) { callbacks_.Key(path, key, length); PassAction(); } }
+            void Int64(const char* path, std::int64_t value, const char* text, std::size_t length) override { if (Match(path)) { callbacks_.Int64(path, value, text, length); PassAction(); } }
+            void UInt64(const char* path, std::uint64_t value, const char* text, std::size_t length) override { if (Match(path)) { callbacks_.UInt64(path, value, text, length); PassAction(); } }
+            void Double(const char* path, double value, const char* text, std::size_t length) override { if (Match(path)) { callbacks_.Double(path, value, text, length); PassAction(); } }
+            void Bool(const char* path, bool value) override { if (Match(path)) { callbacks_.Bool(path, value); PassAction(); } }
+            void Null(const char* path) override { if (Match(path)) { callbacks_.Null(path); PassAction(); } }
+
+        private:
+            Events<Parser::Callbacks> events_; //to pass on the path id
+            Parser::Callbacks& callbacks_;
+            const PathFilter& filter_;
+
+            bool Match(const char* path)
+            {
+                if (filter_.Match(path, std::strlen(path)) != PathMatch::Deliver)
+                    return false;
+                events_.SetPathId(getPathId());
+                return true;
+            }
+
+            // Passes on the action that the callbacks asked for, if any.
+            void PassAction() { setAction(events_.TakeAction()); }
+        };
+    }
+
+    inline bool Parser::ParseFile(const char* filename, Callbacks& callbacks)
+    {
+        line_ = 0;
+        column_ = 0;
+        statistics_ = Statistics();
+        stopped_ = false;
+        if (!filename)
+            return false;
+
+        std::FILE* file = std::fopen(filename, "rb");
+        if (!file)
+            return false;
+
+        bool result;
+        detail::MappedFile mapped;
+        if (mapped.Map(file))
+        {
+            result = ParseWith(mapped.getData(), mapped.getData() + mapped.getSize(), callbacks);
+        }
+        else
+        {
+            FileSource source(file);
+            result = ParseBlocks(source, callbacks);
+        }
+        std::fclose(file);
+        return result;
+    }
+}
+
+#endif //__CYOJSON_DETAIL_FILE_HPP
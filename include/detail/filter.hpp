@@ -0,0 +1,135 @@
+/*
+[CyoJSON] detail/filter.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_FILTER_HPP
+#define __CYOJSON_DETAIL_FILTER_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        enum class PathMatch
+        {
+            Skip,    //can't match, so skip the value
+            Descend, //a subscription is beneath this path
+            Deliver  //at or beneath a subscription, so invoke the callbacks
+        };
+
+        // Matches paths against the subscriptions of a Parser.
+        class PathFilter
+        {
+        public:
+            PathFilter(const std::vector<std::string>& patterns, Parser::SkipMode skipMode)
+                : patterns_(patterns),
+                unchecked_(skipMode == Parser::SkipMode::Unchecked)
+            {
+            }
+
+            PathFilter(const PathFilter&) = delete;
+
+            void operator=(const PathFilter&) = delete;
+
+            bool IsEmpty() const { return patterns_.empty(); }
+            bool IsUnchecked() const { return unchecked_; }
+
+            PathMatch Match(const char* path, std::size_t length) const
+            {
+                if (patterns_.empty())
+                    return PathMatch::Deliver;
+
+                PathMatch match = PathMatch::Skip;
+                for (const auto& pattern : patterns_)
+                {
+                    switch (MatchPattern(pattern, path, length))
+                    {
+                    case PathMatch::Deliver:
+                        return PathMatch::Deliver;
+                    case PathMatch::Descend:
+                        match = PathMatch::Descend;
+                        break;
+                    case PathMatch::Skip:
+                        break;
+                    }
+                }
+                return match;
+            }
+
+        private:
+            const std::vector<std::string>& patterns_;
+            const bool unchecked_;
+
+            // Compares the path with the pattern component by component, where
+            // a "*" component matches any one component.
+            static PathMatch MatchPattern(const std::string& pattern, const char* path, std::size_t length)
+            {
+                if (pattern.empty())
+                    return PathMatch::Deliver;
+                if (length == 0)
+                    return PathMatch::Descend;
+
+                const char* nextPattern = pattern.c_str();
+                const char* const endPattern = nextPattern + pattern.size();
+                const char* nextPath = path;
+                const char* const endPath = path + length;
+                for (;;)
+                {
+                    const char* endComponent = EndOfComponent(nextPattern, endPattern);
+                    const char* endPathComponent = EndOfComponent(nextPath, endPath);
+                    std::size_t size = (std::size_t)(endComponent - nextPattern);
+                    bool wildcard = (size == 1 && *nextPattern == '*');
+                    if (!wildcard && (size != (std::size_t)(endPathComponent - nextPath) || std::memcmp(nextPattern, nextPath, size) != 0))
+                        return PathMatch::Skip;
+
+                    if (endComponent == endPattern)
+                        return PathMatch::Deliver;
+                    if (endPathComponent == endPath)
+                        return PathMatch::Descend;
+                    nextPattern = endComponent + 1;
+                    nextPath = endPathComponent + 1;
+                }
+            }
+
+            static const char* EndOfComponent(const char* next, const char* end)
+            {
+                const char* colon = (const char*)std::memchr(next, ':', (std::size_t)(end - next));
+                return (colon ? colon : end);
+            }
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_FILTER_HPP
@@ -0,0 +1,403 @@
+/*
+[CyoJSON] detail/format.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_FORMAT_HPP
+#define __CYOJSON_DETAIL_FORMAT_HPP
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // The longest text that FormatInt64, FormatUInt64 or FormatDouble can
+        // write (e.g. "-0.0000012345678901234567").
+        const std::size_t c_maxNumberLength = 32;
+
+        // Writes two digits at a time, from "00" to "99".
+        inline const char* GetDigitPair(unsigned value)
+        {
+            assert(value < 100);
+
+            static const char c_pairs[201] =
+                "00010203040506070809"
+                "10111213141516171819"
+                "20212223242526272829"
+                "30313233343536373839"
+                "40414243444546474849"
+                "50515253545556575859"
+                "60616263646566676869"
+                "70717273747576777879"
+                "80818283848586878889"
+                "90919293949596979899";
+            return c_pairs + value * 2;
+        }
+
+        // Writes an integer, returning the char after it.
+        inline char* FormatUInt64(std::uint64_t value, char* out)
+        {
+            // Fill a buffer from the end, then copy it...
+            char digits[20];
+            char* first = digits + sizeof(digits);
+            while (value >= 100)
+            {
+                first -= 2;
+                std::memcpy(first, GetDigitPair((unsigned)(value % 100)), 2);
+                value /= 100;
+            }
+            if (value >= 10)
+            {
+                first -= 2;
+                std::memcpy(first, GetDigitPair((unsigned)value), 2);
+            }
+            else
+            {
+                *--first = (char)('0' + value);
+            }
+
+            const std::size_t length = (std::size_t)(digits + sizeof(digits) - first);
+            std::memcpy(out, first, length);
+            return out + length;
+        }
+
+        inline char* FormatInt64(std::int64_t value, char* out)
+        {
+            std::uint64_t magnitude = (std::uint64_t)value;
+            if (value < 0)
+            {
+                *out++ = '-';
+                magnitude = 0 - magnitude; //no overflow for the minimum
+            }
+            return FormatUInt64(magnitude, out);
+        }
+
+        // Doubles are formatted by Grisu2 (Florian Loitsch, "Printing
+        // Floating-Point Numbers Quickly and Accurately with Integers", 2010),
+        // using only 64-bit integer arithmetic. Its digits always read back as
+        // the same double, and in all but a tiny fraction of cases (about
+        // 0.1%), they're also the shortest that do; otherwise there's one
+        // more digit than needed.
+
+        // A "do-it-yourself floating point" number: f * 2^e.
+        struct DiyFp
+        {
+            std::uint64_t f;
+            int e;
+        };
+
+        // The upper 64 bits of the product (rounded), so only approximate.
+        inline DiyFp Multiply(const DiyFp& lhs, const DiyFp& rhs)
+        {
+            const std::uint64_t c_low = 0xFFFFFFFFu;
+            const std::uint64_t a = lhs.f >> 32;
+            const std::uint64_t b = lhs.f & c_low;
+            const std::uint64_t c = rhs.f >> 32;
+            const std::uint64_t d = rhs.f & c_low;
+            const std::uint64_t ac = a * c;
+            const std::uint64_t bc = b * c;
+            const std::uint64_t ad = a * d;
+            const std::uint64_t bd = b * d;
+            const std::uint64_t middle = (bd >> 32) + (ad & c_low) + (bc & c_low) + (1ull << 31);
+            return DiyFp{ ac + (ad >> 32) + (bc >> 32) + (middle >> 32), lhs.e + rhs.e + 64 };
+        }
+
+        // A power of ten, 10^k, whose binary exponent puts the product with a
+        // normalised number whose exponent is e into the range -60 to -32.
+        inline DiyFp GetCachedPower(int e, int& k)
+        {
+            // Normalised and rounded: 10^-348, 10^-340, ... 10^340.
+            static const DiyFp c_powers[87] =
+            {
+                { 0xFA8FD5A0081C0288ull, -1220 }, { 0xBAAEE17FA23EBF76ull, -1193 },
+                { 0x8B16FB203055AC76ull, -1166 }, { 0xCF42894A5DCE35EAull, -1140 },
+                { 0x9A6BB0AA55653B2Dull, -1113 }, { 0xE61ACF033D1A45DFull, -1087 },
+                { 0xAB70FE17C79AC6CAull, -1060 }, { 0xFF77B1FCBEBCDC4Full, -1034 },
+                { 0xBE5691EF416BD60Cull, -1007 }, { 0x8DD01FAD907FFC3Cull, -980 },
+                { 0xD3515C2831559A83ull, -954 }, { 0x9D71AC8FADA6C9B5ull, -927 },
+                { 0xEA9C227723EE8BCBull, -901 }, { 0xAECC49914078536Dull, -874 },
+                { 0x823C12795DB6CE57ull, -847 }, { 0xC21094364DFB5637ull, -821 },
+                { 0x9096EA6F3848984Full, -794 }, { 0xD77485CB25823AC7ull, -768 },
+                { 0xA086CFCD97BF97F4ull, -741 }, { 0xEF340A98172AACE5ull, -715 },
+                { 0xB23867FB2A35B28Eull, -688 }, { 0x84C8D4DFD2C63F3Bull, -661 },
+                { 0xC5DD44271AD3CDBAull, -635 }, { 0x936B9FCEBB25C996ull, -608 },
+                { 0xDBAC6C247D62A584ull, -582 }, { 0xA3AB66580D5FDAF6ull, -555 },
+                { 0xF3E2F893DEC3F126ull, -529 }, { 0xB5B5ADA8AAFF80B8ull, -502 },
+                { 0x87625F056C7C4A8Bull, -475 }, { 0xC9BCFF6034C13053ull, -449 },
+                { 0x964E858C91BA2655ull, -422 }, { 0xDFF9772470297EBDull, -396 },
+                { 0xA6DFBD9FB8E5B88Full, -369 }, { 0xF8A95FCF88747D94ull, -343 },
+                { 0xB94470938FA89BCFull, -316 }, { 0x8A08F0F8BF0F156Bull, -289 },
+                { 0xCDB02555653131B6ull, -263 }, { 0x993FE2C6D07B7FACull, -236 },
+                { 0xE45C10C42A2B3B06ull, -210 }, { 0xAA242499697392D3ull, -183 },
+                { 0xFD87B5F28300CA0Eull, -157 }, { 0xBCE5086492111AEBull, -130 },
+                { 0x8CBCCC096F5088CCull, -103 }, { 0xD1B71758E219652Cull, -77 },
+                { 0x9C40000000000000ull, -50 }, { 0xE8D4A51000000000ull, -24 },
+                { 0xAD78EBC5AC620000ull, 3 }, { 0x813F3978F8940984ull, 30 },
+                { 0xC097CE7BC90715B3ull, 56 }, { 0x8F7E32CE7BEA5C70ull, 83 },
+                { 0xD5D238A4ABE98068ull, 109 }, { 0x9F4F2726179A2245ull, 136 },
+                { 0xED63A231D4C4FB27ull, 162 }, { 0xB0DE65388CC8ADA8ull, 189 },
+                { 0x83C7088E1AAB65DBull, 216 }, { 0xC45D1DF942711D9Aull, 242 },
+                { 0x924D692CA61BE758ull, 269 }, { 0xDA01EE641A708DEAull, 295 },
+                { 0xA26DA3999AEF774Aull, 322 }, { 0xF209787BB47D6B85ull, 348 },
+                { 0xB454E4A179DD1877ull, 375 }, { 0x865B86925B9BC5C2ull, 402 },
+                { 0xC83553C5C8965D3Dull, 428 }, { 0x952AB45CFA97A0B3ull, 455 },
+                { 0xDE469FBD99A05FE3ull, 481 }, { 0xA59BC234DB398C25ull, 508 },
+                { 0xF6C69A72A3989F5Cull, 534 }, { 0xB7DCBF5354E9BECEull, 561 },
+                { 0x88FCF317F22241E2ull, 588 }, { 0xCC20CE9BD35C78A5ull, 614 },
+                { 0x98165AF37B2153DFull, 641 }, { 0xE2A0B5DC971F303Aull, 667 },
+                { 0xA8D9D1535CE3B396ull, 694 }, { 0xFB9B7CD9A4A7443Cull, 720 },
+                { 0xBB764C4CA7A44410ull, 747 }, { 0x8BAB8EEFB6409C1Aull, 774 },
+                { 0xD01FEF10A657842Cull, 800 }, { 0x9B10A4E5E9913129ull, 827 },
+                { 0xE7109BFBA19C0C9Dull, 853 }, { 0xAC2820D9623BF429ull, 880 },
+                { 0x80444B5E7AA7CF85ull, 907 }, { 0xBF21E44003ACDD2Dull, 933 },
+                { 0x8E679C2F5E44FF8Full, 960 }, { 0xD433179D9C8CB841ull, 986 },
+                { 0x9E19DB92B4E31BA9ull, 1013 }, { 0xEB96BF6EBADF77D9ull, 1039 },
+                { 0xAF87023B9BF0EE6Bull, 1066 }
+            };
+
+            const double dk = (-61 - e) * 0.30102999566398114 + 347; //log10(2)
+            int index = (int)dk;
+            if (dk - index > 0.0)
+                ++index;
+            index = (index >> 3) + 1;
+            k = -(-348 + index * 8);
+            assert(index >= 0 && index < 87);
+            return c_powers[index];
+        }
+
+        inline int CountDigits(std::uint32_t value)
+        {
+            int count = 1;
+            while (value >= 10)
+            {
+                value /= 10;
+                ++count;
+            }
+            return count;
+        }
+
+        // Moves the last digit towards the exact value (w) while it stays
+        // within the range of numbers that read back as the double.
+        inline void GrisuRound(char* digits, int length, std::uint64_t delta, std::uint64_t rest, std::uint64_t tenKappa, std::uint64_t distance)
+        {
+            while (rest < distance && delta - rest >= tenKappa &&
+                (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+            {
+                --digits[length - 1];
+                rest += tenKappa;
+            }
+        }
+
+        // Generates the digits of upper (the upper bound of the range, scaled
+        // by 10^-k), stopping as soon as they're within delta of it; k is
+        // adjusted by the number of digits not generated.
+        inline int GenerateDigits(const DiyFp& w, const DiyFp& upper, std::uint64_t delta, char* digits, int& k)
+        {
+            static const std::uint64_t c_powersOf10[20] =
+            {
+                1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull,
+                10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull,
+                1000000000000000ull, 10000000000000000ull, 100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+            };
+
+            const int shift = -upper.e;
+            const std::uint64_t one = 1ull << shift;
+            const std::uint64_t distance = upper.f - w.f;
+            std::uint32_t integral = (std::uint32_t)(upper.f >> shift);
+            std::uint64_t fraction = upper.f & (one - 1);
+            int length = 0;
+
+            // The digits of the integral part...
+            int kappa = CountDigits(integral);
+            while (kappa > 0)
+            {
+                const std::uint32_t divisor = (std::uint32_t)c_powersOf10[kappa - 1];
+                const std::uint32_t digit = integral / divisor;
+                integral %= divisor;
+                if (digit != 0 || length != 0)
+                    digits[length++] = (char)('0' + digit);
+                --kappa;
+
+                const std::uint64_t rest = ((std::uint64_t)integral << shift) + fraction;
+                if (rest <= delta)
+                {
+                    k += kappa;
+                    GrisuRound(digits, length, delta, rest, c_powersOf10[kappa] << shift, distance);
+                    return length;
+                }
+            }
+
+            // ...then of the fraction.
+            for (;;)
+            {
+                fraction *= 10;
+                delta *= 10;
+                const char digit = (char)(fraction >> shift);
+                if (digit != 0 || length != 0)
+                    digits[length++] = (char)('0' + digit);
+                fraction &= one - 1;
+                --kappa;
+                if (fraction < delta)
+                {
+                    k += kappa;
+                    GrisuRound(digits, length, delta, fraction, one, (-kappa < 20 ? distance * c_powersOf10[-kappa] : 0));
+                    return length;
+                }
+            }
+        }
+
+        // The digits of a positive, finite double (at most 17), where its
+        // value is digits * 10^k.
+        inline int Grisu2(double value, char* digits, int& k)
+        {
+            assert(value > 0);
+
+            const std::uint64_t c_hiddenBit = 1ull << 52;
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            const int biasedExponent = (int)(bits >> 52) & 0x7FF;
+
+            DiyFp v;
+            if (biasedExponent != 0)
+                v = DiyFp{ (bits & (c_hiddenBit - 1)) | c_hiddenBit, biasedExponent - 1075 };
+            else
+                v = DiyFp{ bits & (c_hiddenBit - 1), -1074 }; //subnormal
+
+            // The bounds of the range of numbers that read back as v: halfway
+            // to its neighbours (the one below being closer if v is a power of
+            // two, other than the smallest normal)...
+            DiyFp upper{ (v.f << 1) + 1, v.e - 1 };
+            while ((upper.f & (c_hiddenBit << 1)) == 0)
+            {
+                upper.f <<= 1;
+                --upper.e;
+            }
+            upper.f <<= 10;
+            upper.e -= 10;
+            DiyFp lower = (v.f == c_hiddenBit && biasedExponent > 1) ? DiyFp{ (v.f << 2) - 1, v.e - 2 } : DiyFp{ (v.f << 1) - 1, v.e - 1 };
+            lower.f <<= lower.e - upper.e;
+            lower.e = upper.e;
+
+            DiyFp w = v;
+            while ((w.f & c_hiddenBit) == 0)
+            {
+                w.f <<= 1;
+                --w.e;
+            }
+            w.f <<= 11;
+            w.e -= 11;
+
+            // ...scaled so that the digits can be generated with integers,
+            // and narrowed to allow for the error of the multiplications.
+            const DiyFp power = GetCachedPower(upper.e, k);
+            w = Multiply(w, power);
+            upper = Multiply(upper, power);
+            lower = Multiply(lower, power);
+            ++lower.f;
+            --upper.f;
+            return GenerateDigits(w, upper, upper.f - lower.f, digits, k);
+        }
+
+        inline char* FormatExponent(int exponent, char* out)
+        {
+            *out++ = 'e';
+            if (exponent < 0)
+            {
+                *out++ = '-';
+                exponent = -exponent;
+            }
+            return FormatUInt64((std::uint64_t)exponent, out);
+        }
+
+        // Writes a finite double as the shortest JSON number that reads back
+        // as the same value (see Grisu2), returning the char after it. So that
+        // it reads back as a double rather than an integer, a whole number has
+        // a fraction of ".0" (unless it's 1e21 or more, so has an exponent).
+        inline char* FormatDouble(double value, char* out)
+        {
+            if (std::signbit(value))
+            {
+                *out++ = '-';
+                value = -value;
+            }
+            if (value == 0)
+            {
+                std::memcpy(out, "0.0", 3);
+                return out + 3;
+            }
+
+            int k;
+            const int length = Grisu2(value, out, k);
+            const int point = length + k; //where the decimal point goes
+
+            if (k >= 0 && point <= 21)
+            {
+                // 1234e7 => 12340000000.0
+                std::memset(out + length, '0', (std::size_t)k);
+                std::memcpy(out + point, ".0", 2);
+                return out + point + 2;
+            }
+            if (point > 0 && point <= 21)
+            {
+                // 1234e-2 => 12.34
+                std::memmove(out + point + 1, out + point, (std::size_t)(length - point));
+                out[point] = '.';
+                return out + length + 1;
+            }
+            if (point > -6 && point <= 0)
+            {
+                // 1234e-6 => 0.001234
+                const int offset = 2 - point;
+                std::memmove(out + offset, out, (std::size_t)length);
+                out[0] = '0';
+                out[1] = '.';
+                std::memset(out + 2, '0', (std::size_t)(offset - 2));
+                return out + offset + length;
+            }
+            if (length == 1)
+            {
+                // 1e30
+                return FormatExponent(point - 1, out + 1);
+            }
+
+            // 1234e30 => 1.234e33
+            std::memmove(out + 2, out + 1, (std::size_t)(length - 1));
+            out[1] = '.';
+            return FormatExponent(point - 1, out + length + 1);
+        }
+    }
+}
+
+#endif //__CYOJSON_DETAIL_FORMAT_HPP
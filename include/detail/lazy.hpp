@@ -0,0 +1,381 @@
+/*
+[CyoJSON] detail/lazy.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_LAZY_HPP
+#define __CYOJSON_DETAIL_LAZY_HPP
+
+#include "number.hpp"
+#include "scanner.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // The buffer for a LazyScanner's unescaped strings, which is a base
+        // class so that it's constructed before the Scanner.
+        struct LazyScratch
+        {
+            BufferString buffer;
+        };
+
+        // Scans part of a LazyDocument, starting from an element. Each of the
+        // parse functions records the position of any error in the document.
+        class LazyScanner final : private LazyScratch, private Scanner
+        {
+        public:
+            LazyScanner(LazyDocument& document, const char* next, int line, int column)
+                : Scanner(next, document.end_, buffer),
+                document_(document)
+            {
+                line_ = line;
+                column_ = column;
+            }
+
+            LazyScanner(const LazyScanner&) = delete;
+
+            void operator=(const LazyScanner&) = delete;
+
+            const char* getNext() const { return next_; }
+            int getLine() const { return line_; }
+            int getColumn() const { return column_; }
+
+            char Peek()
+            {
+                SkipWhitespace();
+                return CurrChar();
+            }
+
+            bool IsNext(char ch)
+            {
+                return Scanner::IsNext(ch);
+            }
+
+            bool Expect(char ch)
+            {
+                return (Scanner::IsNext(ch) || Fail());
+            }
+
+            bool ParseLiteral(const char* literal)
+            {
+                return (Scanner::IsNext(literal) || Fail());
+            }
+
+            // An unescaped string is kept by the document, until the next call.
+            bool ParseString(const char*& str, std::size_t& length)
+            {
+                if (!Scanner::ParseString(str, length))
+                    return Fail();
+                if (str == scratch_.data())
+                {
+                    document_.scratch_.assign(str, length);
+                    str = document_.scratch_.data();
+                }
+                return true;
+            }
+
+            bool ParseNumber(NumberValue& value)
+            {
+                const char* number;
+                std::size_t length;
+                return (Scanner::ParseNumber(number, length, value) || Fail());
+            }
+
+            bool SkipValue()
+            {
+                bool skipped = (document_.skipMode_ == Parser::SkipMode::Unchecked ? SkipValueUnchecked() : Scanner::SkipValue());
+                return (skipped || Fail());
+            }
+
+            bool Fail()
+            {
+                if (!document_.error_)
+                {
+                    document_.error_ = true;
+                    document_.line_ = line_;
+                    document_.column_ = column_;
+                }
+                return false;
+            }
+
+        private:
+            LazyDocument& document_;
+        };
+    }
+
+    inline LazyDocument::Element LazyDocument::getRoot()
+    {
+        if (!json_)
+        {
+            error_ = true;
+            return Element();
+        }
+
+        Element root(this, json_, 1, 1, nullptr, Element::Context::Root);
+        detail::LazyScanner scanner(*this, json_, 1, 1);
+        if (scanner.Peek() != '{')
+        {
+            scanner.Fail();
+            return Element();
+        }
+        return root.ParseElement(scanner, nullptr, Element::Context::Root);
+    }
+
+    inline bool LazyDocument::Element::getType(Document::Type& type) const
+    {
+        if (!IsValid())
+            return false;
+
+        switch (*next_)
+        {
+        case '{':
+            type = Document::Type::Object;
+            return true;
+        case '[':
+            type = Document::Type::Array;
+            return true;
+        case '\"':
+            type = Document::Type::String;
+            return true;
+        case 't':
+        case 'f':
+            type = Document::Type::Bool;
+            return true;
+        case 'n':
+            type = Document::Type::Null;
+            return true;
+        }
+
+        detail::NumberValue value;
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        if (!scanner.ParseNumber(value))
+            return false;
+        switch (value.type)
+        {
+        case detail::NumberValue::Type::Int64:
+            type = Document::Type::Int64;
+            break;
+        case detail::NumberValue::Type::UInt64:
+            type = Document::Type::UInt64;
+            break;
+        case detail::NumberValue::Type::Double:
+            type = Document::Type::Double;
+            break;
+        }
+        return true;
+    }
+
+    inline bool LazyDocument::Element::getInt64(std::int64_t& value) const
+    {
+        if (!IsValid() || (*next_ != '-' && !detail::IsDigit(*next_)))
+            return false;
+
+        detail::NumberValue number;
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        if (!scanner.ParseNumber(number) || number.type != detail::NumberValue::Type::Int64)
+            return false;
+        value = number.int64;
+        return true;
+    }
+
+    inline bool LazyDocument::Element::getUInt64(std::uint64_t& value) const
+    {
+        if (!IsValid() || !detail::IsDigit(*next_))
+            return false;
+
+        detail::NumberValue number;
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        if (!scanner.ParseNumber(number) || number.type == detail::NumberValue::Type::Double)
+            return false;
+        value = (number.type == detail::NumberValue::Type::Int64 ? (std::uint64_t)number.int64 : number.uint64);
+        return true;
+    }
+
+    inline bool LazyDocument::Element::getDouble(double& value) const
+    {
+        if (!IsValid() || (*next_ != '-' && !detail::IsDigit(*next_)))
+            return false;
+
+        detail::NumberValue number;
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        if (!scanner.ParseNumber(number))
+            return false;
+        switch (number.type)
+        {
+        case detail::NumberValue::Type::Int64:
+            value = (double)number.int64;
+            break;
+        case detail::NumberValue::Type::UInt64:
+            value = (double)number.uint64;
+            break;
+        case detail::NumberValue::Type::Double:
+            value = number.dbl;
+            break;
+        }
+        return true;
+    }
+
+    inline bool LazyDocument::Element::getBool(bool& value) const
+    {
+        if (!IsValid() || (*next_ != 't' && *next_ != 'f'))
+            return false;
+
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        value = (*next_ == 't');
+        return scanner.ParseLiteral(value ? "true" : "false");
+    }
+
+    inline bool LazyDocument::Element::IsNull() const
+    {
+        if (!IsValid() || *next_ != 'n')
+            return false;
+
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        return scanner.ParseLiteral("null");
+    }
+
+    inline bool LazyDocument::Element::getString(const char*& str, std::size_t& length) const
+    {
+        if (!IsValid() || *next_ != '\"')
+            return false;
+
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        return scanner.ParseString(str, length);
+    }
+
+    inline bool LazyDocument::Element::getKey(const char*& key, std::size_t& length) const
+    {
+        if (!IsValid() || !key_)
+            return false;
+
+        detail::LazyScanner scanner(*document_, key_, line_, column_); //already checked
+        return scanner.ParseString(key, length);
+    }
+
+    inline LazyDocument::Element LazyDocument::Element::Find(const char* key) const
+    {
+        if (!IsValid() || *next_ != '{')
+            return Element();
+
+        const std::size_t keyLength = std::strlen(key);
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        scanner.IsNext('{');
+        if (scanner.IsNext('}'))
+            return Element();
+
+        for (;;)
+        {
+            if (scanner.Peek() != '\"')
+            {
+                scanner.Fail();
+                return Element();
+            }
+            const char* memberKey = scanner.getNext();
+            const char* str;
+            std::size_t length;
+            if (!scanner.ParseString(str, length) || !scanner.Expect(':'))
+                return Element();
+            if (length == keyLength && std::memcmp(str, key, length) == 0)
+                return ParseElement(scanner, memberKey, Context::Member);
+
+            if (!scanner.SkipValue())
+                return Element();
+            if (scanner.IsNext('}'))
+                return Element();
+            if (!scanner.Expect(','))
+                return Element();
+        }
+    }
+
+    inline LazyDocument::Element LazyDocument::Element::getFirst() const
+    {
+        if (!IsValid() || (*next_ != '{' && *next_ != '['))
+            return Element();
+
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        if (scanner.IsNext('{'))
+            return (scanner.IsNext('}') ? Element() : ParseMember(scanner));
+
+        scanner.IsNext('[');
+        return (scanner.IsNext(']') ? Element() : ParseElement(scanner, nullptr, Context::Element));
+    }
+
+    inline LazyDocument::Element LazyDocument::Element::getNext() const
+    {
+        if (!IsValid() || context_ == Context::Root)
+            return Element();
+
+        detail::LazyScanner scanner(*document_, next_, line_, column_);
+        if (!scanner.SkipValue())
+            return Element();
+        if (scanner.IsNext(context_ == Context::Member ? '}' : ']'))
+            return Element();
+        if (!scanner.Expect(','))
+            return Element();
+        return (context_ == Context::Member ? ParseMember(scanner) : ParseElement(scanner, nullptr, Context::Element));
+    }
+
+    // Parses the key of a member, returning its value.
+    inline LazyDocument::Element LazyDocument::Element::ParseMember(detail::LazyScanner& scanner) const
+    {
+        if (scanner.Peek() != '\"')
+        {
+            scanner.Fail();
+            return Element();
+        }
+        const char* key = scanner.getNext();
+        const char* str;
+        std::size_t length;
+        if (!scanner.ParseString(str, length) || !scanner.Expect(':'))
+            return Element();
+        return ParseElement(scanner, key, Context::Member);
+    }
+
+    // The value at the scanner, which must start with a valid char.
+    inline LazyDocument::Element LazyDocument::Element::ParseElement(detail::LazyScanner& scanner, const char* key, Context context) const
+    {
+        switch (scanner.Peek())
+        {
+        case '{': case '[': case '\"': case 't': case 'f': case 'n': case '-':
+        case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+            return Element(document_, scanner.getNext(), scanner.getLine(), scanner.getColumn(), key, context);
+        }
+        scanner.Fail();
+        return Element();
+    }
+}
+
+#endif //__CYOJSON_DETAIL_LAZY_HPP
@@ -28,13 +28,23 @@ SOFTWARE.
 #   error Do not #include this file!
 #endif
 
-#include "utf8.hpp"
+#include "bulk.hpp"
+#include "events.hpp"
+#include "filter.hpp"
+#include "scanner.hpp"
+#include "structural.hpp"
 
-#include <cassert>
-#include <cctype>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <new>
 #include <string>
+#include <utility>
+#include <vector>
+
+#ifndef CYOJSON_NO_THREADS
+#   include <thread>
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -42,407 +52,512 @@ namespace cyojson
 {
     namespace detail
     {
-        class ParserImpl final
+        template <typename Handler>
+        class ParserImpl final : private Scanner
         {
         public:
-            ParserImpl(const char* next, Parser::Callbacks& callbacks)
-                : next_(next),
-                callbacks_(callbacks)
+            ParserImpl(const char* next, const char* end, Handler& handler, const PathFilter& filter, PathTable* pathTable, ParserBuffers& buffers)
+                : Scanner(next, end, buffers.scratch),
+                path_(pathTable, buffers, (Events<Handler>::c_usesPaths || pathTable || !filter.IsEmpty())),
+                events_(handler),
+                filter_(filter)
             {
+                events_.SetPathId(PathTable::c_rootId);
             }
 
             ParserImpl(const ParserImpl&) = delete;
 
             void operator=(const ParserImpl&) = delete;
 
-            bool Parse(int& line, int& column)
+            // Starts again on another document, e.g. the next record.
+            void Reset(const char* next, const char* end)
             {
-                if (!ParseObject())
-                {
-                    line = line_;
-                    column = column_;
-                    return false;
-                }
-
-                SkipWhitespace();
-
-                line = line_;
-                column = column_;
-                return (*next_ == '\0');
+                Scanner::Reset(next, end);
+                path_.Clear();
+                events_.SetPathId(PathTable::c_rootId);
+                stopped_ = false;
             }
 
-        private:
-            const int c_firstLine = 1;
-            const int c_firstColumnOfLine = 1;
-            const char* const c_true = "true";
-            const char* const c_false = "false";
-            const char* const c_null = "null";
-
-            int line_ = c_firstLine;
-            int column_ = c_firstColumnOfLine;
-            const char* next_;
-            std::string path_;
-            Parser::Callbacks& callbacks_;
-
-            void NextChar()
+            // Counts the statistics of each parse (if c_statistics).
+            void setStatistics(Parser::Statistics* stats)
             {
-                ++next_;
-                ++column_;
+                stats_ = stats;
+                path_.setStatistics(stats);
             }
 
-            void NextChars(int count)
+            void setUTF8Mode(Parser::UTF8Mode mode)
             {
-                next_ += count;
-                column_ += count;
+                checkUTF8_ = (mode == Parser::UTF8Mode::Checked);
             }
 
-            void NewLine()
-            {
-                column_ = c_firstColumnOfLine;
-                ++line_;
-            }
-
-            void SkipWhitespace()
+            // Succeeds if the handler asks to stop, with line and column
+            // giving where it stopped.
+            bool Parse(int& line, int& column)
             {
-                while (*next_ != '\0')
+                const char* const start = next_;
+                bool success = ParseObject(filter_.Match("", 0));
+                if (success)
                 {
-                    switch (*next_)
-                    {
-                    case '\r':
-                        if (*(next_ + 1) == '\n')
-                            next_ += 2;
-                        else
-                            ++next_;
-                        NewLine();
-                        continue;
-
-                    case '\n':
-                        ++next_;
-                        NewLine();
-                        continue;
-                    }
-
-                    if (std::isspace(*next_))
-                        NextChar();
-                    else
-                        break;
-                }
-            }
-
-            bool IsNext(char ch, bool skipWhitespace = true)
-            {
-                assert(ch != '\0');
-                assert(!std::isspace(ch));
-
-                if (skipWhitespace)
-                    SkipWhitespace();
-
-                if (*next_ != ch)
-                    return false;
-
-                NextChar();
-                return true;
-            }
-
-            bool IsNext(char ch1, char ch2, bool skipWhitespace = true)
-            {
-                assert(ch1 != '\0' && ch2 != '\0');
-                assert(!std::isspace(ch1) && !std::isspace(ch2));
-
-                if (skipWhitespace)
-                    SkipWhitespace();
-
-                if (*next_ != ch1 && *next_ != ch2)
-                    return false;
-
-                NextChar();
-                return true;
-            }
-
-            bool IsNext(const char* str, bool skipWhitespace = true)
-            {
-                assert(str && *str);
-
-                if (skipWhitespace)
                     SkipWhitespace();
-
-                const char* next = next_;
-                const char* nextStr = str;
-                while (*nextStr && *nextStr == *next)
+                    success = IsEnd();
+                }
+                else if (stopped_)
                 {
-                    ++next;
-                    ++nextStr;
+                    success = true;
                 }
-                if (*nextStr)
-                    return false;
 
-                NextChars((int)(nextStr - str));
-                return true;
+                line = line_;
+                column = column_;
+                if (c_statistics && stats_)
+                    stats_->bytes += (std::size_t)(next_ - start);
+                return success;
             }
 
-            bool ParseString(std::string& out)
+            // Parses a run of the elements of an array at the given path, as
+            // a slice of a BulkArray, up to the end of the text.
+            bool ParseSlice(const BufferVector<std::pair<const char*, std::size_t>>& keys, PathMatch match, int& line, int& column)
             {
-                assert(out.empty());
-
-                if (!IsNext('\"'))
-                    return false;
+                for (const auto& key : keys)
+                    path_.Push(key.first, key.second);
+                if (path_.HasTable())
+                    events_.SetPathId(path_.getId());
 
-                for (;;)
+                bool success = true;
+                do
                 {
-                    char ch = *next_;
-                    if (ch == '\"')
-                        break;
-
-                    NextChar();
-
-                    if (ch != '\\')
-                    {
-                        out += ch;
-                        continue;
-                    }
-
-                    if (*next_ == 'u')
+                    if (!ParseValue(match))
                     {
-                        if (!ParseUnicode(out))
-                            return false;
-                        else
-                            continue;
+                        success = false;
+                        break;
                     }
-
-                    const char* const escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
-                    const char* escape = std::strchr(escapes, *next_);
-                    if (escape == nullptr)
-                        return false;
-                    out += *(escape + 1);
-                    NextChar();
                 }
+                while (IsNext(','));
 
-                if (!IsNext('\"'))
-                    return false;
-
-                return true;
+                line = line_;
+                column = column_;
+                return (success && IsEnd());
             }
 
-            bool ParseNumber(std::string& out)
-            {
-                assert(out.empty());
-
-                SkipWhitespace();
-
-                const char* numberStart = next_;
-
-                IsNext('-', false);
-
-                if (!IsNext('0', false))
-                {
-                    while (std::isdigit(*next_))
-                        NextChar();
-                }
+#ifndef CYOJSON_NO_THREADS
+            void setBulkArray(BulkArray* bulk) { bulk_ = bulk; }
+#endif
 
-                if (IsNext('.', false))
-                {
-                    while (std::isdigit(*next_))
-                        NextChar();
-                }
+            // Has the recorder (the handler) record where each event is.
+            void TrackPosition(EventRecorder& recorder) { recorder.TrackPosition(&next_, &line_, &column_); }
 
-                if (IsNext('e', 'E', false))
-                {
-                    IsNext('+', '-', false);
+            // Whether the last parse was stopped by the handler.
+            bool IsStopped() const { return stopped_; }
 
-                    while (std::isdigit(*next_))
-                        NextChar();
-                }
+        private:
+            PathStack path_;
+            Events<Handler> events_;
+            const PathFilter& filter_;
+#ifndef CYOJSON_NO_THREADS
+            BulkArray* bulk_ = nullptr;
+#endif
+            bool stopped_ = false;
 
-                const char* numberEnd = next_;
-                if (numberStart == numberEnd)
-                    return false;
+            // Whether the handler asked to stop, in which case the parse ends
+            // at once, returning false as for an error.
+            bool IsStop(Parser::Action action)
+            {
+                stopped_ = (action == Parser::Action::Stop);
+                return stopped_;
+            }
 
-                out = std::string(numberStart, numberEnd - numberStart);
-                return true;
+            // Skips the rest of the object or array whose opening bracket was
+            // just read, as the handler asked.
+            bool SkipContents()
+            {
+                --next_;
+                --column_;
+                return (filter_.IsUnchecked() ? SkipValueUnchecked() : SkipValue());
             }
 
-            bool ParseValue()
+            bool ParseValue(PathMatch match)
             {
                 SkipWhitespace();
 
-                switch (*next_)
+                if (match != PathMatch::Deliver && (match == PathMatch::Skip || (CurrChar() != '{' && CurrChar() != '[')))
+                    return (filter_.IsUnchecked() ? SkipValueUnchecked() : SkipValue());
+
+                switch (CurrChar())
                 {
                 case '{':
-                    return ParseObject();
+                    return ParseObject(match);
 
                 case '[':
-                    return ParseArray();
+                    return ParseArray(match);
 
                 case '\"':
                 {
-                    std::string str;
-                    if (!ParseString(str))
+                    const char* str;
+                    std::size_t length;
+                    if (!ParseString(str, length))
                         return false;
-                    callbacks_.Value(path_.c_str(), str.c_str());
-                    return true;
+                    Count(&Parser::Statistics::strings);
+                    return !IsStop(events_.String(path_.c_str(), str, length));
                 }
 
                 case 't':
                     if (!IsNext(c_true))
                         return false;
-                    callbacks_.Value(path_.c_str(), c_true);
-                    return true;
+                    Count(&Parser::Statistics::bools);
+                    return !IsStop(events_.Literal(path_.c_str(), c_true));
 
                 case 'f':
                     if (!IsNext(c_false))
                         return false;
-                    callbacks_.Value(path_.c_str(), c_false);
-                    return true;
+                    Count(&Parser::Statistics::bools);
+                    return !IsStop(events_.Literal(path_.c_str(), c_false));
 
                 case 'n':
                     if (!IsNext(c_null))
                         return false;
-                    callbacks_.Value(path_.c_str(), c_null);
-                    return true;
+                    Count(&Parser::Statistics::nulls);
+                    return !IsStop(events_.Literal(path_.c_str(), c_null));
 
                 default:
+                    return ParseNumberValue();
+                }
+            }
+
+            bool ParseNumberValue()
+            {
+                const char* num;
+                std::size_t length;
+                Parser::Action action;
+                if (Events<Handler>::c_convertsNumbers)
                 {
-                    std::string num;
-                    if (!ParseNumber(num))
+                    NumberValue value;
+                    if (!ParseNumber(num, length, value))
                         return false;
-                    callbacks_.Value(path_.c_str(), num.c_str());
-                    return true;
+                    action = events_.Number(path_.c_str(), value, num, length);
                 }
+                else
+                {
+                    if (!ParseNumber(num, length))
+                        return false;
+                    action = events_.Number(path_.c_str(), num, length);
                 }
+                Count(&Parser::Statistics::numbers);
+                return !IsStop(action);
             }
 
-            bool ParseArray()
+            bool ParseArray(PathMatch match)
             {
+#ifndef CYOJSON_NO_THREADS
+                if (bulk_ && next_ == bulk_->getStart())
+                    return ParseBulkArray(match);
+#endif
+
                 if (!IsNext('['))
                     return false;
 
-                callbacks_.ArrayStart(path_.c_str());
+                Count(&Parser::Statistics::arrays);
+                CountNested();
+                Parser::Action action = Parser::Action::Continue;
+                if (match == PathMatch::Deliver && IsStop(action = events_.ArrayStart(path_.c_str())))
+                    return false;
+                if (action == Parser::Action::Skip)
+                    return (SkipContents() && EndArray(match));
+
+                return ParseElements(match, true);
+            }
 
-                for (;;)
+#ifndef CYOJSON_NO_THREADS
+            // Delivers the events of each slice of the array, as parsed by the
+            // workers. If a slice is invalid, the rest of the array is parsed
+            // here instead, to report the error as usual. If the handler asks
+            // to stop during a slice, the parse stops where that event was.
+            bool ParseBulkArray(PathMatch match)
+            {
+                BulkArray& bulk = *bulk_;
+                bulk_ = nullptr;
+
+                NextChar(); //'['
+                Count(&Parser::Statistics::arrays);
+                CountNested();
+                Parser::Action action = Parser::Action::Continue;
+                if (match == PathMatch::Deliver && IsStop(action = events_.ArrayStart(path_.c_str())))
+                    return false;
+                if (action == Parser::Action::Skip)
                 {
-                    if (!ParseValue())
-                        break;
+                    bulk.Stop();
+                    return (SkipContents() && EndArray(match));
+                }
 
-                    if (!IsNext(','))
-                        break;
+                bool afterComma = false;
+                if (match == bulk.getMatch() && (!path_.IsEnabled() || bulk.getPath() == path_.c_str()))
+                {
+                    while (BulkArray::Chunk* slice = bulk.NextParsed())
+                    {
+                        const bool success = slice->success;
+                        if (success)
+                        {
+                            const EventRecorder::Position* stoppedAt = nullptr;
+                            stopped_ = !bulk.Replay(*slice, events_, path_.IsEnabled(), stoppedAt);
+                            if (c_statistics && stats_)
+                                AddStatistics(*stats_, slice->statistics, depth_);
+                            if (stopped_)
+                                SkipTo(stoppedAt->next, stoppedAt->line, stoppedAt->column);
+                            else
+                                SkipTo(slice->end, slice->line, slice->column);
+                            afterComma = false;
+                        }
+                        bulk.Release(slice);
+                        if (stopped_)
+                        {
+                            bulk.Stop();
+                            return false;
+                        }
+                        if (!success || CurrChar() != ',')
+                            break;
+                        NextChar();
+                        afterComma = true;
+                    }
+                    if (path_.HasTable())
+                        events_.SetPathId(path_.getId());
                 }
+                bulk.Stop();
 
-                if (!IsNext(']'))
-                    return false;
+                return ParseElements(match, !afterComma);
+            }
+
+            // Moves to next, given its line and column relative to the current
+            // position (as though that were at the start of the text).
+            void SkipTo(const char* next, int line, int column)
+            {
+                next_ = next;
+                if (line == c_firstLine)
+                {
+                    column_ += column - c_firstColumnOfLine;
+                }
+                else
+                {
+                    line_ += line - c_firstLine;
+                    column_ = column;
+                }
+            }
+#endif
+
+            // Parses the rest of an array, after the '[' (if first) or a ','.
+            bool ParseElements(PathMatch match, bool first)
+            {
+                if (!first || !IsNext(']'))
+                {
+                    do
+                    {
+                        if (!ParseValue(match))
+                            return false;
+                    }
+                    while (IsNext(','));
+
+                    if (!IsNext(']'))
+                        return false;
+                }
 
-                callbacks_.ArrayEnd(path_.c_str());
+                return EndArray(match);
+            }
 
-                return true;
+            bool EndArray(PathMatch match)
+            {
+                EndNested();
+                return (match != PathMatch::Deliver || !IsStop(events_.ArrayEnd(path_.c_str())));
             }
 
-            bool ParseObject()
+            bool ParseObject(PathMatch match)
             {
                 if (!IsNext('{'))
                     return false;
 
-                callbacks_.ObjectStart(path_.c_str());
+                Count(&Parser::Statistics::objects);
+                CountNested();
+                Parser::Action action = Parser::Action::Continue;
+                if (match == PathMatch::Deliver && IsStop(action = events_.ObjectStart(path_.c_str())))
+                    return false;
+                if (action == Parser::Action::Skip)
+                    return (SkipContents() && EndObject(match));
 
-                for (;;)
+                if (!IsNext('}'))
                 {
-                    std::string name;
-                    if (!ParseString(name))
-                        break;
-                    if (!path_.empty())
-                        path_ += ':';
-                    path_ += name;
-
-                    if (!IsNext(':'))
-                        break;
+                    do
+                    {
+                        const char* key;
+                        std::size_t keyLength;
+                        if (!ParseString(key, keyLength))
+                            return false;
+                        Count(&Parser::Statistics::keys);
+                        if (match == PathMatch::Deliver && IsStop(action = events_.Key(path_.c_str(), key, keyLength)))
+                            return false;
+                        path_.Push(key, keyLength);
+                        if (path_.HasTable())
+                            events_.SetPathId(path_.getId());
+                        PathMatch memberMatch = (match == PathMatch::Deliver ? match : filter_.Match(path_.c_str(), path_.size()));
+                        if (action == Parser::Action::Skip)
+                            memberMatch = PathMatch::Skip;
+
+                        if (!IsNext(':'))
+                            return false;
 
-                    if (!ParseValue())
-                        break;
+                        if (!ParseValue(memberMatch))
+                            return false;
 
-                    auto pos = path_.find_last_of(':');
-                    if (pos != path_.npos)
-                        path_.erase(pos);
-                    else
-                        path_.clear();
+                        path_.Pop();
+                        if (path_.HasTable())
+                            events_.SetPathId(path_.getId());
+                    }
+                    while (IsNext(','));
 
-                    if (!IsNext(','))
-                        break;
+                    if (!IsNext('}'))
+                        return false;
                 }
 
-                if (!IsNext('}'))
-                    return false;
-
-                callbacks_.ObjectEnd(path_.c_str());
-
-                return true;
+                return EndObject(match);
             }
 
-            bool ParseUnicode(std::string& out)
+            bool EndObject(PathMatch match)
             {
-                NextChar(); //u
+                EndNested();
+                return (match != PathMatch::Deliver || !IsStop(events_.ObjectEnd(path_.c_str())));
+            }
+        };
+    }
 
-                // Parse first (or only) char...
+    inline Parser::~Parser()
+    {
+        ReleaseBuffers();
+    }
 
-                std::uint16_t value;
-                if (!ParseUnicodeChar(value))
-                    return false;
+    inline void Parser::setAllocator(Allocator* allocator)
+    {
+        ReleaseBuffers();
+        allocator_ = allocator;
+    }
 
-                if (value < 0xD800 || value >= 0xE000)
-                {
-                    OutputUTF8(out, value);
-                    return true;
-                }
+    inline void Parser::ReleaseBuffers()
+    {
+#ifndef CYOJSON_NO_THREADS
+        if (workers_)
+        {
+            detail::BufferAllocator<detail::WorkerPool> allocator(allocator_);
+            workers_->~WorkerPool();
+            allocator.deallocate(workers_, 1);
+            workers_ = nullptr;
+        }
+#endif
 
-                std::uint16_t highSurrogate = value;
-                if (highSurrogate >= 0xDC00)
-                    return false; //invalid high surrogate
+        if (!buffers_)
+            return;
 
-                assert(0xD800 <= highSurrogate && highSurrogate <= 0xDBFF);
+        detail::BufferAllocator<detail::ParserBuffers> allocator(allocator_);
+        buffers_->~ParserBuffers();
+        allocator.deallocate(buffers_, 1);
+        buffers_ = nullptr;
+    }
 
-                // Parse second char...
+    inline detail::ParserBuffers& Parser::getBuffers()
+    {
+        if (!buffers_)
+        {
+            // The buffers themselves come from the allocator too...
+            detail::BufferAllocator<detail::ParserBuffers> allocator(allocator_);
+            buffers_ = new (allocator.allocate(1)) detail::ParserBuffers(allocator_);
+        }
+        return *buffers_;
+    }
 
-                if (!IsNext('\\'))
-                    return false;
-                if (!IsNext('u'))
-                    return false;
+#ifndef CYOJSON_NO_THREADS
+    inline detail::WorkerPool& Parser::getWorkers()
+    {
+        if (!workers_)
+        {
+            detail::BufferAllocator<detail::WorkerPool> allocator(allocator_);
+            workers_ = new (allocator.allocate(1)) detail::WorkerPool(allocator_);
+        }
+        return *workers_;
+    }
+#endif
 
-                std::uint16_t lowSurrogate;
-                if (!ParseUnicodeChar(lowSurrogate))
-                    return false;
+    inline bool Parser::Parse(const char* json, Callbacks& callbacks)
+    {
+        return ParseWith(json, nullptr, callbacks);
+    }
+
+    inline bool Parser::Parse(const char* json, std::size_t length, Callbacks& callbacks)
+    {
+        return ParseWith(json, json + length, callbacks);
+    }
+
+    template <typename Handler>
+    inline bool Parser::ParseWith(const char* json, const char* end, Handler& handler)
+    {
+        statistics_ = Statistics();
+        stopped_ = false;
+        if (!json)
+            return false;
 
-                assert(0xDC00 <= lowSurrogate && lowSurrogate <= 0xDFFF);
+        detail::StatisticsTimer timer(statistics_);
+        Statistics* const stats = (detail::c_statistics ? &statistics_ : nullptr);
+        detail::PathFilter filter(subscriptions_, skipMode_);
+        bool indexed = false; //the structural index of the text is already built
 
-                OutputUTF8(out, highSurrogate, lowSurrogate);
-                return true;
+#ifndef CYOJSON_NO_THREADS
+        // Parse the largest array on several threads, if it's large enough...
+        unsigned threads = (threads_ != 0 ? threads_ : std::thread::hardware_concurrency());
+        if (threads > 1)
+        {
+            std::size_t length = (end ? (std::size_t)(end - json) : std::strlen(json));
+            detail::BulkArray bulk(filter, pathTable_, utf8Mode_, getBuffers());
+            if (bulk.Find(json, length))
+            {
+                bulk.Start(getWorkers(), threads);
+                detail::ParserImpl<Handler> impl(json, json + length, handler, filter, pathTable_, getBuffers());
+                impl.setBulkArray(&bulk);
+                impl.setStatistics(stats);
+                impl.setUTF8Mode(utf8Mode_);
+                const bool success = impl.Parse(line_, column_);
+                stopped_ = impl.IsStopped();
+                return success;
             }
+            indexed = bulk.IsIndexed();
+        }
+#endif
 
-            bool ParseUnicodeChar(std::uint16_t& value)
+        if (engine_ == Engine::StructuralIndex)
+        {
+            std::size_t length = (end ? (std::size_t)(end - json) : std::strlen(json));
+            if (length <= UINT32_MAX)
             {
-                value = 0;
-                for (int i = 0; i < 4; ++i)
-                {
-                    std::uint16_t curr;
-                    if ('a' <= *next_ && *next_ <= 'z')
-                        curr = ((*next_ - 'a') + 10);
-                    else if ('A' <= *next_ && *next_ <= 'Z')
-                        curr = ((*next_ - 'A') + 10);
-                    else if ('0' <= *next_ && *next_ <= '9')
-                        curr = (*next_ - '0');
-                    else
-                        return false;
-                    value <<= 4;
-                    value |= curr;
-                    NextChar();
-                }
-                return true;
+                detail::StructuralParserImpl<Handler> impl(json, length, handler, filter, pathTable_, getBuffers());
+                impl.setIndexed(indexed);
+                impl.setStatistics(stats);
+                impl.setUTF8Mode(utf8Mode_);
+                const bool success = impl.Parse(line_, column_);
+                stopped_ = impl.IsStopped();
+                return success;
             }
-        };
+        }
+
+        detail::ParserImpl<Handler> impl(json, end, handler, filter, pathTable_, getBuffers());
+        impl.setStatistics(stats);
+        impl.setUTF8Mode(utf8Mode_);
+        const bool success = impl.Parse(line_, column_);
+        stopped_ = impl.IsStopped();
+        return success;
     }
 
-    inline bool Parser::Parse(const char* json, Callbacks& callbacks)
+#ifndef CYOJSON_NO_THREADS
+    inline void detail::BulkArray::ParseChunk(Chunk& chunk)
     {
-        if (!json)
-            return false;
-
-        detail::ParserImpl impl(json, callbacks);
-        return impl.Parse(line_, column_);
+        chunk.recorder.Clear();
+        chunk.statistics = Parser::Statistics();
+        ParserImpl<EventRecorder> impl(chunk.begin, chunk.end, chunk.recorder, filter_, &chunk.recorder.getPathTable(), chunk.buffers);
+        impl.setStatistics(&chunk.statistics);
+        impl.setUTF8Mode(utf8Mode_);
+        impl.TrackPosition(chunk.recorder);
+        chunk.success = impl.ParseSlice(found_.keys, match_, chunk.line, chunk.column);
+        chunk.recorder.TrackPosition(nullptr, nullptr, nullptr); //impl's position is about to go
     }
+#endif
 }
@@ -0,0 +1,236 @@
+/*
+[CyoJSON] detail/path.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_PATH_HPP
+#define __CYOJSON_DETAIL_PATH_HPP
+
+#include "buffers.hpp"
+#include "statistics.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // The path of the current value, either as a colon-joined string with
+        // a stack of the offsets at which each component was appended (both
+        // kept in the buffers), or as an id in a PathTable (which holds the
+        // strings).
+        class PathStack
+        {
+        public:
+            // If not enabled, the path is always empty.
+            PathStack(PathTable* table, ParserBuffers& buffers, bool enabled = true)
+                : enabled_(enabled),
+                path_(buffers.path),
+                offsets_(buffers.offsets)
+            {
+                Reset(table);
+            }
+
+            PathStack(const PathStack&) = delete;
+
+            void operator=(const PathStack&) = delete;
+
+            void Reset(PathTable* table)
+            {
+                table_ = table;
+                id_ = PathTable::c_rootId;
+                path_.clear();
+                offsets_.clear();
+            }
+
+            // Returns to the root, keeping the table.
+            void Clear() { Reset(table_); }
+
+            // Counts the growth of the path (only used if c_statistics).
+            void setStatistics(Parser::Statistics* stats) { stats_ = stats; }
+
+            bool HasTable() const { return (table_ != nullptr); }
+            bool IsEnabled() const { return (enabled_ || table_); }
+            PathTable::Id getId() const { return id_; }
+
+            const char* c_str() const
+            {
+                return (table_ ? table_->getPath(id_) : path_.c_str());
+            }
+
+            std::size_t size() const
+            {
+                return (table_ ? table_->getPathLength(id_) : path_.size());
+            }
+
+            void Push(const char* key, std::size_t length)
+            {
+                if (table_)
+                {
+                    id_ = table_->Intern(id_, key, length);
+                    return;
+                }
+
+                if (!enabled_)
+                    return;
+                const std::size_t capacity = path_.capacity();
+                const std::size_t offsetsCapacity = offsets_.capacity();
+                const bool nested = !offsets_.empty(); //even if the path is empty, as for PathTable
+                offsets_.push_back(path_.size());
+                if (nested)
+                    path_ += ':';
+                path_.append(key, length);
+
+                if (c_statistics && stats_ && (path_.capacity() != capacity || offsets_.capacity() != offsetsCapacity))
+                {
+                    ++stats_->pathGrowths;
+                    ++stats_->allocations;
+                }
+            }
+
+            void Pop()
+            {
+                if (table_)
+                {
+                    id_ = table_->getParent(id_);
+                    return;
+                }
+
+                if (!enabled_)
+                    return;
+                path_.resize(offsets_.back());
+                offsets_.pop_back();
+            }
+
+        private:
+            const bool enabled_;
+            PathTable* table_;
+            PathTable::Id id_;
+            BufferString& path_;
+            BufferVector<std::size_t>& offsets_;
+            Parser::Statistics* stats_ = nullptr;
+        };
+    }
+
+    inline PathTable::PathTable()
+    {
+        Clear();
+    }
+
+    inline PathTable::Id PathTable::Intern(Id parent, const char* key, std::size_t length)
+    {
+        const Id c_empty = (Id)-1;
+
+        std::size_t mask = slots_.size() - 1;
+        std::size_t slot = Hash(parent, key, length) & mask;
+        for (;; slot = (slot + 1) & mask)
+        {
+            Id id = slots_[slot];
+            if (id == c_empty)
+                break;
+            const Entry& entry = entries_[id];
+            if (entry.parent == parent && entry.path.size() - entry.keyOffset == length
+                && std::memcmp(entry.path.data() + entry.keyOffset, key, length) == 0)
+                return id;
+        }
+
+        Entry entry;
+        entry.parent = parent;
+        entry.path = entries_[parent].path;
+        if (parent != c_rootId)
+            entry.path += ':';
+        entry.keyOffset = entry.path.size();
+        entry.path.append(key, length);
+
+        Id id = (Id)entries_.size();
+        entries_.push_back(std::move(entry));
+        slots_[slot] = id;
+        if (entries_.size() * 2 > slots_.size())
+            Grow();
+        return id;
+    }
+
+    inline PathTable::Id PathTable::Intern(const char* path)
+    {
+        Id id = c_rootId;
+        if (*path == '\0')
+            return id;
+        for (;;)
+        {
+            const char* colon = std::strchr(path, ':');
+            std::size_t length = (colon ? (std::size_t)(colon - path) : std::strlen(path));
+            id = Intern(id, path, length);
+            if (!colon)
+                return id;
+            path = colon + 1;
+        }
+    }
+
+    inline void PathTable::Clear()
+    {
+        entries_.clear();
+        slots_.assign(64, (Id)-1);
+
+        Entry root;
+        root.parent = c_rootId;
+        root.keyOffset = 0;
+        entries_.push_back(std::move(root));
+    }
+
+    inline std::size_t PathTable::Hash(Id parent, const char* key, std::size_t length)
+    {
+        //FNV-1a
+        std::uint64_t hash = 0xCBF29CE484222325ull ^ parent;
+        for (std::size_t i = 0; i < length; ++i)
+            hash = (hash ^ (unsigned char)key[i]) * 0x100000001B3ull;
+        return (std::size_t)(hash ^ (hash >> 32));
+    }
+
+    inline void PathTable::Grow()
+    {
+        slots_.assign(slots_.size() * 2, (Id)-1);
+        std::size_t mask = slots_.size() - 1;
+        for (Id id = 1; id < (Id)entries_.size(); ++id)
+        {
+            const Entry& entry = entries_[id];
+            std::size_t slot = Hash(entry.parent, entry.path.data() + entry.keyOffset, entry.path.size() - entry.keyOffset) & mask;
+            while (slots_[slot] != (Id)-1)
+                slot = (slot + 1) & mask;
+            slots_[slot] = id;
+        }
+    }
+}
+
+#endif //__CYOJSON_DETAIL_PATH_HPP
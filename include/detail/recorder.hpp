@@ -0,0 +1,497 @@
+/*
+[CyoJSON] detail/recorder.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_RECORDER_HPP
+#define __CYOJSON_DETAIL_RECORDER_HPP
+
+#include "events.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        enum class EventOp : char
+        {
+            Path,
+            ObjectStart,
+            ObjectEnd,
+            ArrayStart,
+            ArrayEnd,
+            Key,
+            String,
+            Int64,
+            UInt64,
+            Double,
+            True,
+            False,
+            Null,
+            RecordStart,
+            RecordEnd,
+            RecordError
+        };
+
+        template <typename T>
+        inline T GetEventValue(const char*& next)
+        {
+            T value;
+            std::memcpy(&value, next, sizeof(value));
+            next += sizeof(value);
+            return value;
+        }
+
+        inline std::uint32_t GetEventString(const char*& next, const char*& str)
+        {
+            std::uint32_t length = GetEventValue<std::uint32_t>(next);
+            str = next;
+            next += length;
+            return length;
+        }
+
+        // The id in table of a path in source (where it was recorded), which
+        // ids caches (with -1 for those not yet interned).
+        inline PathTable::Id MapPathId(PathTable::Id id, const PathTable& source, std::vector<PathTable::Id>& ids, PathTable& table)
+        {
+            if (ids[id] == (PathTable::Id)-1)
+                ids[id] = table.Intern(MapPathId(source.getParent(id), source, ids, table), source.getKey(id), source.getKeyLength(id));
+            return ids[id];
+        }
+
+        // Passes over the data of a recorded event, after its op.
+        inline void SkipEventData(const char*& next, EventOp op)
+        {
+            const char* str;
+            switch (op)
+            {
+            case EventOp::Key:
+            case EventOp::String:
+                GetEventString(next, str);
+                break;
+
+            case EventOp::Int64:
+            case EventOp::UInt64:
+            case EventOp::Double:
+                next += sizeof(std::uint64_t);
+                GetEventString(next, str);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        // Invokes the events recorded from next to end on the handler, with
+        // the paths interned in the given table (if any), or without paths if
+        // not usesPaths. Source is the table of the recorded path ids, and ids
+        // is scratch space. Records receives the RecordStart, RecordEnd and
+        // RecordError calls. The handler's actions are taken as by the parser:
+        // the events of a skipped value are passed over, by matching starts
+        // and ends, and false is returned (at once) if it asks to stop, with
+        // stoppedAt (if given) set to the index of that event (counting every
+        // recorded event, skipped or not).
+        template <typename Handler, typename Records>
+        inline bool ReplayEvents(const char* next, const char* end, const PathTable& source, std::vector<PathTable::Id>& ids,
+            Events<Handler>& events, Records& records, PathTable* table, bool usesPaths, std::size_t* stoppedAt = nullptr)
+        {
+            if (table)
+            {
+                ids.assign(source.getCount(), (PathTable::Id)-1);
+                ids[PathTable::c_rootId] = PathTable::c_rootId;
+            }
+
+            const char* path = source.getPath(PathTable::c_rootId);
+            events.SetPathId(PathTable::c_rootId);
+            auto setPath = [&](PathTable::Id id)
+            {
+                if (table)
+                {
+                    PathTable::Id global = MapPathId(id, source, ids, *table);
+                    path = table->getPath(global);
+                    events.SetPathId(global);
+                }
+                else
+                {
+                    path = source.getPath(id);
+                }
+            };
+
+            // While skipping, the nesting of the events passed over, whether
+            // the end that closes them is delivered (it isn't for the value
+            // of a key), and the last path among them...
+            int skipDepth = 0;
+            bool skipValue = false; //the next value, after a key
+            bool skipEnd = false;
+            PathTable::Id skippedId = PathTable::c_rootId;
+            bool skippedPath = false;
+
+            std::size_t count = 0; //of the events so far
+            while (next != end)
+            {
+                const EventOp op = (EventOp)*next++;
+                if (op != EventOp::Path)
+                    ++count;
+                if (skipDepth != 0 || skipValue)
+                {
+                    if (op == EventOp::Path)
+                    {
+                        skippedId = GetEventValue<PathTable::Id>(next);
+                        skippedPath = usesPaths;
+                        continue;
+                    }
+
+                    bool deliver = true;
+                    switch (op)
+                    {
+                    case EventOp::ObjectStart:
+                    case EventOp::ArrayStart:
+                        if (skipValue)
+                        {
+                            skipValue = false;
+                            skipEnd = false;
+                        }
+                        ++skipDepth;
+                        continue;
+
+                    case EventOp::ObjectEnd:
+                    case EventOp::ArrayEnd:
+                        deliver = (--skipDepth == 0 && skipEnd);
+                        break;
+
+                    case EventOp::RecordStart:
+                    case EventOp::RecordEnd:
+                    case EventOp::RecordError:
+                        skipDepth = 0; //an invalid record can end within a skip
+                        skipValue = false;
+                        break;
+
+                    default:
+                        SkipEventData(next, op);
+                        skipValue = false;
+                        deliver = false;
+                        break;
+                    }
+                    if (skipDepth != 0)
+                        continue;
+
+                    if (skippedPath)
+                    {
+                        setPath(skippedId);
+                        skippedPath = false;
+                    }
+                    if (!deliver)
+                        continue;
+                }
+
+                Parser::Action action = Parser::Action::Continue;
+                const char* str;
+                std::uint32_t length;
+                switch (op)
+                {
+                case EventOp::Path:
+                {
+                    PathTable::Id id = GetEventValue<PathTable::Id>(next);
+                    if (usesPaths)
+                        setPath(id);
+                    break;
+                }
+
+                case EventOp::ObjectStart:
+                    action = events.ObjectStart(path);
+                    break;
+
+                case EventOp::ObjectEnd:
+                    action = events.ObjectEnd(path);
+                    break;
+
+                case EventOp::ArrayStart:
+                    action = events.ArrayStart(path);
+                    break;
+
+                case EventOp::ArrayEnd:
+                    action = events.ArrayEnd(path);
+                    break;
+
+                case EventOp::Key:
+                    length = GetEventString(next, str);
+                    action = events.Key(path, str, length);
+                    break;
+
+                case EventOp::String:
+                    length = GetEventString(next, str);
+                    action = events.String(path, str, length);
+                    break;
+
+                case EventOp::Int64:
+                {
+                    NumberValue value;
+                    value.type = NumberValue::Type::Int64;
+                    value.int64 = GetEventValue<std::int64_t>(next);
+                    length = GetEventString(next, str);
+                    action = events.Number(path, value, str, length);
+                    break;
+                }
+
+                case EventOp::UInt64:
+                {
+                    NumberValue value;
+                    value.type = NumberValue::Type::UInt64;
+                    value.uint64 = GetEventValue<std::uint64_t>(next);
+                    length = GetEventString(next, str);
+                    action = events.Number(path, value, str, length);
+                    break;
+                }
+
+                case EventOp::Double:
+                {
+                    NumberValue value;
+                    value.type = NumberValue::Type::Double;
+                    value.dbl = GetEventValue<double>(next);
+                    length = GetEventString(next, str);
+                    action = events.Number(path, value, str, length);
+                    break;
+                }
+
+                case EventOp::True:
+                    action = events.Literal(path, "true");
+                    break;
+
+                case EventOp::False:
+                    action = events.Literal(path, "false");
+                    break;
+
+                case EventOp::Null:
+                    action = events.Literal(path, "null");
+                    break;
+
+                case EventOp::RecordStart:
+                    records.RecordStart((std::size_t)GetEventValue<std::uint64_t>(next));
+                    break;
+
+                case EventOp::RecordEnd:
+                    records.RecordEnd((std::size_t)GetEventValue<std::uint64_t>(next));
+                    break;
+
+                case EventOp::RecordError:
+                {
+                    std::size_t offset = (std::size_t)GetEventValue<std::uint64_t>(next);
+                    int line = GetEventValue<std::int32_t>(next);
+                    int column = GetEventValue<std::int32_t>(next);
+                    records.RecordError(offset, line, column);
+                    break;
+                }
+                }
+
+                if (action == Parser::Action::Stop)
+                {
+                    if (stoppedAt)
+                        *stoppedAt = count - 1;
+                    return false;
+                }
+                if (action == Parser::Action::Skip)
+                {
+                    if (op == EventOp::ObjectStart || op == EventOp::ArrayStart)
+                    {
+                        skipDepth = 1;
+                        skipEnd = true;
+                    }
+                    else if (op == EventOp::Key)
+                    {
+                        skipValue = true;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // A handler that records the events of a chunk of the input, so they
+        // can be delivered later by another thread. Paths are interned in the
+        // chunk's own table, and recorded whenever they change.
+        class EventRecorder final
+        {
+        public:
+            EventRecorder() = default;
+            EventRecorder(const EventRecorder&) = delete;
+            void operator=(const EventRecorder&) = delete;
+
+            // Where the parser was at an event, as it reports when stopped.
+            struct Position
+            {
+                const char* next;
+                int line;
+                int column;
+            };
+
+            void Clear()
+            {
+                events_.clear();
+                positions_.clear();
+                table_.Clear();
+                pathId_ = PathTable::c_rootId;
+                recordedId_ = PathTable::c_rootId;
+            }
+
+            PathTable& getPathTable() { return table_; }
+
+            // Records the position of each event from then on, as given by
+            // the parser's current char, line and column.
+            void TrackPosition(const char* const* next, const int* line, const int* column)
+            {
+                trackNext_ = next;
+                trackLine_ = line;
+                trackColumn_ = column;
+            }
+
+            // Of the event with the given index, if tracked (see Replay).
+            const Position& getPosition(std::size_t index) const { return positions_[index]; }
+
+            void setPathId(PathTable::Id id) { pathId_ = id; }
+
+            void ObjectStart(const char*) { Put(EventOp::ObjectStart); }
+            void ObjectEnd(const char*) { Put(EventOp::ObjectEnd); }
+            void ArrayStart(const char*) { Put(EventOp::ArrayStart); }
+            void ArrayEnd(const char*) { Put(EventOp::ArrayEnd); }
+
+            void Key(const char*, const char* key, std::size_t length)
+            {
+                Put(EventOp::Key);
+                PutString(key, length);
+            }
+
+            void String(const char*, const char* value, std::size_t length)
+            {
+                Put(EventOp::String);
+                PutString(value, length);
+            }
+
+            void Int64(const char*, std::int64_t value, const char* text, std::size_t length)
+            {
+                Put(EventOp::Int64);
+                PutValue(value);
+                PutString(text, length);
+            }
+
+            void UInt64(const char*, std::uint64_t value, const char* text, std::size_t length)
+            {
+                Put(EventOp::UInt64);
+                PutValue(value);
+                PutString(text, length);
+            }
+
+            void Double(const char*, double value, const char* text, std::size_t length)
+            {
+                Put(EventOp::Double);
+                PutValue(value);
+                PutString(text, length);
+            }
+
+            void Bool(const char*, bool value) { Put(value ? EventOp::True : EventOp::False); }
+            void Null(const char*) { Put(EventOp::Null); }
+
+            void RecordStart(std::size_t offset)
+            {
+                Put(EventOp::RecordStart);
+                PutValue((std::uint64_t)offset);
+            }
+
+            void RecordEnd(std::size_t offset)
+            {
+                Put(EventOp::RecordEnd);
+                PutValue((std::uint64_t)offset);
+            }
+
+            void RecordError(std::size_t offset, int line, int column)
+            {
+                Put(EventOp::RecordError);
+                PutValue((std::uint64_t)offset);
+                PutValue((std::int32_t)line);
+                PutValue((std::int32_t)column);
+            }
+
+            const std::vector<char>& getEvents() const { return events_; }
+
+            // Invokes the events on the handler, with the paths interned in
+            // the given table (if any), or without paths if not usesPaths.
+            // Records receives the RecordStart, RecordEnd and RecordError
+            // calls. Returns false if the handler asked to stop, with
+            // stoppedAt (if given) set to the index of that event.
+            template <typename Handler, typename Records>
+            bool Replay(Events<Handler>& events, Records& records, PathTable* table, bool usesPaths, std::size_t* stoppedAt = nullptr)
+            {
+                return ReplayEvents(events_.data(), events_.data() + events_.size(), table_, ids_, events, records, table, usesPaths, stoppedAt);
+            }
+
+        private:
+            std::vector<char> events_;
+            PathTable table_;
+            PathTable::Id pathId_ = PathTable::c_rootId;
+            PathTable::Id recordedId_ = PathTable::c_rootId;
+            std::vector<PathTable::Id> ids_; //the id in the replay table of each of ours
+            std::vector<Position> positions_; //of each event, if tracked
+            const char* const* trackNext_ = nullptr;
+            const int* trackLine_ = nullptr;
+            const int* trackColumn_ = nullptr;
+
+            void Put(EventOp op)
+            {
+                if (trackNext_)
+                    positions_.push_back({ *trackNext_, *trackLine_, *trackColumn_ });
+                if (pathId_ != recordedId_)
+                {
+                    events_.push_back((char)EventOp::Path);
+                    PutValue(pathId_);
+                    recordedId_ = pathId_;
+                }
+                events_.push_back((char)op);
+            }
+
+            template <typename T>
+            void PutValue(T value)
+            {
+                std::size_t size = events_.size();
+                events_.resize(size + sizeof(value));
+                std::memcpy(&events_[size], &value, sizeof(value));
+            }
+
+            void PutString(const char* str, std::size_t length)
+            {
+                PutValue((std::uint32_t)length);
+                events_.insert(events_.end(), str, str + length);
+            }
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_RECORDER_HPP
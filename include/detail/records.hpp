@@ -0,0 +1,305 @@
+/*
+[CyoJSON] detail/records.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_RECORDS_HPP
+#define __CYOJSON_DETAIL_RECORDS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifndef CYOJSON_NO_THREADS
+#   include <thread>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        inline bool IsBlankLine(const char* next, const char* end)
+        {
+            for (; next != end; ++next)
+            {
+                if (*next != ' ' && *next != '\t' && *next != '\r')
+                    return false;
+            }
+            return true;
+        }
+
+        // Parses each line from begin to end as a record, where offset is that
+        // of begin. Records receives the RecordStart, RecordEnd and RecordError
+        // calls, and is either the callbacks or an EventRecorder. If the
+        // handler asks to stop, the rest are left (as is the end of that
+        // record), and impl.IsStopped() returns true.
+        template <typename Handler, typename Records>
+        inline bool ParseRecordLines(ParserImpl<Handler>& impl, Records& records, const char* begin, const char* end, std::size_t offset)
+        {
+            bool success = true;
+            const char* next = begin;
+            while (next != end)
+            {
+                const char* lineEnd = (const char*)std::memchr(next, '\n', (std::size_t)(end - next));
+                if (!lineEnd)
+                    lineEnd = end;
+
+                if (!IsBlankLine(next, lineEnd))
+                {
+                    const std::size_t recordOffset = offset + (std::size_t)(next - begin);
+                    impl.Reset(next, lineEnd);
+                    records.RecordStart(recordOffset);
+                    int line, column;
+                    if (impl.Parse(line, column))
+                    {
+                        if (impl.IsStopped())
+                            break;
+                        records.RecordEnd(recordOffset);
+                    }
+                    else
+                    {
+                        records.RecordError(recordOffset, line, column);
+                        success = false;
+                    }
+                }
+
+                next = (lineEnd == end ? end : lineEnd + 1);
+            }
+            return success;
+        }
+
+#ifndef CYOJSON_NO_THREADS
+
+        // Parses records on a number of threads, a chunk of records at a time,
+        // while the calling thread delivers the recorded events.
+        class RecordWorkers final : public ChunkWorkers
+        {
+        public:
+            RecordWorkers(const char* begin, const char* end, std::size_t offset, const PathFilter& filter, Parser::Delivery delivery, Parser::UTF8Mode utf8Mode)
+                : ChunkWorkers(delivery == Parser::Delivery::Ordered),
+                begin_(begin),
+                next_(begin),
+                end_(end),
+                offset_(offset),
+                filter_(filter),
+                utf8Mode_(utf8Mode)
+            {
+            }
+
+            ~RecordWorkers()
+            {
+                Stop();
+            }
+
+            // Adds the statistics of each chunk to stats (if c_statistics).
+            // If the handler asks to stop, the rest of the chunks are left,
+            // and IsStopped() returns true.
+            bool Run(WorkerPool& pool, unsigned threads, Parser::RecordCallbacks& callbacks, PathTable* table, Parser::Statistics* stats)
+            {
+                Start(pool, threads);
+
+                Events<Parser::Callbacks> events(callbacks);
+                ErrorTracker records(callbacks);
+                while (Chunk* chunk = NextParsed())
+                {
+                    stopped_ = !chunk->recorder.Replay(events, records, table, true);
+                    if (c_statistics && stats)
+                    {
+                        AddStatistics(*stats, chunk->statistics, 0);
+                        stats->bytes += chunk->statistics.bytes;
+                    }
+                    Release(chunk);
+                    if (stopped_)
+                        break;
+                }
+                return records.success;
+            }
+
+            bool IsStopped() const { return stopped_; }
+
+        protected:
+            bool Claim(Chunk& chunk) override
+            {
+                if (next_ == end_)
+                    return false;
+
+                chunk.begin = next_;
+                if ((std::size_t)(end_ - next_) <= c_chunkSize)
+                {
+                    chunk.end = end_;
+                }
+                else
+                {
+                    const char* lineEnd = (const char*)std::memchr(next_ + c_chunkSize, '\n', (std::size_t)(end_ - next_ - c_chunkSize));
+                    chunk.end = (lineEnd ? lineEnd + 1 : end_);
+                }
+                next_ = chunk.end;
+                return true;
+            }
+
+            void ParseChunk(Chunk& chunk) override
+            {
+                chunk.recorder.Clear();
+                chunk.statistics = Parser::Statistics();
+                ParserImpl<EventRecorder> impl(chunk.begin, chunk.end, chunk.recorder, filter_, &chunk.recorder.getPathTable(), chunk.buffers);
+                impl.setStatistics(&chunk.statistics);
+                impl.setUTF8Mode(utf8Mode_);
+                chunk.success = ParseRecordLines(impl, chunk.recorder, chunk.begin, chunk.end, offset_ + (std::size_t)(chunk.begin - begin_));
+            }
+
+        private:
+            // Passes on the record calls, noting any errors (as only those
+            // delivered before a stop count).
+            struct ErrorTracker
+            {
+                Parser::RecordCallbacks& callbacks;
+                bool success = true;
+
+                explicit ErrorTracker(Parser::RecordCallbacks& recordCallbacks) : callbacks(recordCallbacks) { }
+
+                void RecordStart(std::size_t offset) { callbacks.RecordStart(offset); }
+                void RecordEnd(std::size_t offset) { callbacks.RecordEnd(offset); }
+
+                void RecordError(std::size_t offset, int line, int column)
+                {
+                    success = false;
+                    callbacks.RecordError(offset, line, column);
+                }
+            };
+
+            const char* const begin_;
+            const char* next_; //the start of the next chunk
+            const char* const end_;
+            const std::size_t offset_;
+            const PathFilter& filter_;
+            const Parser::UTF8Mode utf8Mode_;
+            bool stopped_ = false;
+        };
+
+#endif //CYOJSON_NO_THREADS
+    }
+
+    inline bool Parser::ParseRecords(const char* json, std::size_t length, RecordCallbacks& callbacks)
+    {
+        line_ = 0;
+        column_ = 0;
+        statistics_ = Statistics();
+        stopped_ = false;
+        if (!json)
+            return false;
+        return ParseRecordsAt(json, json + length, 0, callbacks);
+    }
+
+    inline bool Parser::ParseRecordsAt(const char* json, const char* end, std::size_t offset, RecordCallbacks& callbacks)
+    {
+        detail::StatisticsTimer timer(statistics_);
+        Statistics* const stats = (detail::c_statistics ? &statistics_ : nullptr);
+        detail::PathFilter filter(subscriptions_, skipMode_);
+
+#ifndef CYOJSON_NO_THREADS
+        unsigned threads = (threads_ != 0 ? threads_ : std::thread::hardware_concurrency());
+        if (threads > 1 && (std::size_t)(end - json) > detail::c_chunkSize)
+        {
+            detail::RecordWorkers workers(json, end, offset, filter, delivery_, utf8Mode_);
+            const bool success = workers.Run(getWorkers(), threads, callbacks, pathTable_, stats);
+            stopped_ = workers.IsStopped();
+            return success;
+        }
+#endif
+
+        detail::ParserImpl<Callbacks> impl(json, end, callbacks, filter, pathTable_, getBuffers());
+        impl.setStatistics(stats);
+        impl.setUTF8Mode(utf8Mode_);
+        const bool success = detail::ParseRecordLines(impl, callbacks, json, end, offset);
+        stopped_ = impl.IsStopped();
+        return success;
+    }
+
+    inline bool Parser::ParseRecordsFile(const char* filename, RecordCallbacks& callbacks)
+    {
+        line_ = 0;
+        column_ = 0;
+        statistics_ = Statistics();
+        stopped_ = false;
+        if (!filename)
+            return false;
+
+        std::FILE* file = std::fopen(filename, "rb");
+        if (!file)
+            return false;
+
+        detail::MappedFile mapped;
+        if (mapped.Map(file))
+        {
+            const bool result = ParseRecordsAt(mapped.getData(), mapped.getData() + mapped.getSize(), 0, callbacks);
+            std::fclose(file);
+            return result;
+        }
+
+        // Parse the complete lines in the buffer, keeping any partial line for
+        // the next read...
+        std::vector<char> buffer;
+        std::size_t offset = 0;
+        bool success = true;
+        for (;;)
+        {
+            std::size_t size = buffer.size();
+            buffer.resize(size + 16 * 1024 * 1024);
+            size += std::fread(buffer.data() + size, 1, buffer.size() - size, file);
+            buffer.resize(size);
+            if (size == 0)
+                break;
+
+            bool last = (std::feof(file) || std::ferror(file));
+            std::size_t complete = size;
+            if (!last)
+            {
+                while (complete != 0 && buffer[complete - 1] != '\n')
+                    --complete;
+                if (complete == 0)
+                    continue; //a line longer than the buffer
+            }
+
+            success &= ParseRecordsAt(buffer.data(), buffer.data() + complete, offset, callbacks);
+            offset += complete;
+            buffer.erase(buffer.begin(), buffer.begin() + (std::ptrdiff_t)complete);
+            if (last || stopped_)
+                break;
+        }
+        if (std::ferror(file))
+            success = false;
+        std::fclose(file);
+        return success;
+    }
+}
+
+#endif //__CYOJSON_DETAIL_RECORDS_HPP
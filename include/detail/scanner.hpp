@@ -0,0 +1,592 @@
+/*
+[CyoJSON] detail/scanner.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_SCANNER_HPP
+#define __CYOJSON_DETAIL_SCANNER_HPP
+
+#include "buffers.hpp"
+#include "number.hpp"
+#include "simd.hpp"
+#include "statistics.hpp"
+#include "utf8.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Token-level primitives shared by the parse engines: whitespace,
+        // strings, numbers and literals, tracking the line and column.
+        class Scanner
+        {
+        public:
+            Scanner(const Scanner&) = delete;
+
+            void operator=(const Scanner&) = delete;
+
+        protected:
+            const int c_firstLine = 1;
+            const int c_firstColumnOfLine = 1;
+            const char* const c_true = "true";
+            const char* const c_false = "false";
+            const char* const c_null = "null";
+
+            int line_ = c_firstLine;
+            int column_ = c_firstColumnOfLine;
+            const char* next_;
+            const char* end_; //nullptr if the text is null-terminated
+            BufferString& scratch_; //unescaped strings
+            const ScanFunctions& scan_;
+            Parser::Statistics* stats_ = nullptr; //only used if c_statistics
+            std::size_t depth_ = 0;
+            bool checkUTF8_ = false;
+
+            Scanner(const char* next, const char* end, BufferString& scratch)
+                : next_(next),
+                end_(end),
+                scratch_(scratch),
+                scan_(GetScanFunctions())
+            {
+            }
+
+            // Starts again on another text.
+            void Reset(const char* next, const char* end)
+            {
+                line_ = c_firstLine;
+                column_ = c_firstColumnOfLine;
+                next_ = next;
+                end_ = end;
+                depth_ = 0;
+            }
+
+            // Statistics, which compile to nothing unless c_statistics...
+
+            void Count(std::size_t Parser::Statistics::* counter)
+            {
+                if (c_statistics && stats_)
+                    ++(stats_->*counter);
+            }
+
+            void CountNested()
+            {
+                if (c_statistics && stats_ && ++depth_ > stats_->maxDepth)
+                    stats_->maxDepth = depth_;
+            }
+
+            void EndNested()
+            {
+                if (c_statistics && stats_)
+                    --depth_;
+            }
+
+            // The char at next, or '\0' at the end of the text. An embedded
+            // null char in length-bounded text isn't valid anywhere, so also
+            // stops every token, but IsEnd() tells them apart.
+            char CharAt(const char* next) const { return (next != end_ ? *next : '\0'); }
+            char CurrChar() const { return CharAt(next_); }
+
+            bool IsEnd() const { return (end_ ? next_ == end_ : *next_ == '\0'); }
+
+            void NextChar()
+            {
+                ++next_;
+                ++column_;
+            }
+
+            void NextChars(int count)
+            {
+                next_ += count;
+                column_ += count;
+            }
+
+            void NewLine()
+            {
+                column_ = c_firstColumnOfLine;
+                ++line_;
+            }
+
+            void SkipWhitespace()
+            {
+                for (;;)
+                {
+                    switch (CurrChar())
+                    {
+                    case ' ':
+                    case '\t':
+                    {
+                        const char* next = scan_.SkipBlanks(next_ + 1, end_);
+                        column_ += (int)(next - next_);
+                        next_ = next;
+                        continue;
+                    }
+
+                    case '\r':
+                        if (CharAt(next_ + 1) == '\n')
+                            next_ += 2;
+                        else
+                            ++next_;
+                        NewLine();
+                        continue;
+
+                    case '\n':
+                        ++next_;
+                        NewLine();
+                        continue;
+                    }
+
+                    break;
+                }
+            }
+
+            bool IsNext(char ch, bool skipWhitespace = true)
+            {
+                assert(ch != '\0');
+                assert(!IsWhitespace(ch));
+
+                if (skipWhitespace)
+                    SkipWhitespace();
+
+                if (CurrChar() != ch)
+                    return false;
+
+                NextChar();
+                return true;
+            }
+
+            bool IsNext(char ch1, char ch2, bool skipWhitespace = true)
+            {
+                assert(ch1 != '\0' && ch2 != '\0');
+                assert(!IsWhitespace(ch1) && !IsWhitespace(ch2));
+
+                if (skipWhitespace)
+                    SkipWhitespace();
+
+                char next = CurrChar();
+                if (next != ch1 && next != ch2)
+                    return false;
+
+                NextChar();
+                return true;
+            }
+
+            bool IsNext(const char* str, bool skipWhitespace = true)
+            {
+                assert(str && *str);
+
+                if (skipWhitespace)
+                    SkipWhitespace();
+
+                const char* next = next_;
+                const char* nextStr = str;
+                while (*nextStr && *nextStr == CharAt(next))
+                {
+                    ++next;
+                    ++nextStr;
+                }
+                if (*nextStr)
+                    return false;
+
+                NextChars((int)(nextStr - str));
+                return true;
+            }
+
+            // Skips to the next quote, escape or control char (strings can't
+            // contain newlines, so only the column changes).
+            void SkipStringChars()
+            {
+                const char* next = scan_.FindStringSpecial(next_, end_);
+                column_ += (int)(next - next_);
+                next_ = next;
+            }
+
+            // If checkUTF8_, fails at the first char from start to next_ (all
+            // within a string) that isn't valid UTF-8.
+            bool CheckUTF8(const char* start)
+            {
+                if (!checkUTF8_)
+                    return true;
+
+                const char* invalid = scan_.FindInvalidUTF8(start, next_);
+                if (!invalid)
+                    return true;
+                column_ -= (int)(next_ - invalid);
+                next_ = invalid;
+                return false;
+            }
+
+            // On success, str points either into the JSON text or, if the
+            // string contains escapes, to the unescaped copy in scratch_.
+            bool ParseString(const char*& str, std::size_t& length)
+            {
+                if (!IsNext('\"'))
+                    return false;
+
+                const char* const start = next_;
+                SkipStringChars();
+                if (!CheckUTF8(start))
+                    return false;
+                if (CurrChar() == '\"')
+                {
+                    str = start;
+                    length = (std::size_t)(next_ - start);
+                    NextChar();
+                    return true;
+                }
+
+                const std::size_t capacity = scratch_.capacity();
+                scratch_.assign(start, next_ - start);
+
+                for (;;)
+                {
+                    char ch = CurrChar();
+                    if (ch == '\"')
+                        break;
+                    if (ch != '\\')
+                        return false; //control char, or unterminated string
+
+                    NextChar();
+
+                    ch = CurrChar();
+                    if (ch == 'u')
+                    {
+                        if (!ParseUnicode(scratch_))
+                            return false;
+                    }
+                    else
+                    {
+                        const char* const escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+                        const char* escape = (ch != '\0' ? std::strchr(escapes, ch) : nullptr);
+                        if (escape == nullptr || (escape - escapes) % 2 != 0)
+                            return false;
+                        scratch_ += *(escape + 1);
+                        NextChar();
+                    }
+
+                    const char* run = next_;
+                    SkipStringChars();
+                    if (!CheckUTF8(run))
+                        return false;
+                    scratch_.append(run, next_ - run);
+                }
+
+                if (!IsNext('\"'))
+                    return false;
+
+                Count(&Parser::Statistics::unescapedStrings);
+                if (c_statistics && scratch_.capacity() != capacity)
+                    Count(&Parser::Statistics::allocations);
+
+                str = scratch_.data();
+                length = scratch_.size();
+                return true;
+            }
+
+            // Checks the number without converting it.
+            bool ParseNumber(const char*& number, std::size_t& length)
+            {
+                SkipWhitespace();
+
+                const char* const start = next_;
+                if (!SkipNumber())
+                    return false;
+                number = start;
+                length = (std::size_t)(next_ - start);
+                return true;
+            }
+
+            bool ParseNumber(const char*& number, std::size_t& length, NumberValue& value)
+            {
+                SkipWhitespace();
+
+                const char* last;
+                bool ok = ScanNumber(next_, end_, last, value);
+                column_ += (int)(last - next_);
+                number = next_;
+                length = (std::size_t)(last - next_);
+                next_ = last;
+                return ok;
+            }
+
+            bool SkipNumber()
+            {
+                SkipWhitespace();
+
+                const char* next = next_;
+                const bool valid = SkipNumberChars(next);
+                column_ += (int)(next - next_);
+                next_ = next;
+                return valid;
+            }
+
+            // Moves next past the number there, stopping at the first char
+            // that isn't part of it; false if that char makes it invalid.
+            bool SkipNumberChars(const char*& next) const
+            {
+                if (CharAt(next) == '-')
+                    ++next;
+
+                if (CharAt(next) == '0')
+                    ++next;
+                else if (!SkipDigits(next))
+                    return false;
+
+                if (CharAt(next) == '.')
+                {
+                    ++next;
+                    if (!SkipDigits(next))
+                        return false;
+                }
+
+                if (CharAt(next) == 'e' || CharAt(next) == 'E')
+                {
+                    ++next;
+                    if (CharAt(next) == '+' || CharAt(next) == '-')
+                        ++next;
+                    if (!SkipDigits(next))
+                        return false;
+                }
+
+                return true;
+            }
+
+            // Moves next past one or more digits; false if there are none.
+            bool SkipDigits(const char*& next) const
+            {
+                if (!IsDigit(CharAt(next)))
+                    return false;
+                do
+                    ++next;
+                while (IsDigit(CharAt(next)));
+                return true;
+            }
+
+            // Checks the value as if parsing it, failing at the same position,
+            // but without converting numbers or building paths.
+            bool SkipValue()
+            {
+                SkipWhitespace();
+
+                const char* str;
+                std::size_t length;
+
+                switch (CurrChar())
+                {
+                case '{':
+                    NextChar();
+                    if (IsNext('}'))
+                        return true;
+                    do
+                    {
+                        if (!ParseString(str, length) || !IsNext(':') || !SkipValue())
+                            return false;
+                    }
+                    while (IsNext(','));
+                    return IsNext('}');
+
+                case '[':
+                    NextChar();
+                    if (IsNext(']'))
+                        return true;
+                    do
+                    {
+                        if (!SkipValue())
+                            return false;
+                    }
+                    while (IsNext(','));
+                    return IsNext(']');
+
+                case '\"':
+                    return ParseString(str, length);
+
+                case 't':
+                    return IsNext(c_true);
+
+                case 'f':
+                    return IsNext(c_false);
+
+                case 'n':
+                    return IsNext(c_null);
+
+                default:
+                    return SkipNumber();
+                }
+            }
+
+            // For trusted input: skips the value by matching brackets, only
+            // looking inside strings for the closing quote.
+            bool SkipValueUnchecked()
+            {
+                SkipWhitespace();
+
+                const char* const start = next_;
+                int depth = 0;
+                for (;;)
+                {
+                    switch (CurrChar())
+                    {
+                    case '\0':
+                        return false;
+
+                    case '\"':
+                        NextChar();
+                        for (;;)
+                        {
+                            SkipStringChars();
+                            char ch = CurrChar();
+                            if (ch == '\"')
+                                break;
+                            if (ch == '\0')
+                                return false;
+                            if (ch == '\\' && CharAt(next_ + 1) != '\0')
+                                NextChar();
+                            NextChar();
+                        }
+                        NextChar();
+                        if (depth == 0)
+                            return true;
+                        continue;
+
+                    case '{':
+                    case '[':
+                        ++depth;
+                        NextChar();
+                        continue;
+
+                    case '}':
+                    case ']':
+                        if (depth == 0)
+                            break; //end of a number or literal
+                        NextChar();
+                        if (--depth == 0)
+                            return true;
+                        continue;
+
+                    case ',':
+                    case ' ':
+                    case '\t':
+                    case '\r':
+                    case '\n':
+                        if (depth == 0)
+                            break;
+                        if (CurrChar() == ',')
+                            NextChar();
+                        else
+                            SkipWhitespace();
+                        continue;
+
+                    default:
+                        NextChar();
+                        continue;
+                    }
+
+                    return (next_ != start);
+                }
+            }
+
+            // Converts a \u escape (at the u), appending it to out as UTF-8.
+            bool ParseUnicode(BufferString& out)
+            {
+                std::uint16_t value, lowSurrogate;
+                if (!SkipUnicode(value, lowSurrogate))
+                    return false;
+
+                if (lowSurrogate == 0)
+                    OutputUTF8(out, value);
+                else
+                    OutputUTF8(out, value, lowSurrogate);
+                return true;
+            }
+
+            // Checks a \u escape (at the u) without converting it: it must be a
+            // char other than a surrogate, or a high surrogate followed by a
+            // low one (otherwise lowSurrogate is 0). An invalid surrogate is
+            // reported at its last hex digit.
+            bool SkipUnicode(std::uint16_t& value, std::uint16_t& lowSurrogate)
+            {
+                NextChar(); //u
+
+                // Parse first (or only) char...
+
+                if (!ParseUnicodeChar(value))
+                    return false;
+
+                lowSurrogate = 0;
+                if (value < 0xD800 || value >= 0xE000)
+                {
+                    NextChar();
+                    return true;
+                }
+
+                if (value >= 0xDC00)
+                    return false; //invalid high surrogate
+                NextChar();
+
+                // Parse second char...
+
+                if (!IsNext('\\', false) || !IsNext('u', false))
+                    return false;
+
+                if (!ParseUnicodeChar(lowSurrogate))
+                    return false;
+                if (lowSurrogate < 0xDC00 || lowSurrogate >= 0xE000)
+                    return false; //invalid low surrogate
+                NextChar();
+                return true;
+            }
+
+            // Parses the 4 hex digits, leaving the last for the caller to
+            // consume once it's checked the value.
+            bool ParseUnicodeChar(std::uint16_t& value)
+            {
+                value = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (i != 0)
+                        NextChar();
+                    std::uint8_t digit = HexDigit(CurrChar());
+                    if (digit == 0xFF)
+                        return false;
+                    value = (std::uint16_t)((value << 4) | digit);
+                }
+                Count(&Parser::Statistics::unicodeEscapes);
+                return true;
+            }
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_SCANNER_HPP
@@ -0,0 +1,713 @@
+/*
+[CyoJSON] detail/simd.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_SIMD_HPP
+#define __CYOJSON_DETAIL_SIMD_HPP
+
+#include "utf8.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(CYOJSON_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#   define CYOJSON_SIMD_X86
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define CYOJSON_TARGET_AVX2 __attribute__((target("avx2")))
+#   define CYOJSON_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#   define CYOJSON_TARGET_AVX2
+#   define CYOJSON_NO_SANITIZE_ADDRESS
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // JSON only allows these four whitespace chars, unlike std::isspace
+        // (which also depends upon the current locale).
+        inline bool IsWhitespace(char ch)
+        {
+            return (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t');
+        }
+
+        // Chars that end the fast scan of a string: the closing quote, the
+        // start of an escape, or a control char (including the terminator).
+        inline bool IsStringSpecial(char ch)
+        {
+            return (ch == '\"' || ch == '\\' || (unsigned char)ch < 0x20);
+        }
+
+        inline int CountTrailingZeros(std::uint32_t mask)
+        {
+            assert(mask != 0);
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return (int)index;
+#else
+            int count = 0;
+            for (; (mask & 1) == 0; mask >>= 1)
+                ++count;
+            return count;
+#endif
+        }
+
+        inline int CountTrailingZeros64(std::uint64_t mask)
+        {
+            assert(mask != 0);
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(mask);
+#else
+            std::uint32_t low = (std::uint32_t)mask;
+            if (low != 0)
+                return CountTrailingZeros(low);
+            return 32 + CountTrailingZeros((std::uint32_t)(mask >> 32));
+#endif
+        }
+
+        inline int CountLeadingZeros64(std::uint64_t mask)
+        {
+            assert(mask != 0);
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_clzll(mask);
+#else
+            int count = 0;
+            for (std::uint64_t bit = (std::uint64_t)1 << 63; (mask & bit) == 0; bit >>= 1)
+                ++count;
+            return count;
+#endif
+        }
+
+        inline int PopCount64(std::uint64_t mask)
+        {
+#if defined(__POPCNT__)
+            return __builtin_popcountll(mask);
+#else
+            mask = mask - ((mask >> 1) & 0x5555555555555555ull);
+            mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+            mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+            return (int)((mask * 0x0101010101010101ull) >> 56);
+#endif
+        }
+
+        // Classification of a 64-byte block, one bit per char.
+        struct BlockMasks
+        {
+            std::uint64_t quote;        //"
+            std::uint64_t backslash;    //backslash
+            std::uint64_t op;           //{ } [ ] : ,
+            std::uint64_t whitespace;   //space, tab, CR, LF
+            std::uint64_t control;      //0x00 to 0x1F
+            std::uint64_t cr;
+            std::uint64_t lf;
+        };
+
+        // Scanning kernels, selected at runtime according to the CPU:
+        //  - SkipBlanks returns the first char that isn't a space or tab;
+        //  - FindStringSpecial returns the first char that IsStringSpecial;
+        //  - ClassifyBlock classifies the 64 chars at block (which must all be
+        //    readable, but needn't be aligned);
+        //  - FindInvalidUTF8 is as for FindInvalidUTF8Scalar;
+        //  - CompactBlock copies those of the 64 chars at block whose bits are
+        //    set in keep to out, returning the char after them. It may write
+        //    up to 7 more chars after them, but writes 8 chars at a time,
+        //    each no further on than the chars it reads, so out may be the
+        //    block itself, or anywhere before it.
+        // Neither of the first two can advance past end, or if that's nullptr,
+        // the null terminator. The vectorised versions only use aligned loads,
+        // and only check the end once per block, so although they may read
+        // past the end, they never read past the end of its page. Whereas
+        // FindInvalidUTF8 is always given the end, and never reads past it.
+        struct ScanFunctions
+        {
+            const char* (*SkipBlanks)(const char* next, const char* end);
+            const char* (*FindStringSpecial)(const char* next, const char* end);
+            void (*ClassifyBlock)(const char* block, BlockMasks& masks);
+            const char* (*FindInvalidUTF8)(const char* next, const char* end);
+            char* (*CompactBlock)(const char* block, std::uint64_t keep, char* out);
+        };
+
+        inline const char* SkipBlanksScalar(const char* next, const char* end)
+        {
+            while (next != end && (*next == ' ' || *next == '\t'))
+                ++next;
+            return next;
+        }
+
+        inline const char* FindStringSpecialScalar(const char* next, const char* end)
+        {
+            while (next != end && !IsStringSpecial(*next))
+                ++next;
+            return next;
+        }
+
+        // Where a vectorised kernel stops: at the char found in the block, or
+        // at the end if that comes first.
+        inline const char* FoundInBlock(const char* found, const char* end)
+        {
+            return (end && found > end ? end : found);
+        }
+
+        inline void ClassifyBlockScalar(const char* block, BlockMasks& masks)
+        {
+            masks = BlockMasks{ 0, 0, 0, 0, 0, 0, 0 };
+            for (int i = 0; i < 64; ++i)
+            {
+                std::uint64_t bit = (std::uint64_t)1 << i;
+                if ((unsigned char)block[i] < 0x20)
+                    masks.control |= bit;
+                switch (block[i])
+                {
+                case '\"':
+                    masks.quote |= bit;
+                    break;
+
+                case '\\':
+                    masks.backslash |= bit;
+                    break;
+
+                case '{': case '}': case '[': case ']': case ':': case ',':
+                    masks.op |= bit;
+                    break;
+
+                case '\r':
+                    masks.cr |= bit;
+                    masks.whitespace |= bit;
+                    break;
+
+                case '\n':
+                    masks.lf |= bit;
+                    masks.whitespace |= bit;
+                    break;
+
+                case ' ': case '\t':
+                    masks.whitespace |= bit;
+                    break;
+                }
+            }
+        }
+
+        inline char* CompactBlockScalar(const char* block, std::uint64_t keep, char* out)
+        {
+            for (int group = 0; group < 64; group += 8)
+            {
+                char chars[8];
+                std::memcpy(chars, block + group, 8);
+                const unsigned mask = (unsigned)(keep >> group) & 0xFF;
+                if (mask == 0xFF)
+                {
+                    std::memcpy(out, chars, 8);
+                    out += 8;
+                    continue;
+                }
+                for (int i = 0; i < 8; ++i)
+                {
+                    *out = chars[i];
+                    out += (mask >> i) & 1;
+                }
+            }
+            return out;
+        }
+
+#ifdef CYOJSON_SIMD_X86
+
+        CYOJSON_NO_SANITIZE_ADDRESS
+        inline const char* SkipBlanksSSE2(const char* next, const char* end)
+        {
+            if (next == end)
+                return end;
+
+            const __m128i spaces = _mm_set1_epi8(' ');
+            const __m128i tabs = _mm_set1_epi8('\t');
+
+            unsigned offset = (unsigned)((std::uintptr_t)next & 15);
+            const char* block = next - offset;
+            std::uint32_t mask = (0xFFFFu << offset) & 0xFFFFu; //ignore chars before next
+            for (;;)
+            {
+                __m128i chars = _mm_load_si128((const __m128i*)block);
+                __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(chars, spaces), _mm_cmpeq_epi8(chars, tabs));
+                mask &= ~(std::uint32_t)_mm_movemask_epi8(blanks);
+                if (mask != 0)
+                    return FoundInBlock(block + CountTrailingZeros(mask), end);
+                block += 16;
+                if (end && block >= end)
+                    return end;
+                mask = 0xFFFFu;
+            }
+        }
+
+        CYOJSON_NO_SANITIZE_ADDRESS
+        inline const char* FindStringSpecialSSE2(const char* next, const char* end)
+        {
+            if (next == end)
+                return end;
+
+            const __m128i quotes = _mm_set1_epi8('\"');
+            const __m128i backslashes = _mm_set1_epi8('\\');
+            const __m128i maxControl = _mm_set1_epi8(0x1F);
+
+            unsigned offset = (unsigned)((std::uintptr_t)next & 15);
+            const char* block = next - offset;
+            std::uint32_t mask = 0xFFFFu << offset; //ignore chars before next
+            for (;;)
+            {
+                __m128i chars = _mm_load_si128((const __m128i*)block);
+                __m128i special = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chars, quotes), _mm_cmpeq_epi8(chars, backslashes)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(chars, maxControl), chars));
+                mask &= (std::uint32_t)_mm_movemask_epi8(special);
+                if (mask != 0)
+                    return FoundInBlock(block + CountTrailingZeros(mask), end);
+                block += 16;
+                if (end && block >= end)
+                    return end;
+                mask = 0xFFFFu;
+            }
+        }
+
+        CYOJSON_TARGET_AVX2 CYOJSON_NO_SANITIZE_ADDRESS
+        inline const char* SkipBlanksAVX2(const char* next, const char* end)
+        {
+            if (next == end)
+                return end;
+
+            const __m256i spaces = _mm256_set1_epi8(' ');
+            const __m256i tabs = _mm256_set1_epi8('\t');
+
+            unsigned offset = (unsigned)((std::uintptr_t)next & 31);
+            const char* block = next - offset;
+            std::uint32_t mask = 0xFFFFFFFFu << offset; //ignore chars before next
+            for (;;)
+            {
+                __m256i chars = _mm256_load_si256((const __m256i*)block);
+                __m256i blanks = _mm256_or_si256(_mm256_cmpeq_epi8(chars, spaces), _mm256_cmpeq_epi8(chars, tabs));
+                mask &= ~(std::uint32_t)_mm256_movemask_epi8(blanks);
+                if (mask != 0)
+                    return FoundInBlock(block + CountTrailingZeros(mask), end);
+                block += 32;
+                if (end && block >= end)
+                    return end;
+                mask = 0xFFFFFFFFu;
+            }
+        }
+
+        CYOJSON_TARGET_AVX2 CYOJSON_NO_SANITIZE_ADDRESS
+        inline const char* FindStringSpecialAVX2(const char* next, const char* end)
+        {
+            if (next == end)
+                return end;
+
+            const __m256i quotes = _mm256_set1_epi8('\"');
+            const __m256i backslashes = _mm256_set1_epi8('\\');
+            const __m256i maxControl = _mm256_set1_epi8(0x1F);
+
+            unsigned offset = (unsigned)((std::uintptr_t)next & 31);
+            const char* block = next - offset;
+            std::uint32_t mask = 0xFFFFFFFFu << offset; //ignore chars before next
+            for (;;)
+            {
+                __m256i chars = _mm256_load_si256((const __m256i*)block);
+                __m256i special = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chars, quotes), _mm256_cmpeq_epi8(chars, backslashes)),
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(chars, maxControl), chars));
+                mask &= (std::uint32_t)_mm256_movemask_epi8(special);
+                if (mask != 0)
+                    return FoundInBlock(block + CountTrailingZeros(mask), end);
+                block += 32;
+                if (end && block >= end)
+                    return end;
+                mask = 0xFFFFFFFFu;
+            }
+        }
+
+        inline void ClassifyBlockSSE2(const char* block, BlockMasks& masks)
+        {
+            // '[' and ']' only differ from '{' and '}' by 0x20.
+            const __m128i quotes = _mm_set1_epi8('\"');
+            const __m128i backslashes = _mm_set1_epi8('\\');
+            const __m128i openBraces = _mm_set1_epi8('{');
+            const __m128i closeBraces = _mm_set1_epi8('}');
+            const __m128i colons = _mm_set1_epi8(':');
+            const __m128i commas = _mm_set1_epi8(',');
+            const __m128i spaces = _mm_set1_epi8(' ');
+            const __m128i tabs = _mm_set1_epi8('\t');
+            const __m128i crs = _mm_set1_epi8('\r');
+            const __m128i lfs = _mm_set1_epi8('\n');
+            const __m128i maxControl = _mm_set1_epi8(0x1F);
+            const __m128i bit5 = _mm_set1_epi8(0x20);
+
+            masks = BlockMasks{ 0, 0, 0, 0, 0, 0, 0 };
+            for (int i = 0; i < 4; ++i)
+            {
+                __m128i chars = _mm_loadu_si128((const __m128i*)(block + (16 * i)));
+                __m128i lower = _mm_or_si128(chars, bit5);
+                __m128i cr = _mm_cmpeq_epi8(chars, crs);
+                __m128i lf = _mm_cmpeq_epi8(chars, lfs);
+                __m128i op = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(lower, openBraces), _mm_cmpeq_epi8(lower, closeBraces)),
+                    _mm_or_si128(_mm_cmpeq_epi8(chars, colons), _mm_cmpeq_epi8(chars, commas)));
+                __m128i whitespace = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chars, spaces), _mm_cmpeq_epi8(chars, tabs)),
+                    _mm_or_si128(cr, lf));
+
+                int shift = 16 * i;
+                masks.quote |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, quotes)) << shift;
+                masks.backslash |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, backslashes)) << shift;
+                masks.op |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(op) << shift;
+                masks.whitespace |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(whitespace) << shift;
+                masks.control |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(chars, maxControl), chars)) << shift;
+                masks.cr |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(cr) << shift;
+                masks.lf |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(lf) << shift;
+            }
+        }
+
+        CYOJSON_TARGET_AVX2
+        inline void ClassifyBlockAVX2(const char* block, BlockMasks& masks)
+        {
+            const __m256i quotes = _mm256_set1_epi8('\"');
+            const __m256i backslashes = _mm256_set1_epi8('\\');
+            const __m256i openBraces = _mm256_set1_epi8('{');
+            const __m256i closeBraces = _mm256_set1_epi8('}');
+            const __m256i colons = _mm256_set1_epi8(':');
+            const __m256i commas = _mm256_set1_epi8(',');
+            const __m256i spaces = _mm256_set1_epi8(' ');
+            const __m256i tabs = _mm256_set1_epi8('\t');
+            const __m256i crs = _mm256_set1_epi8('\r');
+            const __m256i lfs = _mm256_set1_epi8('\n');
+            const __m256i maxControl = _mm256_set1_epi8(0x1F);
+            const __m256i bit5 = _mm256_set1_epi8(0x20);
+
+            masks = BlockMasks{ 0, 0, 0, 0, 0, 0, 0 };
+            for (int i = 0; i < 2; ++i)
+            {
+                __m256i chars = _mm256_loadu_si256((const __m256i*)(block + (32 * i)));
+                __m256i lower = _mm256_or_si256(chars, bit5);
+                __m256i cr = _mm256_cmpeq_epi8(chars, crs);
+                __m256i lf = _mm256_cmpeq_epi8(chars, lfs);
+                __m256i op = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(lower, openBraces), _mm256_cmpeq_epi8(lower, closeBraces)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chars, colons), _mm256_cmpeq_epi8(chars, commas)));
+                __m256i whitespace = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chars, spaces), _mm256_cmpeq_epi8(chars, tabs)),
+                    _mm256_or_si256(cr, lf));
+
+                int shift = 32 * i;
+                masks.quote |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, quotes)) << shift;
+                masks.backslash |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, backslashes)) << shift;
+                masks.op |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(op) << shift;
+                masks.whitespace |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(whitespace) << shift;
+                masks.control |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(chars, maxControl), chars)) << shift;
+                masks.cr |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(cr) << shift;
+                masks.lf |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(lf) << shift;
+            }
+        }
+
+        // For each mask of 8 chars, the shuffle that gathers those to keep at
+        // the start (the others being zeroed), and how many there are.
+        struct CompactShuffles
+        {
+            std::uint64_t shuffles[256];
+            std::uint8_t counts[256];
+        };
+
+        inline CompactShuffles BuildCompactShuffles()
+        {
+            CompactShuffles table;
+            for (unsigned mask = 0; mask < 256; ++mask)
+            {
+                std::uint64_t shuffle = ~(std::uint64_t)0; //0x80 and above zero
+                unsigned count = 0;
+                for (unsigned i = 0; i < 8; ++i)
+                {
+                    if (mask & (1u << i))
+                    {
+                        shuffle &= ~((std::uint64_t)0xFF << (8 * count));
+                        shuffle |= (std::uint64_t)i << (8 * count);
+                        ++count;
+                    }
+                }
+                table.shuffles[mask] = shuffle;
+                table.counts[mask] = (std::uint8_t)count;
+            }
+            return table;
+        }
+
+        inline const CompactShuffles& GetCompactShuffles()
+        {
+            static const CompactShuffles table = BuildCompactShuffles();
+            return table;
+        }
+
+        // (Only needs SSSE3, which all AVX2 CPUs have.)
+        CYOJSON_TARGET_AVX2
+        inline char* CompactBlockAVX2(const char* block, std::uint64_t keep, char* out)
+        {
+            const CompactShuffles& table = GetCompactShuffles();
+            for (int group = 0; group < 64; group += 8)
+            {
+                const unsigned mask = (unsigned)(keep >> group) & 0xFF;
+                __m128i chars = _mm_loadl_epi64((const __m128i*)(block + group));
+                __m128i shuffle = _mm_loadl_epi64((const __m128i*)&table.shuffles[mask]);
+                _mm_storel_epi64((__m128i*)out, _mm_shuffle_epi8(chars, shuffle));
+                out += table.counts[mask];
+            }
+            return out;
+        }
+
+        // Where the scalar check resumes after the vectorised check of the
+        // bytes from begin to next: at the start of the sequence containing
+        // the byte before next, which may continue beyond it.
+        inline const char* ResumeUTF8(const char* begin, const char* next)
+        {
+            const char* start = next;
+            while (start != begin && next - start < 4)
+            {
+                --start;
+                if (((unsigned char)*start & 0xC0) != 0x80)
+                    break;
+            }
+            return start;
+        }
+
+        // Skips ASCII 16 bytes at a time, checking the rest a sequence at a
+        // time.
+        inline const char* FindInvalidUTF8SSE2(const char* next, const char* end)
+        {
+            while (next != end)
+            {
+                if (end - next >= 16)
+                {
+                    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)next));
+                    if (mask == 0)
+                    {
+                        next += 16;
+                        continue;
+                    }
+                    next += CountTrailingZeros((std::uint32_t)mask);
+                }
+                else if ((unsigned char)*next < 0x80)
+                {
+                    ++next;
+                    continue;
+                }
+
+                bool valid;
+                next = CheckUTF8Sequence(next, end, valid);
+                if (!valid)
+                    return next;
+            }
+            return nullptr;
+        }
+
+        // The errors in the 32 bytes of chars, given the 32 bytes before them
+        // (prev), found using lookup tables (Keiser and Lemire, "Validating
+        // UTF-8 in less than one instruction per byte"): each error is a
+        // combination of the high and low nibbles of one byte and the high
+        // nibble of the next, apart from the continuation bytes that a 3 or
+        // 4-byte sequence requires, which are found from the bytes 2 and 3
+        // before. Non-zero if there are any.
+        CYOJSON_TARGET_AVX2
+        inline __m256i FindUTF8ErrorsAVX2(__m256i chars, __m256i prev)
+        {
+            const std::uint8_t c_tooShort = 1 << 0;     //a lead byte where a continuation byte is expected
+            const std::uint8_t c_tooLong = 1 << 1;      //an ASCII byte followed by a continuation byte
+            const std::uint8_t c_overlong3 = 1 << 2;
+            const std::uint8_t c_tooLarge = 1 << 3;     //above 0x10FFFF
+            const std::uint8_t c_surrogate = 1 << 4;
+            const std::uint8_t c_overlong2 = 1 << 5;
+            const std::uint8_t c_tooLarge1000 = 1 << 6;
+            const std::uint8_t c_overlong4 = 1 << 6;
+            const std::uint8_t c_twoConts = 1 << 7;     //two continuation bytes (only valid after a 3 or 4-byte lead)
+            const std::uint8_t c_carry = c_tooShort | c_tooLong | c_twoConts;
+
+            const __m256i byte1High = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+                c_tooLong, c_tooLong, c_tooLong, c_tooLong, c_tooLong, c_tooLong, c_tooLong, c_tooLong,
+                (char)c_twoConts, (char)c_twoConts, (char)c_twoConts, (char)c_twoConts,
+                c_tooShort | c_overlong2,
+                c_tooShort,
+                c_tooShort | c_overlong3 | c_surrogate,
+                c_tooShort | c_tooLarge | c_tooLarge1000 | c_overlong4));
+            const __m256i byte1Low = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+                (char)(c_carry | c_overlong3 | c_overlong2 | c_overlong4),
+                (char)(c_carry | c_overlong2),
+                (char)c_carry,
+                (char)c_carry,
+                (char)(c_carry | c_tooLarge),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000 | c_surrogate),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000),
+                (char)(c_carry | c_tooLarge | c_tooLarge1000)));
+            const __m256i byte2High = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+                c_tooShort, c_tooShort, c_tooShort, c_tooShort, c_tooShort, c_tooShort, c_tooShort, c_tooShort,
+                (char)(c_tooLong | c_overlong2 | c_twoConts | c_overlong3 | c_tooLarge1000 | c_overlong4),
+                (char)(c_tooLong | c_overlong2 | c_twoConts | c_overlong3 | c_tooLarge),
+                (char)(c_tooLong | c_overlong2 | c_twoConts | c_surrogate | c_tooLarge),
+                (char)(c_tooLong | c_overlong2 | c_twoConts | c_surrogate | c_tooLarge),
+                c_tooShort, c_tooShort, c_tooShort, c_tooShort));
+            const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+            const __m256i thirdByteBias = _mm256_set1_epi8((char)(0xE0 - 0x80)); //only 111xxxxx leaves the top bit set
+            const __m256i fourthByteBias = _mm256_set1_epi8((char)(0xF0 - 0x80)); //only 1111xxxx leaves the top bit set
+            const __m256i topBit = _mm256_set1_epi8((char)0x80);
+
+            // The bytes 1, 2 and 3 before each byte...
+            __m256i shifted = _mm256_permute2x128_si256(prev, chars, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(chars, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(chars, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(chars, shifted, 13);
+
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble)),
+                    _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, lowNibble))),
+                _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(chars, 4), lowNibble)));
+            __m256i mustContinue = _mm256_and_si256(
+                _mm256_or_si256(_mm256_subs_epu8(prev2, thirdByteBias), _mm256_subs_epu8(prev3, fourthByteBias)),
+                topBit);
+            return _mm256_xor_si256(mustContinue, special);
+        }
+
+        // Checks 32 bytes at a time, skipping ASCII. The last few bytes are
+        // copied to a block padded with nulls (so a sequence that's incomplete
+        // at the end is an error). Only whether a block has an error is found
+        // this way, so its position is then found by the scalar check.
+        CYOJSON_TARGET_AVX2
+        inline const char* FindInvalidUTF8AVX2(const char* next, const char* end)
+        {
+            const char* const begin = next;
+            __m256i prev = _mm256_setzero_si256();
+            bool prevASCII = true;
+            for (;;)
+            {
+                __m256i chars;
+                const bool last = (end - next < 32);
+                if (!last)
+                {
+                    chars = _mm256_loadu_si256((const __m256i*)next);
+                }
+                else
+                {
+                    if (next == end && prevASCII)
+                        return nullptr;
+                    char padded[32] = {};
+                    std::memcpy(padded, next, (std::size_t)(end - next));
+                    chars = _mm256_loadu_si256((const __m256i*)padded);
+                }
+
+                const bool ascii = (_mm256_movemask_epi8(chars) == 0);
+                if (!ascii || !prevASCII) //after non-ASCII, check for an incomplete sequence
+                {
+                    __m256i errors = FindUTF8ErrorsAVX2(chars, prev);
+                    if (!_mm256_testz_si256(errors, errors))
+                        return FindInvalidUTF8Scalar(ResumeUTF8(begin, next), end);
+                }
+                if (last)
+                    return nullptr;
+
+                prev = chars;
+                prevASCII = ascii;
+                next += 32;
+            }
+        }
+
+        inline bool HasSSE2()
+        {
+#   if defined(__x86_64__) || defined(_M_X64)
+            return true;
+#   elif defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            return ((info[3] & (1 << 26)) != 0);
+#   else
+            return __builtin_cpu_supports("sse2");
+#   endif
+        }
+
+        inline bool HasAVX2()
+        {
+#   ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            __cpuid(info, 1);
+            const int osxsaveAndAVX = (1 << 27) | (1 << 28);
+            if ((info[2] & osxsaveAndAVX) != osxsaveAndAVX)
+                return false;
+            if ((_xgetbv(0) & 6) != 6)
+                return false; //OS doesn't save the YMM registers
+            __cpuidex(info, 7, 0);
+            return ((info[1] & (1 << 5)) != 0);
+#   else
+            return __builtin_cpu_supports("avx2");
+#   endif
+        }
+
+#endif //CYOJSON_SIMD_X86
+
+        inline ScanFunctions SelectScanFunctions()
+        {
+#ifdef CYOJSON_SIMD_X86
+            if (HasAVX2())
+                return ScanFunctions{ SkipBlanksAVX2, FindStringSpecialAVX2, ClassifyBlockAVX2, FindInvalidUTF8AVX2, CompactBlockAVX2 };
+            if (HasSSE2())
+                return ScanFunctions{ SkipBlanksSSE2, FindStringSpecialSSE2, ClassifyBlockSSE2, FindInvalidUTF8SSE2, CompactBlockScalar };
+#endif
+            return ScanFunctions{ SkipBlanksScalar, FindStringSpecialScalar, ClassifyBlockScalar, FindInvalidUTF8Scalar, CompactBlockScalar };
+        }
+
+        inline const ScanFunctions& GetScanFunctions()
+        {
+            static const ScanFunctions functions = SelectScanFunctions();
+            return functions;
+        }
+    }
+}
+
+#endif //__CYOJSON_DETAIL_SIMD_HPP
@@ -0,0 +1,263 @@
+/*
+[CyoJSON] detail/source.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_SOURCE_HPP
+#define __CYOJSON_DETAIL_SOURCE_HPP
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <istream>
+#include <vector>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <unistd.h>
+#endif
+
+#ifndef CYOJSON_NO_THREADS
+#   include <condition_variable>
+#   include <mutex>
+#   include <thread>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Reads a source into two blocks in turn, so that one can be parsed
+        // while the other is filled, which with read-ahead is done by a thread
+        // of its own.
+        class BlockReader final
+        {
+        public:
+            BlockReader(InputSource& source, std::size_t blockSize, bool readAhead)
+                : source_(source)
+            {
+                for (Block& block : blocks_)
+                    block.data.resize(blockSize);
+
+#ifndef CYOJSON_NO_THREADS
+                if (readAhead)
+                    reader_ = std::thread(&BlockReader::ReadAhead, this);
+#else
+                (void)readAhead;
+#endif
+            }
+
+            BlockReader(const BlockReader&) = delete;
+
+            void operator=(const BlockReader&) = delete;
+
+            ~BlockReader()
+            {
+#ifndef CYOJSON_NO_THREADS
+                if (reader_.joinable())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        stop_ = true;
+                    }
+                    changed_.notify_all();
+                    reader_.join();
+                }
+#endif
+            }
+
+            // The next block, which is empty at the end; false if the source
+            // failed. The previous block is then free to be read into again.
+            bool Next(const char*& data, std::size_t& length)
+            {
+                Block& block = blocks_[next_];
+                next_ ^= 1;
+
+#ifndef CYOJSON_NO_THREADS
+                if (reader_.joinable())
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    if (held_)
+                    {
+                        blocks_[next_].filled = false; //i.e. the previous block
+                        changed_.notify_all();
+                    }
+                    held_ = true;
+                    changed_.wait(lock, [&block] { return block.filled; });
+                }
+                else
+#endif
+                {
+                    block.success = source_.Read(block.data.data(), block.data.size(), block.length);
+                }
+
+                data = block.data.data();
+                length = block.length;
+                return block.success;
+            }
+
+        private:
+            struct Block
+            {
+                std::vector<char> data;
+                std::size_t length = 0;
+                bool success = true;
+                bool filled = false; //by the read-ahead thread, and not yet parsed
+            };
+
+            InputSource& source_;
+            Block blocks_[2];
+            std::size_t next_ = 0; //the block that Next() returns
+
+#ifndef CYOJSON_NO_THREADS
+            std::thread reader_;
+            std::mutex mutex_;
+            std::condition_variable changed_;
+            bool held_ = false; //whether the parser has a block
+            bool stop_ = false;
+
+            void ReadAhead()
+            {
+                for (std::size_t next = 0;; next ^= 1)
+                {
+                    Block& block = blocks_[next];
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        changed_.wait(lock, [this, &block] { return (stop_ || !block.filled); });
+                        if (stop_)
+                            return;
+                    }
+
+                    std::size_t length = 0;
+                    const bool success = source_.Read(block.data.data(), block.data.size(), length);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        block.length = length;
+                        block.success = success;
+                        block.filled = true;
+                    }
+                    changed_.notify_all();
+
+                    if (!success || length == 0)
+                        return;
+                }
+            }
+#endif
+        };
+    }
+
+    inline bool FileDescriptorSource::Read(char* buffer, std::size_t size, std::size_t& length)
+    {
+        length = 0;
+        for (;;)
+        {
+#ifdef _WIN32
+            const int count = _read(fd_, buffer, (unsigned)(size < INT_MAX ? size : INT_MAX));
+#else
+            const ssize_t count = read(fd_, buffer, size);
+#endif
+            if (count >= 0)
+            {
+                length = (std::size_t)count;
+                return true;
+            }
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    inline bool FileSource::Read(char* buffer, std::size_t size, std::size_t& length)
+    {
+        length = std::fread(buffer, 1, size, file_);
+        return (length != 0 || std::ferror(file_) == 0);
+    }
+
+    inline bool StreamSource::Read(char* buffer, std::size_t size, std::size_t& length)
+    {
+        stream_.read(buffer, (std::streamsize)size);
+        length = (std::size_t)stream_.gcount();
+        return (length != 0 || !stream_.bad());
+    }
+
+    inline bool Parser::Parse(InputSource& source, Callbacks& callbacks)
+    {
+        line_ = 0;
+        column_ = 0;
+        statistics_ = Statistics();
+        stopped_ = false;
+        return ParseBlocks(source, callbacks);
+    }
+
+    inline bool Parser::ParseBlocks(InputSource& source, Callbacks& callbacks)
+    {
+        detail::StatisticsTimer timer(statistics_);
+        detail::PathFilter filter(subscriptions_, skipMode_);
+        detail::FilteredCallbacks filtered(callbacks, filter);
+        StreamParser parser(filter.IsEmpty() ? callbacks : filtered);
+        parser.setPathTable(pathTable_);
+        parser.setUTF8Mode(utf8Mode_);
+
+        detail::BlockReader reader(source, blockSize_, readAhead_);
+        bool result = true;
+        for (;;)
+        {
+            const char* data;
+            std::size_t length;
+            if (!reader.Next(data, length))
+            {
+                result = false;
+                break;
+            }
+            if (length == 0)
+            {
+                result = parser.Finish();
+                break;
+            }
+            if (detail::c_statistics)
+                statistics_.bytes += length;
+            if (!parser.Feed(data, length))
+            {
+                result = false;
+                break;
+            }
+            if (parser.IsStopped())
+                break; //nothing more is read
+        }
+
+        line_ = parser.getLine();
+        column_ = parser.getColumn();
+        stopped_ = parser.IsStopped();
+        return result;
+    }
+}
+
+#endif //__CYOJSON_DETAIL_SOURCE_HPP
@@ -0,0 +1,101 @@
+/*
+[CyoJSON] detail/statistics.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_STATISTICS_HPP
+#define __CYOJSON_DETAIL_STATISTICS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Whether Parser::Statistics are counted. The counting is guarded by
+        // this constant (rather than the macro), so it's always compiled, but
+        // optimized away when not wanted.
+#ifdef CYOJSON_STATISTICS
+        const bool c_statistics = true;
+#else
+        const bool c_statistics = false;
+#endif
+
+        // Adds the statistics of part of the text (e.g. parsed by another
+        // thread) at the given depth, other than its bytes.
+        inline void AddStatistics(Parser::Statistics& total, const Parser::Statistics& part, std::size_t depth)
+        {
+            total.objects += part.objects;
+            total.arrays += part.arrays;
+            total.keys += part.keys;
+            total.strings += part.strings;
+            total.numbers += part.numbers;
+            total.bools += part.bools;
+            total.nulls += part.nulls;
+            total.unescapedStrings += part.unescapedStrings;
+            total.unicodeEscapes += part.unicodeEscapes;
+            total.maxDepth = std::max(total.maxDepth, depth + part.maxDepth);
+            total.pathGrowths += part.pathGrowths;
+            total.allocations += part.allocations;
+        }
+
+        // Adds the time until it's destroyed to the statistics.
+        class StatisticsTimer final
+        {
+        public:
+            explicit StatisticsTimer(Parser::Statistics& statistics)
+                : statistics_(statistics)
+            {
+                if (c_statistics)
+                    start_ = Clock::now();
+            }
+
+            StatisticsTimer(const StatisticsTimer&) = delete;
+
+            void operator=(const StatisticsTimer&) = delete;
+
+            ~StatisticsTimer()
+            {
+                if (c_statistics)
+                    statistics_.seconds += std::chrono::duration<double>(Clock::now() - start_).count();
+            }
+
+        private:
+            typedef std::chrono::steady_clock Clock;
+
+            Parser::Statistics& statistics_;
+            Clock::time_point start_;
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_STATISTICS_HPP
@@ -0,0 +1,824 @@
+/*
+[CyoJSON] detail/stream_parser.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#include "events.hpp"
+#include "number.hpp"
+#include "simd.hpp"
+#include "utf8.hpp"
+
+#include <cassert>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Resumable equivalent of ParserImpl. Rather than recursing, the
+        // nesting is kept on an explicit stack and the token being scanned
+        // (string, number or literal) is kept in token_, so the input can be
+        // split at any byte.
+        class StreamParserImpl final
+        {
+        public:
+            StreamParserImpl(Parser::Callbacks& callbacks)
+                : path_(nullptr, buffers_),
+                events_(callbacks)
+            {
+            }
+
+            StreamParserImpl(const StreamParserImpl&) = delete;
+
+            void operator=(const StreamParserImpl&) = delete;
+
+            bool Feed(const char* data, std::size_t length)
+            {
+                if (state_ == State::Error)
+                    return false;
+
+                const char* const end = data + length;
+                for (const char* next = data; next != end && !stopped_; ++next)
+                {
+                    if (!Consume(*next))
+                    {
+                        state_ = State::Error;
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool Finish()
+            {
+                // A number can't end until the char after it, so deliver it now
+                // (as Parse would have, before failing at the end)...
+                if (token_ == Token::Number && state_ != State::Error && !stopped_ && !EndNumber())
+                {
+                    state_ = State::Error;
+                    return false;
+                }
+
+                if (state_ != State::Done && !stopped_)
+                {
+                    if (token_ == Token::Literal)
+                        column_ -= literalPos_; //report the start of the literal
+                    token_ = Token::None;
+                    state_ = State::Error;
+                    return false;
+                }
+                return true;
+            }
+
+            // Takes effect immediately, so only between documents.
+            void SetPathTable(PathTable* pathTable)
+            {
+                pathTable_ = pathTable;
+                path_.Reset(pathTable_);
+                events_.SetPathId(path_.getId());
+            }
+
+            void SetUTF8Mode(Parser::UTF8Mode mode)
+            {
+                checkUTF8_ = (mode == Parser::UTF8Mode::Checked);
+            }
+
+            void Reset()
+            {
+                state_ = State::Root;
+                token_ = Token::None;
+                stopped_ = false;
+                skipDepth_ = 0;
+                skipValue_ = false;
+                line_ = c_firstLine;
+                column_ = c_firstColumnOfLine;
+                afterCR_ = false;
+                text_.clear();
+                path_.Reset(pathTable_);
+                events_.SetPathId(path_.getId());
+                stack_.clear();
+            }
+
+            int getLine() const { return line_; }
+            int getColumn() const { return column_; }
+
+            bool IsStopped() const { return stopped_; }
+
+        private:
+            enum class State
+            {
+                Root,               //expecting the top-level '{'
+                ObjectKeyOrEnd,     //after '{'
+                ObjectKey,          //after ',' in an object
+                ObjectColon,        //after a key
+                ObjectValue,        //after ':'
+                ObjectCommaOrEnd,   //after a member's value
+                ArrayValueOrEnd,    //after '['
+                ArrayValue,         //after ',' in an array
+                ArrayCommaOrEnd,    //after an element
+                Done,               //after the top-level '}'
+                Error
+            };
+
+            enum class Token
+            {
+                None,
+                String,
+                Number,
+                Literal
+            };
+
+            enum class StringState
+            {
+                Chars,
+                Escape,
+                Unicode,
+                LowSurrogateEscape,
+                LowSurrogateU,
+                LowSurrogate
+            };
+
+            enum class NumberState
+            {
+                Minus,
+                Zero,
+                Integer,
+                Point,
+                Fraction,
+                Exponent,
+                ExponentSign,
+                ExponentDigits
+            };
+
+            const int c_firstLine = 1;
+            const int c_firstColumnOfLine = 1;
+            const char* const c_true = "true";
+            const char* const c_false = "false";
+            const char* const c_null = "null";
+
+            State state_ = State::Root;
+            Token token_ = Token::None;
+            StringState stringState_ = StringState::Chars;
+            NumberState numberState_ = NumberState::Minus;
+            const char* literal_ = nullptr;
+            int literalPos_ = 0;
+            int hexDigits_ = 0;
+            std::uint16_t hexValue_ = 0;
+            std::uint16_t highSurrogate_ = 0;
+            bool checkUTF8_ = false;
+            int utf8Pending_ = 0; //continuation bytes still to come
+            unsigned char utf8Min_ = 0x80; //the range of the next one
+            unsigned char utf8Max_ = 0xBF;
+            int line_ = c_firstLine;
+            int column_ = c_firstColumnOfLine;
+            bool afterCR_ = false;
+            std::string text_;
+            PathTable* pathTable_ = nullptr;
+            ParserBuffers buffers_; //for the path
+            PathStack path_;
+            std::vector<char> stack_;
+            Events<Parser::Callbacks> events_;
+
+            bool stopped_ = false; //by the callbacks, ignoring the rest
+
+            // While skipping (as the callbacks asked), the nesting of the
+            // values passed over, whether the end that closes them is
+            // delivered (it isn't for the value of a key), and whether the
+            // next value is to be skipped (after a key). The text is still
+            // parsed, and checked, as usual.
+            std::size_t skipDepth_ = 0;
+            bool skipEnd_ = false;
+            bool skipValue_ = false;
+
+            bool IsSkipping() const { return (skipDepth_ != 0 || skipValue_); }
+
+            // Takes the action that the callbacks asked for after an event.
+            void TakeAction(Parser::Action action, bool start)
+            {
+                if (action == Parser::Action::Stop)
+                {
+                    stopped_ = true;
+                }
+                else if (action == Parser::Action::Skip && start)
+                {
+                    skipDepth_ = 1;
+                    skipEnd_ = true;
+                }
+            }
+
+            bool Consume(char ch)
+            {
+                switch (token_)
+                {
+                case Token::String:
+                    if (!ConsumeString(ch))
+                        return false;
+                    ++column_;
+                    return true;
+
+                case Token::Number:
+                    if (ConsumeNumber(ch))
+                    {
+                        ++column_;
+                        return true;
+                    }
+                    if (!EndNumber())
+                        return false;
+                    if (stopped_)
+                        return true; //not handling ch
+                    break; //ch follows the number, so handle it below
+
+                case Token::Literal:
+                    if (!ConsumeLiteral(ch))
+                        return false;
+                    ++column_;
+                    return true;
+
+                case Token::None:
+                    break;
+                }
+
+                return ConsumeStructural(ch);
+            }
+
+            bool ConsumeStructural(char ch)
+            {
+                if (ch == '\n' && afterCR_)
+                {
+                    afterCR_ = false;
+                    return true;
+                }
+                afterCR_ = false;
+
+                switch (ch)
+                {
+                case '\r':
+                    afterCR_ = true;
+                    NewLine();
+                    return true;
+
+                case '\n':
+                    NewLine();
+                    return true;
+                }
+
+                if (IsWhitespace(ch))
+                {
+                    ++column_;
+                    return true;
+                }
+
+                switch (state_)
+                {
+                case State::Root:
+                    if (ch != '{')
+                        return false;
+                    StartObject();
+                    break;
+
+                case State::ObjectKeyOrEnd:
+                    if (ch == '}')
+                        EndObject();
+                    else if (ch == '\"')
+                        StartString();
+                    else
+                        return false;
+                    break;
+
+                case State::ObjectKey:
+                    if (ch != '\"')
+                        return false;
+                    StartString();
+                    break;
+
+                case State::ObjectColon:
+                    if (ch != ':')
+                        return false;
+                    state_ = State::ObjectValue;
+                    break;
+
+                case State::ArrayValueOrEnd:
+                    if (ch == ']')
+                    {
+                        EndArray();
+                        break;
+                    }
+                    //fall through
+
+                case State::ObjectValue:
+                case State::ArrayValue:
+                    if (!StartValue(ch))
+                        return false;
+                    break;
+
+                case State::ObjectCommaOrEnd:
+                    if (ch == ',')
+                        state_ = State::ObjectKey;
+                    else if (ch == '}')
+                        EndObject();
+                    else
+                        return false;
+                    break;
+
+                case State::ArrayCommaOrEnd:
+                    if (ch == ',')
+                        state_ = State::ArrayValue;
+                    else if (ch == ']')
+                        EndArray();
+                    else
+                        return false;
+                    break;
+
+                case State::Done:
+                case State::Error:
+                    return false;
+                }
+
+                ++column_;
+                return true;
+            }
+
+            bool StartValue(char ch)
+            {
+                switch (ch)
+                {
+                case '{':
+                    StartObject();
+                    return true;
+
+                case '[':
+                    StartArray();
+                    return true;
+
+                case '\"':
+                    StartString();
+                    return true;
+
+                case 't':
+                    StartLiteral(c_true);
+                    return true;
+
+                case 'f':
+                    StartLiteral(c_false);
+                    return true;
+
+                case 'n':
+                    StartLiteral(c_null);
+                    return true;
+                }
+
+                if (ch != '-' && !std::isdigit((unsigned char)ch))
+                    return false;
+
+                token_ = Token::Number;
+                numberState_ = NumberState::Minus;
+                text_.clear();
+                return ConsumeNumber(ch);
+            }
+
+            void StartObject()
+            {
+                stack_.push_back('{');
+                state_ = State::ObjectKeyOrEnd;
+                if (StartSkipped())
+                    return;
+                TakeAction(events_.ObjectStart(path_.c_str()), true);
+            }
+
+            void EndObject()
+            {
+                if (!EndSkipped())
+                    TakeAction(events_.ObjectEnd(path_.c_str()), false);
+                stack_.pop_back();
+                EndValue();
+            }
+
+            void StartArray()
+            {
+                stack_.push_back('[');
+                state_ = State::ArrayValueOrEnd;
+                if (StartSkipped())
+                    return;
+                TakeAction(events_.ArrayStart(path_.c_str()), true);
+            }
+
+            void EndArray()
+            {
+                if (!EndSkipped())
+                    TakeAction(events_.ArrayEnd(path_.c_str()), false);
+                stack_.pop_back();
+                EndValue();
+            }
+
+            // Whether the object or array just started is being skipped.
+            bool StartSkipped()
+            {
+                if (!IsSkipping())
+                    return false;
+                if (skipValue_)
+                {
+                    skipValue_ = false;
+                    skipEnd_ = false;
+                }
+                ++skipDepth_;
+                return true;
+            }
+
+            // Whether the end of the object or array just ended is skipped.
+            bool EndSkipped()
+            {
+                if (skipDepth_ == 0)
+                    return false;
+                return (--skipDepth_ != 0 || !skipEnd_);
+            }
+
+            // Whether the scalar value just ended is skipped.
+            bool ValueSkipped()
+            {
+                if (!IsSkipping())
+                    return false;
+                skipValue_ = false;
+                return true;
+            }
+
+            void StartString()
+            {
+                token_ = Token::String;
+                stringState_ = StringState::Chars;
+                utf8Pending_ = 0;
+                text_.clear();
+            }
+
+            void StartLiteral(const char* literal)
+            {
+                token_ = Token::Literal;
+                literal_ = literal;
+                literalPos_ = 1;
+            }
+
+            void EndValue()
+            {
+                if (stack_.empty())
+                {
+                    state_ = State::Done;
+                }
+                else if (stack_.back() == '{')
+                {
+                    path_.Pop();
+                    events_.SetPathId(path_.getId());
+                    state_ = State::ObjectCommaOrEnd;
+                }
+                else
+                {
+                    state_ = State::ArrayCommaOrEnd;
+                }
+            }
+
+            void EndString()
+            {
+                token_ = Token::None;
+
+                if (state_ == State::ObjectKeyOrEnd || state_ == State::ObjectKey)
+                {
+                    if (!IsSkipping())
+                    {
+                        const Parser::Action action = events_.Key(path_.c_str(), text_.data(), text_.size());
+                        TakeAction(action, false);
+                        skipValue_ = (action == Parser::Action::Skip);
+                    }
+                    path_.Push(text_.data(), text_.size());
+                    events_.SetPathId(path_.getId());
+                    state_ = State::ObjectColon;
+                    return;
+                }
+
+                if (!ValueSkipped())
+                    TakeAction(events_.String(path_.c_str(), text_.data(), text_.size()), false);
+                EndValue();
+            }
+
+            bool ConsumeString(char ch)
+            {
+                switch (stringState_)
+                {
+                case StringState::Chars:
+                    if (checkUTF8_ && (utf8Pending_ != 0 || (unsigned char)ch >= 0x80))
+                        return ConsumeUTF8(ch);
+                    if (ch == '\"')
+                    {
+                        EndString();
+                        return true;
+                    }
+                    if ((unsigned char)ch < 0x20)
+                        return false;
+                    if (ch == '\\')
+                        stringState_ = StringState::Escape;
+                    else
+                        text_ += ch;
+                    return true;
+
+                case StringState::Escape:
+                {
+                    if (ch == 'u')
+                    {
+                        StartHex(StringState::Unicode);
+                        return true;
+                    }
+                    const char* const escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+                    const char* escape = (ch != '\0' ? std::strchr(escapes, ch) : nullptr);
+                    if (escape == nullptr || (escape - escapes) % 2 != 0)
+                        return false;
+                    text_ += *(escape + 1);
+                    stringState_ = StringState::Chars;
+                    return true;
+                }
+
+                case StringState::Unicode:
+                    if (!ConsumeHex(ch))
+                        return false;
+                    if (hexDigits_ < 4)
+                        return true;
+                    if (hexValue_ < 0xD800 || hexValue_ >= 0xE000)
+                    {
+                        OutputUTF8(text_, hexValue_);
+                        stringState_ = StringState::Chars;
+                        return true;
+                    }
+                    if (hexValue_ >= 0xDC00)
+                        return false; //invalid high surrogate
+                    highSurrogate_ = hexValue_;
+                    stringState_ = StringState::LowSurrogateEscape;
+                    return true;
+
+                case StringState::LowSurrogateEscape:
+                    if (ch != '\\')
+                        return false;
+                    stringState_ = StringState::LowSurrogateU;
+                    return true;
+
+                case StringState::LowSurrogateU:
+                    if (ch != 'u')
+                        return false;
+                    StartHex(StringState::LowSurrogate);
+                    return true;
+
+                case StringState::LowSurrogate:
+                    if (!ConsumeHex(ch))
+                        return false;
+                    if (hexDigits_ < 4)
+                        return true;
+                    if (hexValue_ < 0xDC00 || hexValue_ > 0xDFFF)
+                        return false; //invalid low surrogate
+                    OutputUTF8(text_, highSurrogate_, hexValue_);
+                    stringState_ = StringState::Chars;
+                    return true;
+                }
+
+                return false;
+            }
+
+            // Checks each byte of a multi-byte sequence, as CheckUTF8Sequence
+            // does, so fails at the same byte.
+            bool ConsumeUTF8(char ch)
+            {
+                const unsigned char byte = (unsigned char)ch;
+                if (utf8Pending_ == 0)
+                {
+                    utf8Pending_ = GetUTF8Length(byte, utf8Min_, utf8Max_) - 1;
+                    if (utf8Pending_ < 0)
+                        return false;
+                }
+                else
+                {
+                    if (byte < utf8Min_ || byte > utf8Max_)
+                        return false;
+                    utf8Min_ = 0x80;
+                    utf8Max_ = 0xBF;
+                    --utf8Pending_;
+                }
+                text_ += ch;
+                return true;
+            }
+
+            void StartHex(StringState state)
+            {
+                stringState_ = state;
+                hexDigits_ = 0;
+                hexValue_ = 0;
+            }
+
+            bool ConsumeHex(char ch)
+            {
+                std::uint16_t curr;
+                if ('a' <= ch && ch <= 'f')
+                    curr = (std::uint16_t)((ch - 'a') + 10);
+                else if ('A' <= ch && ch <= 'F')
+                    curr = (std::uint16_t)((ch - 'A') + 10);
+                else if ('0' <= ch && ch <= '9')
+                    curr = (std::uint16_t)(ch - '0');
+                else
+                    return false;
+                hexValue_ = (std::uint16_t)((hexValue_ << 4) | curr);
+                ++hexDigits_;
+                return true;
+            }
+
+            // Returns false if ch isn't part of the number, in which case the
+            // caller must end the number (which may be incomplete, e.g. "1.").
+            bool ConsumeNumber(char ch)
+            {
+                bool digit = ('0' <= ch && ch <= '9');
+
+                switch (numberState_)
+                {
+                case NumberState::Minus:
+                    if (ch == '-' && text_.empty())
+                        break;
+                    if (!digit)
+                        return false;
+                    numberState_ = (ch == '0' ? NumberState::Zero : NumberState::Integer);
+                    break;
+
+                case NumberState::Zero:
+                case NumberState::Integer:
+                    if (digit && numberState_ == NumberState::Integer)
+                        break;
+                    if (ch == '.')
+                        numberState_ = NumberState::Point;
+                    else if (ch == 'e' || ch == 'E')
+                        numberState_ = NumberState::Exponent;
+                    else
+                        return false;
+                    break;
+
+                case NumberState::Point:
+                    if (!digit)
+                        return false;
+                    numberState_ = NumberState::Fraction;
+                    break;
+
+                case NumberState::Fraction:
+                    if (digit)
+                        break;
+                    if (ch != 'e' && ch != 'E')
+                        return false;
+                    numberState_ = NumberState::Exponent;
+                    break;
+
+                case NumberState::Exponent:
+                    if (ch == '+' || ch == '-')
+                        numberState_ = NumberState::ExponentSign;
+                    else if (digit)
+                        numberState_ = NumberState::ExponentDigits;
+                    else
+                        return false;
+                    break;
+
+                case NumberState::ExponentSign:
+                case NumberState::ExponentDigits:
+                    if (!digit)
+                        return false;
+                    numberState_ = NumberState::ExponentDigits;
+                    break;
+                }
+
+                text_ += ch;
+                return true;
+            }
+
+            bool EndNumber()
+            {
+                switch (numberState_)
+                {
+                case NumberState::Zero:
+                case NumberState::Integer:
+                case NumberState::Fraction:
+                case NumberState::ExponentDigits:
+                    break;
+
+                default:
+                    return false;
+                }
+
+                token_ = Token::None;
+                if (!ValueSkipped())
+                {
+                    const char* last;
+                    NumberValue value;
+                    ScanNumber(text_.c_str(), nullptr, last, value); //already validated
+                    TakeAction(events_.Number(path_.c_str(), value, text_.data(), text_.size()), false);
+                }
+                EndValue();
+                return true;
+            }
+
+            bool ConsumeLiteral(char ch)
+            {
+                if (ch != literal_[literalPos_])
+                {
+                    column_ -= literalPos_; //report the start of the literal
+                    return false;
+                }
+
+                if (literal_[++literalPos_] == '\0')
+                {
+                    token_ = Token::None;
+                    if (!ValueSkipped())
+                        TakeAction(events_.Literal(path_.c_str(), literal_), false);
+                    EndValue();
+                }
+                return true;
+            }
+
+            void NewLine()
+            {
+                column_ = c_firstColumnOfLine;
+                ++line_;
+            }
+        };
+    }
+
+    inline StreamParser::StreamParser(Parser::Callbacks& callbacks)
+        : impl_(new detail::StreamParserImpl(callbacks))
+    {
+    }
+
+    inline StreamParser::~StreamParser()
+    {
+    }
+
+    inline bool StreamParser::Feed(const char* data, std::size_t length)
+    {
+        if (!data && length != 0)
+            return false;
+
+        bool result = impl_->Feed(data, length);
+        line_ = impl_->getLine();
+        column_ = impl_->getColumn();
+        return result;
+    }
+
+    inline bool StreamParser::Finish()
+    {
+        bool result = impl_->Finish();
+        line_ = impl_->getLine();
+        column_ = impl_->getColumn();
+        return result;
+    }
+
+    inline void StreamParser::setPathTable(PathTable* pathTable)
+    {
+        pathTable_ = pathTable;
+        impl_->SetPathTable(pathTable);
+    }
+
+    inline void StreamParser::setUTF8Mode(Parser::UTF8Mode utf8Mode)
+    {
+        utf8Mode_ = utf8Mode;
+        impl_->SetUTF8Mode(utf8Mode);
+    }
+
+    inline bool StreamParser::IsStopped() const
+    {
+        return impl_->IsStopped();
+    }
+
+    inline void StreamParser::Reset()
+    {
+        impl_->Reset();
+        line_ = 0;
+        column_ = 0;
+    }
+}
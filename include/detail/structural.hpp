@@ -0,0 +1,589 @@
+/*
+[CyoJSON] detail/structural.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_STRUCTURAL_HPP
+#define __CYOJSON_DETAIL_STRUCTURAL_HPP
+
+#include "events.hpp"
+#include "filter.hpp"
+#include "scanner.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Cumulative XOR from the lowest bit upwards, which turns a mask of
+        // quotes into a mask of the chars they enclose (plus opening quotes).
+        inline std::uint64_t PrefixXor(std::uint64_t mask)
+        {
+            mask ^= mask << 1;
+            mask ^= mask << 2;
+            mask ^= mask << 4;
+            mask ^= mask << 8;
+            mask ^= mask << 16;
+            mask ^= mask << 32;
+            return mask;
+        }
+
+        // Returns the mask of chars that are escaped by a backslash: the char
+        // after each odd-length run of backslashes. prevEscaped carries a run
+        // that ends at the last char of the previous block.
+        inline std::uint64_t FindEscaped(std::uint64_t backslash, std::uint64_t& prevEscaped)
+        {
+            const std::uint64_t evenBits = 0x5555555555555555ull;
+
+            backslash &= ~prevEscaped;
+            std::uint64_t followsEscape = (backslash << 1) | prevEscaped;
+
+            std::uint64_t oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+            std::uint64_t sequencesStartingOnEvenBits = oddSequenceStarts + backslash;
+            prevEscaped = (sequencesStartingOnEvenBits < backslash ? 1 : 0); //carry
+            std::uint64_t invertMask = sequencesStartingOnEvenBits << 1;
+
+            return (evenBits ^ invertMask) & followsEscape;
+        }
+
+        inline void BuildStructuralIndex(const char* json, std::size_t length, const ScanFunctions& scan, StructuralIndex& index)
+        {
+            // Every char could be structural, but only the pages that are used
+            // will actually be touched...
+            if (index.positions.size() < length + 64)
+            {
+                index.positions.clear(); //so nothing is copied
+                index.positions.resize(length + 64);
+            }
+            index.count = 0;
+            index.lineBreaks = 0;
+            index.lastLineStart = 0;
+
+            std::uint64_t prevEscaped = 0;
+            std::uint64_t prevInString = 0;
+            std::uint64_t prevScalar = 0;
+            std::uint64_t prevCR = 0;
+            char padded[64];
+
+            for (std::size_t base = 0; base < length; base += 64)
+            {
+                const char* block = json + base;
+                if (length - base < 64)
+                {
+                    std::memset(padded, ' ', sizeof(padded));
+                    std::memcpy(padded, block, length - base);
+                    block = padded;
+                }
+
+                BlockMasks masks;
+                scan.ClassifyBlock(block, masks);
+
+                std::uint64_t escaped = FindEscaped(masks.backslash, prevEscaped);
+                std::uint64_t quotes = masks.quote & ~escaped;
+                std::uint64_t inString = PrefixXor(quotes) ^ prevInString;
+                prevInString = (std::uint64_t)((std::int64_t)inString >> 63);
+                std::uint64_t stringTails = inString ^ quotes; //contents and closing quotes
+                std::uint64_t stringContents = stringTails & ~quotes;
+
+                std::uint64_t scalars = ~(masks.op | masks.whitespace | quotes);
+                std::uint64_t scalarStarts = scalars & ~((scalars << 1) | prevScalar);
+                prevScalar = scalars >> 63;
+
+                // A string that is followed in the index by its closing quote
+                // can be used as is; one followed by a backslash or control
+                // char must be scanned.
+                std::uint64_t structurals = ((masks.op | scalarStarts) & ~stringTails) | quotes
+                    | ((masks.backslash | masks.control) & stringContents);
+
+                // CR, LF or CRLF are each one line break (as in SkipWhitespace),
+                // including a CRLF that straddles two blocks...
+                std::uint64_t lineBreaks = masks.lf | (masks.cr & ~(masks.lf >> 1));
+                if (prevCR)
+                    lineBreaks &= ~(masks.lf & 1);
+                prevCR = masks.cr >> 63;
+                std::uint64_t lineEnds = masks.lf | masks.cr;
+                if (lineEnds != 0)
+                {
+                    index.lineBreaks += PopCount64(lineBreaks);
+                    index.lastLineStart = base + 64 - CountLeadingZeros64(lineEnds);
+                }
+
+                // Write the offsets four at a time, which may write up to three
+                // beyond the end (hence the spare capacity)...
+                if (structurals == 0)
+                    continue;
+                int count = PopCount64(structurals);
+                std::uint32_t* out = index.positions.data() + index.count;
+                for (int i = 0; i < count; i += 4)
+                {
+                    out[i] = (std::uint32_t)(base + CountTrailingZeros64(structurals));
+                    structurals &= structurals - 1;
+                    out[i + 1] = (std::uint32_t)(base + CountTrailingZeros64(structurals | ((std::uint64_t)1 << 63)));
+                    structurals &= structurals - 1;
+                    out[i + 2] = (std::uint32_t)(base + CountTrailingZeros64(structurals | ((std::uint64_t)1 << 63)));
+                    structurals &= structurals - 1;
+                    out[i + 3] = (std::uint32_t)(base + CountTrailingZeros64(structurals | ((std::uint64_t)1 << 63)));
+                    structurals &= structurals - 1;
+                }
+                index.count += (std::size_t)count;
+            }
+        }
+
+        // Stage two: walks the structural index, rather than the text, so
+        // whitespace is never visited and each token is found without a search.
+        // Strings, numbers and literals are still parsed by the Scanner. Fires
+        // the same callbacks as ParserImpl, and reports errors at the same
+        // positions (which are only worked out when needed).
+        template <typename Handler>
+        class StructuralParserImpl final : private Scanner
+        {
+        public:
+            StructuralParserImpl(const char* json, std::size_t length, Handler& handler, const PathFilter& filter, PathTable* pathTable, ParserBuffers& buffers)
+                : Scanner(json, json + length, buffers.scratch),
+                json_(json),
+                index_(buffers.index),
+                path_(pathTable, buffers, (Events<Handler>::c_usesPaths || pathTable || !filter.IsEmpty())),
+                events_(handler),
+                filter_(filter)
+            {
+                events_.SetPathId(PathTable::c_rootId);
+            }
+
+            StructuralParserImpl(const StructuralParserImpl&) = delete;
+
+            void operator=(const StructuralParserImpl&) = delete;
+
+            // Counts the statistics of the parse (if c_statistics).
+            void setStatistics(Parser::Statistics* stats)
+            {
+                stats_ = stats;
+                path_.setStatistics(stats);
+            }
+
+            void setUTF8Mode(Parser::UTF8Mode mode)
+            {
+                checkUTF8_ = (mode == Parser::UTF8Mode::Checked);
+            }
+
+            // Says the index in the buffers was already built, for the same
+            // text (by BulkArray::Find).
+            void setIndexed(bool indexed) { indexed_ = indexed; }
+
+            bool Parse(int& line, int& column)
+            {
+                const std::size_t capacity = index_.positions.size();
+                if (!indexed_)
+                    BuildStructuralIndex(json_, (std::size_t)(end_ - json_), scan_, index_);
+                positions_ = index_.positions.data();
+                if (c_statistics && index_.positions.size() != capacity)
+                    Count(&Parser::Statistics::allocations);
+
+                bool success = ParseObject(filter_.Match("", 0));
+                if (success && (PeekToken() != '\0' || next_ != end_))
+                    success = false; //trailing chars, or an embedded null char
+
+                if (success)
+                {
+                    line = c_firstLine + (int)index_.lineBreaks;
+                    column = c_firstColumnOfLine + (int)((std::size_t)(end_ - json_) - index_.lastLineStart);
+                }
+                else
+                {
+                    FindPosition(line, column);
+                }
+                if (c_statistics && stats_)
+                    stats_->bytes += (std::size_t)((success ? end_ : next_) - json_);
+                return (success || stopped_);
+            }
+
+            // Whether the parse was stopped by the handler, in which case
+            // Parse() succeeds, with line and column giving where it stopped.
+            bool IsStopped() const { return stopped_; }
+
+        private:
+            const char* const json_;
+            StructuralIndex& index_;
+            bool indexed_ = false;
+            const std::uint32_t* positions_ = nullptr;
+            std::size_t pos_ = 0;
+            PathStack path_;
+            Events<Handler> events_;
+            const PathFilter& filter_;
+            bool stopped_ = false;
+
+            // Moves next_ to the next token, returning its first char (or '\0'
+            // at the end of the input).
+            char PeekToken()
+            {
+                if (pos_ == index_.count)
+                {
+                    next_ = end_;
+                    return '\0';
+                }
+                next_ = json_ + positions_[pos_];
+                return *next_;
+            }
+
+            bool IsNextToken(char ch)
+            {
+                if (PeekToken() != ch)
+                    return false;
+                ++pos_;
+                return true;
+            }
+
+            // A number or literal must be followed by whitespace, a structural
+            // char or the end of the input, as otherwise the following chars
+            // (e.g. "truex") aren't in the index.
+            bool IsEndOfScalar() const
+            {
+                switch (CurrChar())
+                {
+                case '\0':
+                    return IsEnd();
+                case ' ': case '\t': case '\r': case '\n':
+                case '{': case '}': case '[': case ']': case ':': case ',': case '\"':
+                    return true;
+                }
+                return false;
+            }
+
+            void FindPosition(int& line, int& column) const
+            {
+                line = c_firstLine;
+                column = c_firstColumnOfLine;
+                for (const char* next = json_; next < next_; ++next)
+                {
+                    if (*next == '\r' && next + 1 < next_ && *(next + 1) == '\n')
+                        continue; //counted at the LF
+                    if (*next == '\r' || *next == '\n')
+                    {
+                        ++line;
+                        column = c_firstColumnOfLine;
+                    }
+                    else
+                    {
+                        ++column;
+                    }
+                }
+            }
+
+            // The fast path for strings without escapes, which are found using
+            // the index alone.
+            bool ParseStringToken(const char*& str, std::size_t& length)
+            {
+                const char* const start = next_ + 1;
+                if (++pos_ < index_.count)
+                {
+                    const char* end = json_ + positions_[pos_];
+                    if (*end == '\"')
+                    {
+                        if (checkUTF8_)
+                        {
+                            const char* invalid = scan_.FindInvalidUTF8(start, end);
+                            if (invalid)
+                            {
+                                next_ = invalid;
+                                return false;
+                            }
+                        }
+                        ++pos_;
+                        str = start;
+                        length = (std::size_t)(end - start);
+                        next_ = end + 1;
+                        return true;
+                    }
+                }
+
+                if (!ParseString(str, length))
+                    return false;
+                while (pos_ < index_.count && json_ + positions_[pos_] < next_)
+                    ++pos_;
+                return true;
+            }
+
+            // Checks the value using the Scanner, then resumes from the first
+            // index entry after it. Only a scalar must be followed by a
+            // terminator; an object or array ends at its bracket, as when
+            // it's parsed.
+            bool SkipValueChecked()
+            {
+                const char token = PeekToken();
+                if (token == '\0' || !SkipValue())
+                    return false;
+                const std::uint32_t* const first = positions_ + pos_;
+                pos_ += (std::size_t)(std::lower_bound(first, positions_ + index_.count, (std::uint32_t)(next_ - json_)) - first);
+                return (token == '{' || token == '[' || IsEndOfScalar());
+            }
+
+            // For trusted input: skips the value using the index alone, where
+            // a string is its opening quote up to the next quote (escaped
+            // quotes aren't in the index) and brackets within strings aren't
+            // in the index at all.
+            bool SkipValueTokens()
+            {
+                switch (PeekToken())
+                {
+                case '\0': case '}': case ']': case ':': case ',':
+                    return false;
+                }
+
+                int depth = 0;
+                do
+                {
+                    switch (PeekToken())
+                    {
+                    case '\0':
+                        return false;
+
+                    case '{':
+                    case '[':
+                        ++depth;
+                        break;
+
+                    case '}':
+                    case ']':
+                        --depth;
+                        break;
+
+                    case '\"':
+                        do
+                        {
+                            if (++pos_ == index_.count)
+                                return false;
+                        }
+                        while (json_[positions_[pos_]] != '\"');
+                        break;
+                    }
+                    ++pos_;
+                }
+                while (depth > 0);
+
+                next_ = json_ + positions_[pos_ - 1] + 1;
+                return true;
+            }
+
+            // Whether the handler asked to stop, in which case the parse ends
+            // at once, returning false as for an error.
+            bool IsStop(Parser::Action action)
+            {
+                stopped_ = (action == Parser::Action::Stop);
+                return stopped_;
+            }
+
+            // As above, after a bracket, which is where it stops.
+            bool IsStopAfterBracket(Parser::Action action)
+            {
+                if (!IsStop(action))
+                    return false;
+                next_ = json_ + positions_[pos_ - 1] + 1;
+                return true;
+            }
+
+            // Skips the rest of the object or array whose opening bracket was
+            // just read, as the handler asked.
+            bool SkipContents()
+            {
+                --pos_;
+                return (filter_.IsUnchecked() ? SkipValueTokens() : SkipValueChecked());
+            }
+
+            bool ParseLiteral(const char* literal)
+            {
+                ++pos_;
+                if (!IsNext(literal, false))
+                    return false;
+                Count(*literal == 'n' ? &Parser::Statistics::nulls : &Parser::Statistics::bools);
+                return (!IsStop(events_.Literal(path_.c_str(), literal)) && IsEndOfScalar());
+            }
+
+            bool ParseValue(PathMatch match)
+            {
+                if (match != PathMatch::Deliver && (match == PathMatch::Skip || (PeekToken() != '{' && PeekToken() != '[')))
+                    return (filter_.IsUnchecked() ? SkipValueTokens() : SkipValueChecked());
+
+                switch (PeekToken())
+                {
+                case '{':
+                    return ParseObject(match);
+
+                case '[':
+                    return ParseArray(match);
+
+                case '\"':
+                {
+                    const char* str;
+                    std::size_t length;
+                    if (!ParseStringToken(str, length))
+                        return false;
+                    Count(&Parser::Statistics::strings);
+                    return !IsStop(events_.String(path_.c_str(), str, length));
+                }
+
+                case 't':
+                    return ParseLiteral(c_true);
+
+                case 'f':
+                    return ParseLiteral(c_false);
+
+                case 'n':
+                    return ParseLiteral(c_null);
+
+                case '\0':
+                    return false;
+
+                default:
+                    ++pos_;
+                    return (ParseNumberValue() && IsEndOfScalar());
+                }
+            }
+
+            bool ParseNumberValue()
+            {
+                const char* num;
+                std::size_t length;
+                Parser::Action action;
+                if (Events<Handler>::c_convertsNumbers)
+                {
+                    NumberValue value;
+                    if (!ParseNumber(num, length, value))
+                        return false;
+                    action = events_.Number(path_.c_str(), value, num, length);
+                }
+                else
+                {
+                    if (!ParseNumber(num, length))
+                        return false;
+                    action = events_.Number(path_.c_str(), num, length);
+                }
+                Count(&Parser::Statistics::numbers);
+                return !IsStop(action);
+            }
+
+            bool ParseArray(PathMatch match)
+            {
+                if (!IsNextToken('['))
+                    return false;
+
+                Count(&Parser::Statistics::arrays);
+                CountNested();
+                Parser::Action action = Parser::Action::Continue;
+                if (match == PathMatch::Deliver && IsStopAfterBracket(action = events_.ArrayStart(path_.c_str())))
+                    return false;
+
+                if (action == Parser::Action::Skip)
+                {
+                    if (!SkipContents())
+                        return false;
+                }
+                else if (!IsNextToken(']'))
+                {
+                    do
+                    {
+                        if (!ParseValue(match))
+                            return false;
+                    }
+                    while (IsNextToken(','));
+
+                    if (!IsNextToken(']'))
+                        return false;
+                }
+
+                EndNested();
+                return (match != PathMatch::Deliver || !IsStopAfterBracket(events_.ArrayEnd(path_.c_str())));
+            }
+
+            bool ParseObject(PathMatch match)
+            {
+                if (!IsNextToken('{'))
+                    return false;
+
+                Count(&Parser::Statistics::objects);
+                CountNested();
+                Parser::Action action = Parser::Action::Continue;
+                if (match == PathMatch::Deliver && IsStopAfterBracket(action = events_.ObjectStart(path_.c_str())))
+                    return false;
+
+                if (action == Parser::Action::Skip)
+                {
+                    if (!SkipContents())
+                        return false;
+                }
+                else if (!IsNextToken('}'))
+                {
+                    do
+                    {
+                        if (PeekToken() != '\"')
+                            return false;
+
+                        const char* key;
+                        std::size_t keyLength;
+                        if (!ParseStringToken(key, keyLength))
+                            return false;
+                        Count(&Parser::Statistics::keys);
+                        if (match == PathMatch::Deliver && IsStop(action = events_.Key(path_.c_str(), key, keyLength)))
+                            return false;
+                        path_.Push(key, keyLength);
+                        if (path_.HasTable())
+                            events_.SetPathId(path_.getId());
+                        PathMatch memberMatch = (match == PathMatch::Deliver ? match : filter_.Match(path_.c_str(), path_.size()));
+                        if (action == Parser::Action::Skip)
+                            memberMatch = PathMatch::Skip;
+
+                        if (!IsNextToken(':'))
+                            return false;
+
+                        if (!ParseValue(memberMatch))
+                            return false;
+
+                        path_.Pop();
+                        if (path_.HasTable())
+                            events_.SetPathId(path_.getId());
+                    }
+                    while (IsNextToken(','));
+
+                    if (!IsNextToken('}'))
+                        return false;
+                }
+
+                EndNested();
+                return (match != PathMatch::Deliver || !IsStopAfterBracket(events_.ObjectEnd(path_.c_str())));
+            }
+        };
+    }
+}
+
+#endif //__CYOJSON_DETAIL_STRUCTURAL_HPP
@@ -0,0 +1,466 @@
+/*
+[CyoJSON] detail/tape.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_TAPE_HPP
+#define __CYOJSON_DETAIL_TAPE_HPP
+
+#include "file.hpp"
+#include "recorder.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#   include <process.h>
+#else
+#   include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // A saved tape is this header, then the path table (the parent id and
+        // key of each path but the root, in order of their ids), then the
+        // events as recorded by EventRecorder.
+        struct TapeHeader
+        {
+            char magic[8];
+            std::uint32_t byteOrder;
+            std::uint32_t version;
+            std::uint64_t contentHash;
+            std::uint64_t contentLength;
+            std::uint64_t pathsSize;
+            std::uint64_t eventsSize;
+            std::uint64_t checksum; //see TapeChecksum
+            std::uint32_t pathCount;
+            std::uint32_t flags;
+            std::uint32_t line; //where the parse ended
+            std::uint32_t column;
+        };
+
+        static_assert(sizeof(TapeHeader) == 72, "TapeHeader isn't packed");
+
+        const char c_tapeMagic[8] = { 'C', 'Y', 'O', 'J', 'T', 'A', 'P', 'E' };
+        const std::uint32_t c_tapeByteOrder = 0x01020304;
+        const std::uint32_t c_tapeVersion = 3;
+        const std::uint32_t c_tapeUTF8Checked = 1; //flag
+
+        // Tapes have no records.
+        struct NoRecords
+        {
+            void RecordStart(std::size_t) { }
+            void RecordEnd(std::size_t) { }
+            void RecordError(std::size_t, int, int) { }
+        };
+
+        template <typename T>
+        inline void PutTapeValue(std::vector<char>& buffer, T value)
+        {
+            const std::size_t size = buffer.size();
+            buffer.resize(size + sizeof(value));
+            std::memcpy(&buffer[size], &value, sizeof(value));
+        }
+
+        // HashContent of the paths and events, then of the header with that
+        // as its checksum, so that damage to either is detected.
+        inline std::uint64_t TapeChecksum(TapeHeader header, const char* body, std::size_t size)
+        {
+            header.checksum = EventTape::HashContent(body, size);
+            return EventTape::HashContent((const char*)&header, sizeof(header));
+        }
+
+        inline unsigned long long CurrentProcessId()
+        {
+#ifdef _WIN32
+            return (unsigned long long)_getpid();
+#else
+            return (unsigned long long)getpid();
+#endif
+        }
+    }
+
+    inline EventTape::EventTape()
+    {
+    }
+
+    inline EventTape::~EventTape()
+    {
+    }
+
+    inline std::uint64_t EventTape::HashContent(const char* json, std::size_t length)
+    {
+        // MurmurHash64A (by Austin Appleby), over four interleaved lanes so
+        // that their multiplications can overlap...
+        const std::uint64_t c_multiplier = 0xC6A4A7935BD1E995ull;
+        const int c_shift = 47;
+        std::uint64_t lanes[4] = { 1, 2, 3, 4 };
+        std::uint64_t word;
+        const char* next = json;
+        const char* const end = json + length;
+
+        for (; end - next >= 32; next += 32)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                std::memcpy(&word, next + 8 * i, 8);
+                word *= c_multiplier;
+                word ^= word >> c_shift;
+                word *= c_multiplier;
+                lanes[i] ^= word;
+                lanes[i] *= c_multiplier;
+            }
+        }
+
+        std::uint64_t hash = (std::uint64_t)length * c_multiplier;
+        for (int i = 0; i < 4; ++i)
+        {
+            word = lanes[i] ^ (lanes[i] >> c_shift);
+            hash ^= word * c_multiplier;
+            hash *= c_multiplier;
+        }
+        for (; end - next >= 8; next += 8)
+        {
+            std::memcpy(&word, next, 8);
+            word *= c_multiplier;
+            word ^= word >> c_shift;
+            word *= c_multiplier;
+            hash ^= word;
+            hash *= c_multiplier;
+        }
+        if (next != end)
+        {
+            word = 0;
+            std::memcpy(&word, next, (std::size_t)(end - next));
+            hash ^= word;
+            hash *= c_multiplier;
+        }
+
+        hash ^= hash >> c_shift;
+        hash *= c_multiplier;
+        hash ^= hash >> c_shift;
+        return hash;
+    }
+
+    inline bool EventTape::Record(const char* json, std::size_t length)
+    {
+        Clear();
+
+        detail::EventRecorder recorder;
+        Parser parser;
+        parser.setEngine(engine_);
+        parser.setUTF8Mode(utf8Mode_);
+        parser.setPathTable(&recorder.getPathTable());
+        const bool success = parser.Parse(json, length, recorder);
+        line_ = parser.getLine();
+        column_ = parser.getColumn();
+        if (!success)
+            return false;
+
+        // Serialise the path table, then the events...
+        const PathTable& table = recorder.getPathTable();
+        buffer_.resize(sizeof(detail::TapeHeader));
+        for (PathTable::Id id = 1; id < (PathTable::Id)table.getCount(); ++id)
+        {
+            detail::PutTapeValue(buffer_, (std::uint32_t)table.getParent(id));
+            detail::PutTapeValue(buffer_, (std::uint32_t)table.getKeyLength(id));
+            buffer_.insert(buffer_.end(), table.getKey(id), table.getKey(id) + table.getKeyLength(id));
+        }
+        const std::size_t pathsSize = buffer_.size() - sizeof(detail::TapeHeader);
+        const std::vector<char>& events = recorder.getEvents();
+        buffer_.insert(buffer_.end(), events.begin(), events.end());
+
+        detail::TapeHeader header;
+        std::memcpy(header.magic, detail::c_tapeMagic, sizeof(header.magic));
+        header.byteOrder = detail::c_tapeByteOrder;
+        header.version = detail::c_tapeVersion;
+        header.contentHash = HashContent(json, length);
+        header.contentLength = length;
+        header.pathsSize = pathsSize;
+        header.eventsSize = events.size();
+        header.pathCount = (std::uint32_t)table.getCount();
+        header.flags = (utf8Mode_ == Parser::UTF8Mode::Checked ? detail::c_tapeUTF8Checked : 0);
+        header.line = (std::uint32_t)line_;
+        header.column = (std::uint32_t)column_;
+        header.checksum = detail::TapeChecksum(header, buffer_.data() + sizeof(header), buffer_.size() - sizeof(header));
+        std::memcpy(buffer_.data(), &header, sizeof(header));
+
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        return Open();
+    }
+
+    template <typename Handler>
+    inline void EventTape::Replay(Handler& handler, PathTable* pathTable)
+    {
+        if (!events_)
+            return;
+
+        detail::Events<Handler> events(handler);
+        detail::NoRecords records;
+        detail::ReplayEvents(events_, eventsEnd_, paths_, ids_, events, records, pathTable, (detail::Events<Handler>::c_usesPaths || pathTable));
+    }
+
+    inline bool EventTape::Save(const char* filename) const
+    {
+        if (!data_ || !filename)
+            return false;
+
+        // A name that no other writer, in this process or another, will be
+        // using at the same time...
+        const std::string temp = std::string(filename) + ".tmp"
+            + std::to_string(detail::CurrentProcessId()) + "-"
+            + std::to_string((unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count())
+            + "-" + std::to_string((unsigned long long)(std::uintptr_t)this);
+
+        std::FILE* file = std::fopen(temp.c_str(), "wb");
+        if (!file)
+            return false;
+        bool success = (std::fwrite(data_, 1, size_, file) == size_);
+        success = (std::fclose(file) == 0 && success);
+
+        if (success && std::rename(temp.c_str(), filename) != 0)
+        {
+            // Windows won't rename over an existing file...
+            std::remove(filename);
+            success = (std::rename(temp.c_str(), filename) == 0);
+        }
+        if (!success)
+            std::remove(temp.c_str());
+        return success;
+    }
+
+    inline bool EventTape::Load(const char* filename)
+    {
+        Clear();
+        if (!filename)
+            return false;
+
+        std::FILE* stream = std::fopen(filename, "rb");
+        if (!stream)
+            return false;
+
+        std::unique_ptr<detail::MappedFile> file(new detail::MappedFile);
+        if (file->Map(stream))
+        {
+            std::fclose(stream);
+            file_ = std::move(file);
+            data_ = file_->getData();
+            size_ = file_->getSize();
+        }
+        else
+        {
+            for (;;)
+            {
+                const std::size_t size = buffer_.size();
+                buffer_.resize(size + 64 * 1024);
+                const std::size_t count = std::fread(buffer_.data() + size, 1, 64 * 1024, stream);
+                buffer_.resize(size + count);
+                if (count == 0)
+                    break;
+            }
+            const bool error = (std::ferror(stream) != 0);
+            std::fclose(stream);
+            if (error)
+                return false;
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+        }
+
+        if (!Open())
+        {
+            Clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Checks the tape at data_, and rebuilds its path table.
+    inline bool EventTape::Open()
+    {
+        detail::TapeHeader header;
+        if (size_ < sizeof(header))
+            return false;
+        std::memcpy(&header, data_, sizeof(header));
+        if (std::memcmp(header.magic, detail::c_tapeMagic, sizeof(header.magic)) != 0
+            || header.byteOrder != detail::c_tapeByteOrder || header.version != detail::c_tapeVersion)
+            return false;
+
+        const std::size_t size = size_ - sizeof(header);
+        if (header.pathsSize > size || header.eventsSize != size - header.pathsSize || header.contentLength > SIZE_MAX
+            || header.pathCount == 0 || detail::TapeChecksum(header, data_ + sizeof(header), size) != header.checksum)
+            return false;
+
+        // The paths were interned in order of their ids, so interning them
+        // again in the same order gives them the same ids...
+        paths_.Clear();
+        const char* next = data_ + sizeof(header);
+        const char* const end = next + header.pathsSize;
+        for (std::uint32_t id = 1; id < header.pathCount; ++id)
+        {
+            std::uint32_t parent, length;
+            if (end - next < 8)
+                return false;
+            std::memcpy(&parent, next, 4);
+            std::memcpy(&length, next + 4, 4);
+            next += 8;
+            if (parent >= id || (std::size_t)(end - next) < length || paths_.Intern(parent, next, length) != id)
+                return false;
+            next += length;
+        }
+        if (next != end)
+            return false;
+
+        events_ = end;
+        eventsEnd_ = end + header.eventsSize;
+        contentHash_ = header.contentHash;
+        contentLength_ = (std::size_t)header.contentLength;
+        line_ = (int)header.line;
+        column_ = (int)header.column;
+        return true;
+    }
+
+    inline void EventTape::Clear()
+    {
+        line_ = 0;
+        column_ = 0;
+        buffer_.clear();
+        file_.reset();
+        data_ = nullptr;
+        size_ = 0;
+        events_ = nullptr;
+        eventsEnd_ = nullptr;
+        contentHash_ = 0;
+        contentLength_ = 0;
+        paths_.Clear();
+    }
+
+    inline std::string TapeCache::getFilename(const char* json, std::size_t length) const
+    {
+        return getFilename(EventTape::HashContent(json, length), length);
+    }
+
+    inline std::string TapeCache::getFilename(std::uint64_t hash, std::size_t length) const
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "%016llx-%llx%s.tape", (unsigned long long)hash, (unsigned long long)length,
+            (utf8Mode_ == Parser::UTF8Mode::Checked ? "-utf8" : ""));
+
+        std::string filename = directory_;
+        if (!filename.empty() && filename.back() != '/' && filename.back() != '\\')
+            filename += '/';
+        return filename + name;
+    }
+
+    inline bool TapeCache::Parse(const char* json, std::size_t length, Parser::Callbacks& callbacks)
+    {
+        hit_ = false;
+        line_ = 0;
+        column_ = 0;
+        if (!json)
+            return false;
+
+        const std::uint64_t hash = EventTape::HashContent(json, length);
+        const std::string filename = getFilename(hash, length);
+        EventTape tape;
+        if (tape.Load(filename.c_str()) && tape.getContentHash() == hash && tape.getContentLength() == length)
+        {
+            hit_ = true;
+            tape.Replay(callbacks, pathTable_);
+            line_ = tape.getLine();
+            column_ = tape.getColumn();
+            return true;
+        }
+
+        tape.setUTF8Mode(utf8Mode_);
+        if (!tape.Record(json, length))
+        {
+            // Parse it again, to invoke the callbacks up to the error...
+            Parser parser;
+            parser.setUTF8Mode(utf8Mode_);
+            parser.setPathTable(pathTable_);
+            const bool success = parser.Parse(json, length, callbacks);
+            line_ = parser.getLine();
+            column_ = parser.getColumn();
+            return success;
+        }
+
+        tape.Replay(callbacks, pathTable_);
+        line_ = tape.getLine();
+        column_ = tape.getColumn();
+        tape.Save(filename.c_str()); //if this fails, it's simply parsed next time
+        return true;
+    }
+
+    inline bool TapeCache::ParseFile(const char* filename, Parser::Callbacks& callbacks)
+    {
+        hit_ = false;
+        line_ = 0;
+        column_ = 0;
+        if (!filename)
+            return false;
+
+        std::FILE* file = std::fopen(filename, "rb");
+        if (!file)
+            return false;
+
+        detail::MappedFile mapped;
+        if (mapped.Map(file))
+        {
+            std::fclose(file);
+            return Parse(mapped.getData(), mapped.getSize(), callbacks);
+        }
+
+        std::vector<char> buffer;
+        for (;;)
+        {
+            const std::size_t size = buffer.size();
+            buffer.resize(size + 64 * 1024);
+            const std::size_t count = std::fread(buffer.data() + size, 1, 64 * 1024, file);
+            buffer.resize(size + count);
+            if (count == 0)
+                break;
+        }
+        const bool error = (std::ferror(file) != 0);
+        std::fclose(file);
+        if (error)
+            return false;
+        return Parse(buffer.data(), buffer.size(), callbacks);
+    }
+}
+
+#endif //__CYOJSON_DETAIL_TAPE_HPP
@@ -0,0 +1,297 @@
+/*
+[CyoJSON] detail/transform.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_TRANSFORM_HPP
+#define __CYOJSON_DETAIL_TRANSFORM_HPP
+
+#include "simd.hpp"
+#include "structural.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // Writes a reformatted document into a string, which grows as needed
+        // (doubling, so it's only resized a few times) and is then trimmed.
+        class Reformatter
+        {
+        public:
+            Reformatter(const char* json, std::size_t length, std::string& out, int indent)
+                : next_(json),
+                end_(json + length),
+                out_(out),
+                indent_((std::size_t)indent),
+                scan_(GetScanFunctions())
+            {
+                assert(indent >= 0);
+            }
+
+            Reformatter(const Reformatter&) = delete;
+
+            void operator=(const Reformatter&) = delete;
+
+            void Run()
+            {
+                out_.resize(std::max<std::size_t>((std::size_t)(end_ - next_) * 2, 64));
+                size_ = 0;
+
+                while (SkipWhitespace())
+                {
+                    const char ch = *next_;
+                    switch (ch)
+                    {
+                    case '{':
+                    case '[':
+                        ++next_;
+                        if (SkipWhitespace() && *next_ == ch + 2) //'}' or ']'
+                        {
+                            ++next_;
+                            Put(ch);
+                            Put((char)(ch + 2));
+                        }
+                        else
+                        {
+                            Put(ch);
+                            ++depth_;
+                            NewLine();
+                        }
+                        break;
+
+                    case '}':
+                    case ']':
+                        ++next_;
+                        if (depth_ != 0)
+                            --depth_;
+                        NewLine();
+                        Put(ch);
+                        break;
+
+                    case ',':
+                        ++next_;
+                        Put(',');
+                        NewLine();
+                        break;
+
+                    case ':':
+                        ++next_;
+                        Put(':');
+                        Put(' ');
+                        break;
+
+                    case '\"':
+                        CopyString();
+                        break;
+
+                    default:
+                        CopyScalar();
+                        break;
+                    }
+                }
+
+                out_.resize(size_);
+            }
+
+        private:
+            const char* next_;
+            const char* const end_;
+            std::string& out_;
+            std::size_t size_ = 0;
+            const std::size_t indent_;
+            std::size_t depth_ = 0;
+            const ScanFunctions& scan_;
+
+            // Returns false at the end of the text.
+            bool SkipWhitespace()
+            {
+                while (next_ != end_ && IsWhitespace(*next_))
+                    ++next_;
+                return (next_ != end_);
+            }
+
+            char* Reserve(std::size_t length)
+            {
+                if (out_.size() - size_ < length)
+                    out_.resize(std::max(out_.size() * 2, size_ + length));
+                return &out_[size_];
+            }
+
+            void Put(char ch)
+            {
+                *Reserve(1) = ch;
+                ++size_;
+            }
+
+            void Append(const char* data, std::size_t length)
+            {
+                std::memcpy(Reserve(length), data, length);
+                size_ += length;
+            }
+
+            void NewLine()
+            {
+                const std::size_t spaces = depth_ * indent_;
+                char* out = Reserve(spaces + 1);
+                *out = '\n';
+                std::memset(out + 1, ' ', spaces);
+                size_ += spaces + 1;
+            }
+
+            // Copies a string (as it is, escapes and all), finding its closing
+            // quote with the same scan as when parsing it.
+            void CopyString()
+            {
+                const char* start = next_++;
+                while (next_ != end_)
+                {
+                    const char* special = scan_.FindStringSpecial(next_, end_);
+                    if (special == end_)
+                    {
+                        next_ = end_;
+                        break;
+                    }
+                    next_ = special + 1;
+                    if (*special == '\"')
+                        break;
+                    if (*special == '\\' && next_ != end_)
+                        ++next_; //the escaped char, which may be a quote
+                }
+                Append(start, (std::size_t)(next_ - start));
+            }
+
+            // Copies a number or literal (or anything else up to the next
+            // structural char or whitespace).
+            void CopyScalar()
+            {
+                const char* start = next_;
+                do
+                {
+                    ++next_;
+                }
+                while (next_ != end_ && !IsWhitespace(*next_) && *next_ != ',' && *next_ != ':'
+                    && *next_ != '}' && *next_ != ']' && *next_ != '{' && *next_ != '[' && *next_ != '\"');
+                Append(start, (std::size_t)(next_ - start));
+            }
+        };
+    }
+
+    inline std::size_t Minify(const char* json, std::size_t length, char* out)
+    {
+        // Classify each block of 64 chars, as for the structural index, and
+        // copy those that aren't whitespace outside a string...
+        const detail::ScanFunctions& scan = detail::GetScanFunctions();
+        std::uint64_t prevEscaped = 0;
+        std::uint64_t prevInString = 0;
+        char padded[64];
+        char* const begin = out;
+
+        for (std::size_t base = 0; base < length; base += 64)
+        {
+            const char* block = json + base;
+            const int count = (int)std::min<std::size_t>(length - base, 64);
+            if (count < 64)
+            {
+                std::memset(padded, ' ', sizeof(padded));
+                std::memcpy(padded, block, (std::size_t)count);
+                block = padded;
+            }
+
+            detail::BlockMasks masks;
+            scan.ClassifyBlock(block, masks);
+
+            std::uint64_t escaped = detail::FindEscaped(masks.backslash, prevEscaped);
+            std::uint64_t quotes = masks.quote & ~escaped;
+            std::uint64_t inString = detail::PrefixXor(quotes) ^ prevInString;
+            prevInString = (std::uint64_t)((std::int64_t)inString >> 63);
+
+            const std::uint64_t keep = ~(masks.whitespace & ~inString);
+            if (count < 64)
+            {
+                // (One at a time, so as not to write beyond the end.)
+                for (int i = 0; i < count; ++i)
+                {
+                    *out = block[i];
+                    out += (keep >> i) & 1;
+                }
+            }
+            else if (keep == ~(std::uint64_t)0)
+            {
+                // (memmove, as out may be json, up to 63 chars behind)
+                std::memmove(out, block, 64);
+                out += 64;
+            }
+            else
+            {
+                out = scan.CompactBlock(block, keep, out);
+            }
+        }
+        return (std::size_t)(out - begin);
+    }
+
+    inline void Minify(const char* json, std::size_t length, std::string& out)
+    {
+        out.resize(length);
+        out.resize(Minify(json, length, &out[0]));
+    }
+
+    inline void Reformat(const char* json, std::size_t length, std::string& out, int indent)
+    {
+        detail::Reformatter reformatter(json, length, out, indent);
+        reformatter.Run();
+    }
+
+    inline bool Parser::Minify(const char* json, std::size_t length, std::string& out)
+    {
+        out.clear();
+        if (!Validate(json, length))
+            return false;
+        cyojson::Minify(json, length, out);
+        return true;
+    }
+
+    inline bool Parser::Reformat(const char* json, std::size_t length, std::string& out, int indent)
+    {
+        out.clear();
+        if (!Validate(json, length))
+            return false;
+        cyojson::Reformat(json, length, out, indent);
+        return true;
+    }
+}
+
+#endif //__CYOJSON_DETAIL_TRANSFORM_HPP
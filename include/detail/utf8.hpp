@@ -28,8 +28,13 @@ SOFTWARE.
 #   error Do not #include this file!
 #endif
 
+#ifndef __CYOJSON_DETAIL_UTF8_HPP
+#define __CYOJSON_DETAIL_UTF8_HPP
+
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -38,59 +43,181 @@ namespace cyojson
 {
     namespace detail
     {
-        inline void OutputUTF8(std::string& out, std::uint16_t value)
+        // The value of a hex digit, or 0xFF if the char isn't one.
+        inline std::uint8_t HexDigit(char ch)
         {
-            if (value >= 0x800)
+            static const std::uint8_t c_digits[256] =
             {
-                // Output 3 bytes...
-                // (aaaabbbb bbcccccc => 1110aaaa 10bbbbbb 10cccccc)
-                std::uint16_t a = (value & 0xF0) >> 12;
-                out += (char)(0xE0 | a);
-                std::uint16_t b = (value & 0xFC) >> 6;
-                out += (char)(0x80 | b);
-                std::uint16_t c = (value & 0x3F);
-                out += (char)(0x80 | c);
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                   0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+            };
+            return c_digits[(unsigned char)ch];
+        }
+
+        // Encodes a code point (up to 0x10FFFF) as UTF-8, returning the number
+        // of bytes written (1 to 4).
+        inline int EncodeUTF8(char* out, std::uint32_t value)
+        {
+            assert(value <= 0x10FFFF);
+
+            if (value < 0x80)
+            {
+                // (0aaaaaaa)
+                out[0] = (char)value;
+                return 1;
             }
-            else if (value >= 0x80)
+            if (value < 0x800)
             {
-                // Output 2 bytes...
                 // (00000aaa aabbbbbb => 110aaaaa 10bbbbbb)
-                std::uint16_t a = (value & 0x7C) >> 6;
-                out += (char)(0xC0 | a);
-                std::uint16_t b = (value & 0x3F);
-                out += (char)(0x80 | b);
+                out[0] = (char)(0xC0 | (value >> 6));
+                out[1] = (char)(0x80 | (value & 0x3F));
+                return 2;
             }
-            else
+            if (value < 0x10000)
             {
-                // Output 1 byte...
-                // (ASCII char, 0-127)
-                out += (char)value;
+                // (aaaabbbb bbcccccc => 1110aaaa 10bbbbbb 10cccccc)
+                out[0] = (char)(0xE0 | (value >> 12));
+                out[1] = (char)(0x80 | ((value >> 6) & 0x3F));
+                out[2] = (char)(0x80 | (value & 0x3F));
+                return 3;
             }
+
+            // (000aaabb bbbbcccc ccdddddd => 11110aaa 10bbbbbb 10cccccc 10dddddd)
+            out[0] = (char)(0xF0 | (value >> 18));
+            out[1] = (char)(0x80 | ((value >> 12) & 0x3F));
+            out[2] = (char)(0x80 | ((value >> 6) & 0x3F));
+            out[3] = (char)(0x80 | (value & 0x3F));
+            return 4;
         }
 
-        inline void OutputUTF8(std::string& out, std::uint16_t highSurrogate, std::uint16_t lowSurrogate)
+        template <typename String>
+        inline void OutputUTF8(String& out, std::uint16_t value)
+        {
+            assert(value < 0xD800 || value > 0xDFFF);
+
+            char bytes[4];
+            out.append(bytes, (std::size_t)EncodeUTF8(bytes, value));
+        }
+
+        template <typename String>
+        inline void OutputUTF8(String& out, std::uint16_t highSurrogate, std::uint16_t lowSurrogate)
         {
             assert(0xD800 <= highSurrogate && highSurrogate <= 0xDBFF);
             assert(0xDC00 <= lowSurrogate && lowSurrogate <= 0xDFFF);
 
-            std::uint32_t value = 0;
-            value |= (highSurrogate & 0x07FF);
-            value <<= 10;
-            value |= (lowSurrogate & 0x03FF);
-            value += 0x10000;
-
-            assert(0x10000 <= value && value <= 0x10FFFF);
-
-            // Output 4 bytes...
-            // (00000000 000aaabb bbbbcccc ccdddddd => 11110aaa 10bbbbbb 10cccccc 10dddddd)
-            auto a = (value & 0x001C0000) >> 18;
-            out += (char)(0xF0 | a);
-            auto b = (value & 0x0003F000) >> 12;
-            out += (char)(0x80 | b);
-            auto c = (value & 0x00000FC0) >> 6;
-            out += (char)(0x80 | c);
-            auto d = (value & 0x0000003F);
-            out += (char)(0x80 | d);
+            std::uint32_t value = 0x10000 + (((std::uint32_t)(highSurrogate & 0x03FF) << 10) | (lowSurrogate & 0x03FF));
+
+            char bytes[4];
+            out.append(bytes, (std::size_t)EncodeUTF8(bytes, value));
+        }
+
+        // The length of a UTF-8 sequence starting with the given (non-ASCII)
+        // byte, and the range of its second byte; 0 if it can't start one.
+        // Together with the ranges, this excludes overlong forms, surrogates
+        // and values above 0x10FFFF.
+        inline int GetUTF8Length(unsigned char lead, unsigned char& min, unsigned char& max)
+        {
+            assert(lead >= 0x80);
+
+            min = 0x80;
+            max = 0xBF;
+            if (lead < 0xC2)
+                return 0; //a continuation byte, or an overlong 2-byte form
+            if (lead < 0xE0)
+                return 2;
+            if (lead < 0xF0)
+            {
+                if (lead == 0xE0)
+                    min = 0xA0; //overlong
+                else if (lead == 0xED)
+                    max = 0x9F; //surrogates
+                return 3;
+            }
+            if (lead < 0xF5)
+            {
+                if (lead == 0xF0)
+                    min = 0x90; //overlong
+                else if (lead == 0xF4)
+                    max = 0x8F; //above 0x10FFFF
+                return 4;
+            }
+            return 0;
+        }
+
+        // Checks the UTF-8 sequence at next, whose first byte isn't ASCII. If
+        // it's valid, returns the byte after it; otherwise sets valid to false
+        // and returns the first byte that makes it invalid, which is end if
+        // the sequence is incomplete.
+        inline const char* CheckUTF8Sequence(const char* next, const char* end, bool& valid)
+        {
+            unsigned char min, max;
+            const int length = GetUTF8Length((unsigned char)*next, min, max);
+
+            valid = false;
+            if (length == 0)
+                return next;
+
+            for (int i = 1; i < length; ++i)
+            {
+                if (next + i == end)
+                    return end;
+                const unsigned char ch = (unsigned char)next[i];
+                if (ch < min || ch > max)
+                    return next + i;
+                min = 0x80;
+                max = 0xBF;
+            }
+
+            valid = true;
+            return next + length;
+        }
+
+        // Returns the first byte from next to end at which the text stops
+        // being valid UTF-8 (end if its last sequence is incomplete), or
+        // nullptr if it's all valid.
+        inline const char* FindInvalidUTF8Scalar(const char* next, const char* end)
+        {
+            while (next != end)
+            {
+                // Skip ASCII, 8 bytes at a time where possible...
+                if (end - next >= 8)
+                {
+                    std::uint64_t bytes;
+                    std::memcpy(&bytes, next, 8);
+                    if ((bytes & 0x8080808080808080ull) == 0)
+                    {
+                        next += 8;
+                        continue;
+                    }
+                }
+                if ((unsigned char)*next < 0x80)
+                {
+                    ++next;
+                    continue;
+                }
+
+                bool valid;
+                next = CheckUTF8Sequence(next, end, valid);
+                if (!valid)
+                    return next;
+            }
+            return nullptr;
         }
     }
 }
+
+#endif //__CYOJSON_DETAIL_UTF8_HPP
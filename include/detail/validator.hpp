@@ -0,0 +1,270 @@
+/*
+[CyoJSON] detail/validator.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_VALIDATOR_HPP
+#define __CYOJSON_DETAIL_VALIDATOR_HPP
+
+#include "scanner.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // The engine behind Parser::Validate: the grammar of ParserImpl, and
+        // its error positions, but with no events, no path, and strings that
+        // are checked in place rather than unescaped.
+        class Validator final : private Scanner
+        {
+        public:
+            Validator(const char* next, const char* end, BufferString& scratch)
+                : Scanner(next, end, scratch)
+            {
+            }
+
+            Validator(const Validator&) = delete;
+
+            void operator=(const Validator&) = delete;
+
+            void setUTF8Mode(Parser::UTF8Mode mode)
+            {
+                checkUTF8_ = (mode == Parser::UTF8Mode::Checked);
+            }
+
+            // Counts the statistics, as for ParserImpl (if c_statistics).
+            void setStatistics(Parser::Statistics* stats)
+            {
+                stats_ = stats;
+            }
+
+            bool Validate(int& line, int& column)
+            {
+                const char* const start = next_;
+                bool success = (IsNext('{') && ValidateObject());
+                if (success)
+                {
+                    SkipWhitespace();
+                    success = IsEnd();
+                }
+
+                line = line_;
+                column = column_;
+                if (c_statistics && stats_)
+                    stats_->bytes += (std::size_t)(next_ - start);
+                return success;
+            }
+
+        private:
+            // Each of these starts after the opening char...
+
+            bool ValidateObject()
+            {
+                Count(&Parser::Statistics::objects);
+                CountNested();
+
+                if (!IsNext('}'))
+                {
+                    do
+                    {
+                        if (!IsNext('\"') || !ValidateString())
+                            return false;
+                        Count(&Parser::Statistics::keys);
+                        if (!IsNext(':') || !ValidateValue())
+                            return false;
+                    }
+                    while (IsNext(','));
+
+                    if (!IsNext('}'))
+                        return false;
+                }
+
+                EndNested();
+                return true;
+            }
+
+            bool ValidateArray()
+            {
+                Count(&Parser::Statistics::arrays);
+                CountNested();
+
+                if (!IsNext(']'))
+                {
+                    do
+                    {
+                        if (!ValidateValue())
+                            return false;
+                    }
+                    while (IsNext(','));
+
+                    if (!IsNext(']'))
+                        return false;
+                }
+
+                EndNested();
+                return true;
+            }
+
+            bool ValidateString()
+            {
+                bool escaped = false;
+                for (;;)
+                {
+                    const char* const run = next_;
+                    SkipStringChars();
+                    if (!CheckUTF8(run))
+                        return false;
+
+                    switch (CurrChar())
+                    {
+                    case '\"':
+                        NextChar();
+                        if (escaped)
+                            Count(&Parser::Statistics::unescapedStrings);
+                        return true;
+
+                    case '\\':
+                        NextChar();
+                        if (!ValidateEscape())
+                            return false;
+                        escaped = true;
+                        continue;
+
+                    default:
+                        return false; //control char, or unterminated string
+                    }
+                }
+            }
+
+            bool ValidateEscape()
+            {
+                switch (CurrChar())
+                {
+                case '\"':
+                case '\\':
+                case '/':
+                case 'b':
+                case 'f':
+                case 'n':
+                case 'r':
+                case 't':
+                    NextChar();
+                    return true;
+
+                case 'u':
+                {
+                    std::uint16_t value, lowSurrogate;
+                    return SkipUnicode(value, lowSurrogate);
+                }
+
+                default:
+                    return false;
+                }
+            }
+
+            bool ValidateValue()
+            {
+                SkipWhitespace();
+
+                switch (CurrChar())
+                {
+                case '{':
+                    NextChar();
+                    return ValidateObject();
+
+                case '[':
+                    NextChar();
+                    return ValidateArray();
+
+                case '\"':
+                    NextChar();
+                    if (!ValidateString())
+                        return false;
+                    Count(&Parser::Statistics::strings);
+                    return true;
+
+                case 't':
+                    if (!IsNext(c_true, false))
+                        return false;
+                    Count(&Parser::Statistics::bools);
+                    return true;
+
+                case 'f':
+                    if (!IsNext(c_false, false))
+                        return false;
+                    Count(&Parser::Statistics::bools);
+                    return true;
+
+                case 'n':
+                    if (!IsNext(c_null, false))
+                        return false;
+                    Count(&Parser::Statistics::nulls);
+                    return true;
+
+                default:
+                    if (!SkipNumber())
+                        return false;
+                    Count(&Parser::Statistics::numbers);
+                    return true;
+                }
+            }
+        };
+    }
+
+    inline bool Parser::Validate(const char* json)
+    {
+        return ValidateWith(json, nullptr);
+    }
+
+    inline bool Parser::Validate(const char* json, std::size_t length)
+    {
+        return ValidateWith(json, json + length);
+    }
+
+    inline bool Parser::ValidateWith(const char* json, const char* end)
+    {
+        statistics_ = Statistics();
+        stopped_ = false;
+        if (!json)
+            return false;
+
+        detail::StatisticsTimer timer(statistics_);
+        detail::BufferString scratch; //never used, as nothing is unescaped
+        detail::Validator validator(json, end, scratch);
+        validator.setStatistics(detail::c_statistics ? &statistics_ : nullptr);
+        validator.setUTF8Mode(utf8Mode_);
+        return validator.Validate(line_, column_);
+    }
+}
+
+#endif //__CYOJSON_DETAIL_VALIDATOR_HPP
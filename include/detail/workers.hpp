@@ -0,0 +1,298 @@
+/*
+[CyoJSON] detail/workers.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+#ifndef __CYOJSON_DETAIL_WORKERS_HPP
+#define __CYOJSON_DETAIL_WORKERS_HPP
+
+#include "recorder.hpp"
+
+#ifndef CYOJSON_NO_THREADS
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        // The input is parsed in parallel in chunks of (about) this size.
+        const std::size_t c_chunkSize = 1024 * 1024;
+
+        class ChunkWorkers;
+
+        // The threads that parse chunks of the input, and the chunks they
+        // parse into, which a Parser keeps from one parse to the next, so once
+        // there are enough of them, a parallel parse doesn't start threads or
+        // allocate. At most two chunks per thread are held at once. It runs a
+        // single ChunkWorkers at a time, from Start() until Stop().
+        class WorkerPool
+        {
+        public:
+            struct Chunk
+            {
+                explicit Chunk(Allocator* allocator) : buffers(allocator) { }
+
+                std::size_t index;
+                const char* begin;
+                const char* end;
+                bool success;
+                int line; //the position at which the parse stopped
+                int column;
+                EventRecorder recorder;
+                ParserBuffers buffers;
+                Parser::Statistics statistics; //if c_statistics
+            };
+
+            explicit WorkerPool(Allocator* allocator)
+                : allocator_(allocator)
+            {
+            }
+
+            WorkerPool(const WorkerPool&) = delete;
+
+            void operator=(const WorkerPool&) = delete;
+
+            ~WorkerPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    closing_ = true;
+                    changed_.notify_all();
+                }
+                for (auto& thread : threads_)
+                    thread.join();
+            }
+
+            // Has the given number of threads run the workers' Claim() and
+            // ParseChunk(), starting more threads if there aren't enough.
+            void Start(ChunkWorkers& workers, bool ordered, unsigned threads)
+            {
+                while (chunks_.size() < 2 * threads)
+                    chunks_.emplace_back(new Chunk(allocator_));
+                free_.reserve(chunks_.size());
+                parsed_.reserve(chunks_.size());
+                while (threads_.size() < threads)
+                    threads_.emplace_back(&WorkerPool::Run, this);
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                workers_ = &workers;
+                ordered_ = ordered;
+                free_.clear();
+                for (unsigned i = 0; i < 2 * threads; ++i)
+                    free_.push_back(chunks_[i].get());
+                parsed_.clear();
+                claimed_ = 0;
+                delivered_ = 0;
+                claimedAll_ = false;
+                stopping_ = false;
+                starting_ = threads;
+                changed_.notify_all();
+            }
+
+            // Waits for the next chunk to deliver, returning nullptr once they
+            // have all been delivered. Pass the chunk to Release() afterwards.
+            Chunk* NextParsed()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                for (;;)
+                {
+                    for (std::size_t i = 0; i < parsed_.size(); ++i)
+                    {
+                        Chunk* chunk = parsed_[i];
+                        if (!ordered_ || chunk->index == delivered_)
+                        {
+                            parsed_.erase(parsed_.begin() + (std::ptrdiff_t)i);
+                            ++delivered_;
+                            return chunk;
+                        }
+                    }
+                    if ((claimedAll_ || stopping_) && delivered_ == claimed_)
+                        return nullptr;
+                    changed_.wait(lock);
+                }
+            }
+
+            void Release(Chunk* chunk)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                free_.push_back(chunk);
+                changed_.notify_all();
+            }
+
+            // Waits for the threads to finish the chunks they're parsing, and
+            // abandons the rest.
+            void Stop()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                stopping_ = true;
+                starting_ = 0;
+                changed_.notify_all();
+                while (running_ != 0)
+                    changed_.wait(lock);
+                workers_ = nullptr;
+            }
+
+        private:
+            Allocator* const allocator_;
+            std::vector<std::thread> threads_;
+            std::vector<std::unique_ptr<Chunk>> chunks_;
+
+            std::mutex mutex_;
+            std::condition_variable changed_;
+            ChunkWorkers* workers_ = nullptr;
+            bool ordered_ = true;
+            std::vector<Chunk*> free_;
+            std::vector<Chunk*> parsed_;
+            std::size_t claimed_ = 0;   //chunks taken by the threads
+            std::size_t delivered_ = 0; //chunks delivered
+            bool claimedAll_ = false;
+            bool stopping_ = false;
+            bool closing_ = false;      //the pool is being destroyed
+            unsigned starting_ = 0;     //threads yet to join in the work
+            unsigned running_ = 0;      //threads doing the work
+
+            void Run()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                for (;;)
+                {
+                    while (!closing_ && starting_ == 0)
+                        changed_.wait(lock);
+                    if (closing_)
+                        return;
+
+                    --starting_;
+                    ++running_;
+                    Work(lock);
+                    --running_;
+                    changed_.notify_all();
+                }
+            }
+
+            void Work(std::unique_lock<std::mutex>& lock);
+        };
+
+        // Parses chunks of the input on the threads of a WorkerPool, recording
+        // their events, while the calling thread delivers them. A derived
+        // class says how the input is divided into chunks (Claim) and how each
+        // is parsed (ParseChunk), and must call Stop() in its destructor.
+        class ChunkWorkers
+        {
+        public:
+            typedef WorkerPool::Chunk Chunk;
+
+            ChunkWorkers(const ChunkWorkers&) = delete;
+
+            void operator=(const ChunkWorkers&) = delete;
+
+            void Start(WorkerPool& pool, unsigned threads)
+            {
+                pool_ = &pool;
+                pool.Start(*this, ordered_, threads);
+            }
+
+            // Waits for the next chunk to deliver, returning nullptr once they
+            // have all been delivered. Pass the chunk to Release() afterwards.
+            Chunk* NextParsed() { return (pool_ ? pool_->NextParsed() : nullptr); }
+
+            void Release(Chunk* chunk) { pool_->Release(chunk); }
+
+            // Waits for the workers to finish the chunks they're parsing, and
+            // abandons the rest.
+            void Stop()
+            {
+                if (pool_)
+                    pool_->Stop();
+                pool_ = nullptr;
+            }
+
+        protected:
+            explicit ChunkWorkers(bool ordered)
+                : ordered_(ordered)
+            {
+            }
+
+            ~ChunkWorkers() = default;
+
+            // Sets the begin and end of the next chunk, returning false if
+            // there are none left. Called with the pool's lock held.
+            virtual bool Claim(Chunk& chunk) = 0;
+
+            // Parses the chunk into its recorder, setting success.
+            virtual void ParseChunk(Chunk& chunk) = 0;
+
+        private:
+            friend class WorkerPool;
+
+            const bool ordered_;
+            WorkerPool* pool_ = nullptr;
+        };
+
+        // Claims chunks and parses them, until they're all claimed or the
+        // pool is stopped. Called with the lock held.
+        inline void WorkerPool::Work(std::unique_lock<std::mutex>& lock)
+        {
+            for (;;)
+            {
+                while (!stopping_ && !claimedAll_ && free_.empty())
+                    changed_.wait(lock);
+                if (stopping_ || claimedAll_)
+                    return;
+
+                Chunk* chunk = free_.back();
+                if (!workers_->Claim(*chunk))
+                {
+                    claimedAll_ = true;
+                    changed_.notify_all();
+                    return;
+                }
+                free_.pop_back();
+                chunk->index = claimed_++;
+
+                ChunkWorkers* const workers = workers_;
+                lock.unlock();
+                workers->ParseChunk(*chunk);
+                lock.lock();
+
+                parsed_.push_back(chunk);
+                changed_.notify_all();
+            }
+        }
+    }
+}
+
+#endif //CYOJSON_NO_THREADS
+
+#endif //__CYOJSON_DETAIL_WORKERS_HPP
@@ -0,0 +1,337 @@
+/*
+[CyoJSON] detail/writer.hpp
+
+The MIT License (MIT)
+
+Copyright (c) 2016 Graham Bull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CYOJSON_HPP
+#   error Do not #include this file!
+#endif
+
+#ifndef __CYOJSON_DETAIL_WRITER_HPP
+#define __CYOJSON_DETAIL_WRITER_HPP
+
+#include "format.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace cyojson
+{
+    namespace detail
+    {
+        const std::size_t c_writerInitialSize = 256;
+        const std::size_t c_writerSinkSize = 64 * 1024;
+
+        // The two-char escape of a char that IsStringSpecial, if it has one
+        // (e.g. \n); otherwise nullptr, and it's written as \u00XX.
+        inline const char* GetShortEscape(char ch)
+        {
+            switch (ch)
+            {
+            case '\"': return "\\\"";
+            case '\\': return "\\\\";
+            case '\b': return "\\b";
+            case '\f': return "\\f";
+            case '\n': return "\\n";
+            case '\r': return "\\r";
+            case '\t': return "\\t";
+            default: return nullptr;
+            }
+        }
+    }
+
+    inline Writer::Writer(Allocator* allocator)
+        : sink_(nullptr),
+        allocator_(allocator)
+    {
+    }
+
+    inline Writer::Writer(Sink& sink, Allocator* allocator)
+        : sink_(&sink),
+        allocator_(allocator)
+    {
+    }
+
+    inline Writer::~Writer()
+    {
+        Flush();
+        if (buffer_)
+        {
+            if (allocator_)
+                allocator_->Deallocate(buffer_, capacity_);
+            else
+                ::operator delete(buffer_);
+        }
+    }
+
+    inline void Writer::Flush()
+    {
+        if (sink_ && size_ != 0)
+        {
+            sink_->Write(buffer_, size_);
+            size_ = 0;
+        }
+    }
+
+    inline void Writer::Clear()
+    {
+        size_ = 0;
+        comma_ = false;
+    }
+
+    // Returns where to write the given number of chars; the caller then sets
+    // size_ to the end of what it wrote.
+    inline char* Writer::Reserve(std::size_t length)
+    {
+        if (capacity_ - size_ < length)
+            Grow(length);
+        return buffer_ + size_;
+    }
+
+    inline void Writer::Grow(std::size_t length)
+    {
+        // With a sink, the buffer only grows from empty (or if a single
+        // write is larger than it)...
+        if (sink_)
+        {
+            Flush();
+            if (capacity_ >= length)
+                return;
+        }
+
+        std::size_t capacity = (capacity_ != 0 ? capacity_ * 2 : (sink_ ? detail::c_writerSinkSize : detail::c_writerInitialSize));
+        while (capacity - size_ < length)
+            capacity *= 2;
+
+        char* buffer = static_cast<char*>(allocator_ ? allocator_->Allocate(capacity) : ::operator new(capacity));
+        if (buffer_)
+        {
+            std::memcpy(buffer, buffer_, size_);
+            if (allocator_)
+                allocator_->Deallocate(buffer_, capacity_);
+            else
+                ::operator delete(buffer_);
+        }
+        buffer_ = buffer;
+        capacity_ = capacity;
+    }
+
+    inline void Writer::Append(const char* data, std::size_t length)
+    {
+        if (capacity_ - size_ < length)
+        {
+            // Pass a large piece straight to the sink, rather than copying it...
+            if (sink_ && capacity_ != 0 && length > capacity_ / 2)
+            {
+                Flush();
+                sink_->Write(data, length);
+                return;
+            }
+            Grow(length);
+        }
+        std::memcpy(buffer_ + size_, data, length);
+        size_ += length;
+    }
+
+    // Reserves room for a value (or key) and the comma before it, if needed.
+    inline char* Writer::StartValue(std::size_t length)
+    {
+        char* out = Reserve(length + 1);
+        if (comma_)
+            *out++ = ',';
+        return out;
+    }
+
+    inline void Writer::WriteString(const char* value, std::size_t length)
+    {
+        char* out = Reserve(1);
+        *out = '\"';
+        ++size_;
+
+        // Copy the runs between the chars that need escaping, which are
+        // found by the same scan as when parsing a string...
+        const detail::ScanFunctions& scan = detail::GetScanFunctions();
+        const char* next = value;
+        const char* const end = value + length;
+        while (next != end)
+        {
+            const char* special = scan.FindStringSpecial(next, end);
+            if (special != next)
+                Append(next, (std::size_t)(special - next));
+            if (special == end)
+                break;
+
+            out = Reserve(6);
+            if (const char* escape = detail::GetShortEscape(*special))
+            {
+                out[0] = escape[0];
+                out[1] = escape[1];
+                size_ += 2;
+            }
+            else
+            {
+                static const char c_hexDigits[] = "0123456789abcdef";
+                std::memcpy(out, "\\u00", 4);
+                out[4] = c_hexDigits[(unsigned char)*special >> 4];
+                out[5] = c_hexDigits[(unsigned char)*special & 0xF];
+                size_ += 6;
+            }
+            next = special + 1;
+        }
+
+        out = Reserve(1);
+        *out = '\"';
+        ++size_;
+    }
+
+    inline void Writer::ObjectStart()
+    {
+        char* out = StartValue(1);
+        *out++ = '{';
+        size_ = (std::size_t)(out - buffer_);
+        comma_ = false;
+    }
+
+    inline void Writer::ObjectEnd()
+    {
+        char* out = Reserve(1);
+        *out = '}';
+        ++size_;
+        comma_ = true;
+    }
+
+    inline void Writer::ArrayStart()
+    {
+        char* out = StartValue(1);
+        *out++ = '[';
+        size_ = (std::size_t)(out - buffer_);
+        comma_ = false;
+    }
+
+    inline void Writer::ArrayEnd()
+    {
+        char* out = Reserve(1);
+        *out = ']';
+        ++size_;
+        comma_ = true;
+    }
+
+    inline void Writer::Key(const char* key, std::size_t length)
+    {
+        size_ = (std::size_t)(StartValue(0) - buffer_);
+        WriteString(key, length);
+        char* out = Reserve(1);
+        *out = ':';
+        ++size_;
+        comma_ = false;
+    }
+
+    inline void Writer::Key(const char* key)
+    {
+        Key(key, std::strlen(key));
+    }
+
+    inline void Writer::String(const char* value, std::size_t length)
+    {
+        size_ = (std::size_t)(StartValue(0) - buffer_);
+        WriteString(value, length);
+        comma_ = true;
+    }
+
+    inline void Writer::String(const char* value)
+    {
+        String(value, std::strlen(value));
+    }
+
+    inline void Writer::Int64(std::int64_t value)
+    {
+        char* out = StartValue(detail::c_maxNumberLength);
+        size_ = (std::size_t)(detail::FormatInt64(value, out) - buffer_);
+        comma_ = true;
+    }
+
+    inline void Writer::UInt64(std::uint64_t value)
+    {
+        char* out = StartValue(detail::c_maxNumberLength);
+        size_ = (std::size_t)(detail::FormatUInt64(value, out) - buffer_);
+        comma_ = true;
+    }
+
+    inline void Writer::Double(double value)
+    {
+        if (!std::isfinite(value))
+        {
+            Null();
+            return;
+        }
+
+        char* out = StartValue(detail::c_maxNumberLength);
+        size_ = (std::size_t)(detail::FormatDouble(value, out) - buffer_);
+        comma_ = true;
+    }
+
+    inline void Writer::Bool(bool value)
+    {
+        char* out = StartValue(5);
+        if (value)
+        {
+            std::memcpy(out, "true", 4);
+            out += 4;
+        }
+        else
+        {
+            std::memcpy(out, "false", 5);
+            out += 5;
+        }
+        size_ = (std::size_t)(out - buffer_);
+        comma_ = true;
+    }
+
+    inline void Writer::Null()
+    {
+        char* out = StartValue(4);
+        std::memcpy(out, "null", 4);
+        size_ = (std::size_t)(out + 4 - buffer_);
+        comma_ = true;
+    }
+
+    inline void Writer::Number(const char* text, std::size_t length)
+    {
+        if (comma_)
+        {
+            char* out = Reserve(1);
+            *out = ',';
+            ++size_;
+        }
+        Append(text, length);
+        comma_ = true;
+    }
+}
+
+#endif //__CYOJSON_DETAIL_WRITER_HPP
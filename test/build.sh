@@ -1 +1,3 @@
-g++ test.cpp -o runtest -I../include --std=c++14
+g++ test.cpp -o runtest -I../include --std=c++14 -O2 -pthread
+g++ test.cpp -o runtest-nosimd -I../include --std=c++14 -O2 -pthread -DCYOJSON_NO_SIMD
+g++ test.cpp -o runtest-statistics -I../include --std=c++14 -O2 -pthread -DCYOJSON_STATISTICS
@@ -26,13 +26,2203 @@ SOFTWARE.
 
 #include "cyojson.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#else
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
 using namespace cyojson;
 
+struct Ranges
+{
+    std::uint8_t small = 0;
+    std::int16_t medium = 0;
+    int integer = 0;
+    unsigned count = 0;
+    std::int64_t large = 0;
+    std::uint64_t huge = 0;
+    double real = 0;
+    float single = 0;
+    bool flag = false;
+    std::string name;
+    std::vector<int> values;
+};
+
+CYOJSON_FIELDS(Ranges, small, medium, integer, count, large, huge, real, single, flag, name, values)
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    int g_failures = 0;
+
+    void Check(bool condition, const char* what, const std::string& detail = std::string())
+    {
+        if (condition)
+            return;
+        ++g_failures;
+        std::printf("FAILED: %s%s%s\n", what, (detail.empty() ? "" : ": "), detail.c_str());
+    }
+
+    // Records each event as a line of text, with its path.
+    class EventLog : public Parser::RecordCallbacks
+    {
+    public:
+        std::vector<std::string> events;
+
+        void ObjectStart(const char* path) override { Add("{", path); }
+        void ObjectEnd(const char* path) override { Add("}", path); }
+        void ArrayStart(const char* path) override { Add("[", path); }
+        void ArrayEnd(const char* path) override { Add("]", path); }
+        void Key(const char* path, const char* key, std::size_t length) override { Add("key", path, std::string(key, length)); }
+        void String(const char* path, const char* value, std::size_t length) override { Add("string", path, std::string(value, length)); }
+        void Number(const char* path, const char* value, std::size_t length) override { Add("number", path, std::string(value, length)); }
+        void Bool(const char* path, bool value) override { Add("bool", path, (value ? "true" : "false")); }
+        void Null(const char* path) override { Add("null", path); }
+        void RecordStart(std::size_t offset) override { Add("record", std::to_string(offset).c_str()); }
+        void RecordEnd(std::size_t offset) override { Add("end", std::to_string(offset).c_str()); }
+        void RecordError(std::size_t offset, int line, int column) override { Add("error", std::to_string(offset).c_str(), Position(line, column)); }
+
+        static std::string Position(int line, int column)
+        {
+            return std::to_string(line) + ":" + std::to_string(column);
+        }
+
+    protected:
+        void Add(const char* event, const char* path)
+        {
+            events.push_back(std::string(event) + " " + path);
+        }
+
+        void Add(const char* event, const char* path, const std::string& value)
+        {
+            events.push_back(std::string(event) + " " + path + " = " + value);
+        }
+    };
+
+    std::string Event(const std::vector<std::string>& events, std::size_t index)
+    {
+        return index < events.size() ? events[index] : "(none)";
+    }
+
+    // Reports the first event that differs, rather than all of them.
+    void CheckEvents(const EventLog& actual, const EventLog& expected, const char* what)
+    {
+        if (actual.events == expected.events)
+            return;
+        std::size_t index = 0;
+        while (index < actual.events.size() && index < expected.events.size() && actual.events[index] == expected.events[index])
+            ++index;
+        Check(false, what, "event " + std::to_string(index) + " is \"" + Event(actual.events, index)
+            + "\" instead of \"" + Event(expected.events, index) + "\"");
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Valid and invalid documents, with errors in every kind of token.
+    const char* const c_documents[] = {
+        "{}",
+        "{ \"a\" : [ ] , \"b\" : { } }",
+        "{\"a\":\"x\\\"y\\\\z\\/\\b\\f\\n\\r\\t\",\"b\":\"\\u00e9\\u20AC\\uD83D\\uDE00\"}",
+        "{\"n\":[0,-0,1,-1,1.5,-1.5e3,2E-2,9223372036854775807,-9223372036854775808,18446744073709551615,18446744073709551616,1e400]}",
+        "{\"t\":true,\"f\":false,\"z\":null,\"o\":{\"a\":{\"b\":[[],[{}],[1,[2,[3]]]]}}}",
+        "\r\n{\t\"a\"\n:\r\n\"b\"\n,\n\"c\":[\n1\n,\n2\n]\n}\n",
+        "[1,{\"a\":[true,false,null]},\"x\",[]]",
+        "{\"a\":[1,2,]}",
+        "{\"a\":1,}",
+        "{\"a\" 1}",
+        "{\"a\":tru}",
+        "{\"a\":nul,\"b\":1}",
+        "{\"a\":\"x}",
+        "{\"a\":\"x\ty\"}",
+        "{\"a\":\"\\q\"}",
+        "{\"a\":\"\\u12G4\"}",
+        "{\"a\":01}",
+        "{\"a\":-}",
+        "{\"a\":1.}",
+        "{\"a\":1e}",
+        "{\"a\":[1 2]}",
+        "{\"a\":{\"b\":1}]",
+        "{\"a\":1}x",
+        "{\"a\":1} {}",
+        "{\"a\":\n[\n1,\n2\n}",
+        "{\"a\":[",
+        "{\"a\"",
+        "",
+        "   ",
+        "{\"a\":truex}",
+        "{\"b\":184",
+        "{\"b\":12.5e3",
+        "{\"b\":[-0",
+        "{\"b\":1.",
+        "{\"b\":1e+",
+        "{\"b\":-",
+        "{\"b\":\"x\"",
+        "{\"b\":nu"
+    };
+
+    struct Outcome
+    {
+        bool success = false;
+        int line = 0;
+        int column = 0;
+
+        Outcome() = default;
+
+        template <typename T>
+        Outcome(bool succeeded, const T& parser)
+            : success(succeeded),
+            line(parser.getLine()),
+            column(parser.getColumn())
+        {
+        }
+
+        bool operator==(const Outcome& other) const
+        {
+            return (success == other.success && line == other.line && column == other.column);
+        }
+
+        std::string ToString() const
+        {
+            return (success ? "success at " : "failure at ") + EventLog::Position(line, column);
+        }
+    };
+
+    void CheckOutcome(const Outcome& actual, const Outcome& expected, const char* what, const char* json)
+    {
+        if (!(actual == expected))
+            Check(false, what, std::string(json) + ": " + actual.ToString() + " instead of " + expected.ToString());
+    }
+
+    // Feeds the text to a StreamParser in pieces of the given size.
+    Outcome ParseStream(const std::string& json, std::size_t pieceSize, Parser::Callbacks& callbacks)
+    {
+        StreamParser parser(callbacks);
+        bool success = true;
+        for (std::size_t offset = 0; success && offset < json.size(); offset += pieceSize)
+            success = parser.Feed(json.data() + offset, std::min(pieceSize, json.size() - offset));
+        success = (success && parser.Finish());
+        return Outcome(success, parser);
+    }
+
+    // Every way of parsing a document delivers the same events, and succeeds
+    // or fails at the same place.
+    void TestEngines()
+    {
+        for (const char* json : c_documents)
+        {
+            const std::string text = json;
+            Parser parser;
+            EventLog expected;
+            const Outcome outcome(parser.Parse(json, expected), parser);
+
+            Parser structural;
+            structural.setEngine(Parser::Engine::StructuralIndex);
+            EventLog indexed;
+            CheckOutcome(Outcome(structural.Parse(json, indexed), structural), outcome, "engines: structural outcome", json);
+            CheckEvents(indexed, expected, "engines: structural events");
+
+            EventLog bounded;
+            CheckOutcome(Outcome(parser.Parse(text.data(), text.size(), bounded), parser), outcome, "engines: bounded outcome", json);
+            CheckEvents(bounded, expected, "engines: bounded events");
+
+            Parser validator;
+            CheckOutcome(Outcome(validator.Validate(json), validator), outcome, "engines: validate outcome", json);
+            CheckOutcome(Outcome(validator.Validate(text.data(), text.size()), validator), outcome, "engines: bounded validate outcome", json);
+
+            for (std::size_t size : { 1, 2, 7, 1024 })
+            {
+                EventLog streamed;
+                CheckOutcome(ParseStream(text, size, streamed), outcome, "engines: stream outcome", json);
+                CheckEvents(streamed, expected, "engines: stream events");
+
+                std::istringstream in(text);
+                StreamSource source(in);
+                Parser reader;
+                reader.setBlockSize(size);
+                reader.setReadAhead(size == 7);
+                EventLog read;
+                CheckOutcome(Outcome(reader.Parse(source, read), reader), outcome, "engines: source outcome", json);
+                CheckEvents(read, expected, "engines: source events");
+            }
+        }
+    }
+
+    // Escapes are transcoded to UTF-8, and an invalid surrogate fails at its
+    // last hex digit (or wherever the pair is broken), as StreamParser and
+    // Validate agree.
+    void TestUnicodeEscapes()
+    {
+        struct Case { const char* json; const char* value; int column; };
+        const Case cases[] = {
+            { "{\"a\":\"\\u0041\\u00e9\\u07FF\"}", "A\xC3\xA9\xDF\xBF", 0 },
+            { "{\"a\":\"\\u0800\\u20AC\\uFFFF\"}", "\xE0\xA0\x80\xE2\x82\xAC\xEF\xBF\xBF", 0 },
+            { "{\"a\":\"\\uD83D\\uDE00\\uD800\\uDC00\\uDBFF\\uDFFF\"}", "\xF0\x9F\x98\x80\xF0\x90\x80\x80\xF4\x8F\xBF\xBF", 0 },
+            { "{\"a\":\"\\uDC00\"}", nullptr, 12 },
+            { "{\"a\":\"\\uD83D\"}", nullptr, 13 },
+            { "{\"a\":\"\\uD83Dx\"}", nullptr, 13 },
+            { "{\"a\":\"\\uD83D \\uDE00\"}", nullptr, 13 },
+            { "{\"a\":\"\\uD83D\\u0041\"}", nullptr, 18 },
+            { "{\"a\":\"\\uD83D\\uD83D\"}", nullptr, 18 }
+        };
+        for (const Case& test : cases)
+        {
+            const std::string text = test.json;
+            Parser parser;
+            EventLog log;
+            const Outcome outcome(parser.Parse(test.json, log), parser);
+            Check(outcome.success == (test.value != nullptr), "unicode escapes: outcome", text);
+            if (test.value)
+                Check(log.events.size() == 4 && log.events[2] == std::string("string a = ") + test.value, "unicode escapes: value", text);
+            else
+                Check(outcome.line == 1 && outcome.column == test.column, "unicode escapes: error position", text + ": " + outcome.ToString());
+
+            Parser structural;
+            structural.setEngine(Parser::Engine::StructuralIndex);
+            EventLog indexed;
+            CheckOutcome(Outcome(structural.Parse(test.json, indexed), structural), outcome, "unicode escapes: structural outcome", test.json);
+            CheckEvents(indexed, log, "unicode escapes: structural events");
+            CheckOutcome(Outcome(parser.Validate(test.json), parser), outcome, "unicode escapes: validate outcome", test.json);
+            EventLog streamed;
+            CheckOutcome(ParseStream(text, 1, streamed), outcome, "unicode escapes: stream outcome", test.json);
+            CheckEvents(streamed, log, "unicode escapes: stream events");
+        }
+    }
+
+    // ParseInto checks that each number fits its field (an integer, or a
+    // float once rounded), failing at the start of a value that doesn't, or
+    // that's of the wrong type.
+    void TestParseInto()
+    {
+        const char* const valid = "{\"small\":255,\"medium\":-32768,\"integer\":2147483647,\"count\":4294967295,"
+            "\"large\":-9223372036854775808,\"huge\":18446744073709551615,\"real\":-1.5e3,\"single\":3.4028235e38,\"flag\":true,"
+            "\"name\":\"a\\u00e9\",\"values\":[1,-2],\"other\":{\"x\":[1,\"y\"]}}";
+        Ranges ranges;
+        Parser parser;
+        Check(parser.ParseInto(valid, ranges), "parse into: valid",
+            EventLog::Position(parser.getLine(), parser.getColumn()));
+        Check(ranges.small == 255 && ranges.medium == -32768 && ranges.integer == 2147483647 && ranges.count == 4294967295u
+            && ranges.large == INT64_MIN && ranges.huge == UINT64_MAX && ranges.real == -1500
+            && ranges.single == std::numeric_limits<float>::max() && ranges.flag
+            && ranges.name == "a\xC3\xA9" && ranges.values == std::vector<int>({ 1, -2 }), "parse into: values");
+
+        // Each is invalid at the first occurrence of the marker...
+        struct Case { const char* json; const char* marker; };
+        const Case cases[] = {
+            { "{\"small\":256}", "256" },
+            { "{\"small\":-1}", "-1" },
+            { "{\"medium\":32768}", "32768" },
+            { "{\"integer\":2147483648}", "2147483648" },
+            { "{\"integer\":-2147483649}", "-2147483649" },
+            { "{\"count\":-1}", "-1" },
+            { "{\"count\":4294967296}", "4294967296" },
+            { "{\"large\":9223372036854775808}", "9223372036854775808" },
+            { "{\"huge\":18446744073709551616}", "18446744073709551616" },
+            { "{\"integer\":1.5}", "1.5" },
+            { "{\"integer\":1e2}", "1e2" },
+            { "{\"integer\":-0}", "-0" },
+            { "{\"values\":[1,-0]}", "-0" },
+            { "{\"single\":3.4028236e38}", "3.4028236e38" },
+            { "{\"single\": -3.4028236e38}", "-3.4028236e38" },
+            { "{\"single\":1e39}", "1e39" },
+            { "{\"integer\":\"1\"}", "\"1\"" },
+            { "{\"integer\":null}", "null" },
+            { "{\"flag\":1}", "1" },
+            { "{\"name\":2}", "2" },
+            { "{\"values\":[1,2147483648]}", "2147483648" },
+            { "{\"values\":{}}", "{}" },
+            { "{\"small\":1,\n  \"integer\":\n    3000000000}", "3000000000" }
+        };
+        for (const Case& test : cases)
+        {
+            const std::string text = test.json;
+            const std::size_t offset = text.find(test.marker);
+            const std::size_t lineStart = text.rfind('\n', offset);
+            const int line = 1 + (int)std::count(text.begin(), text.begin() + offset, '\n');
+            const int column = (int)(lineStart == std::string::npos ? offset + 1 : offset - lineStart);
+
+            Ranges target;
+            Check(!parser.ParseInto(test.json, target), "parse into: invalid", text);
+            Check(parser.getLine() == line && parser.getColumn() == column, "parse into: error position",
+                text + ": " + EventLog::Position(parser.getLine(), parser.getColumn()) + " instead of " + EventLog::Position(line, column));
+            Check(!parser.ParseInto(text.data(), text.size(), target) && parser.getLine() == line && parser.getColumn() == column,
+                "parse into: bounded error position", text);
+        }
+    }
+
+    // Random documents, for the tests of actions and records.
+    class Generator
+    {
+    public:
+        explicit Generator(unsigned seed) : random_(seed) { }
+
+        unsigned Next(unsigned range) { return (unsigned)(random_() % range); }
+
+        std::string Document(int elements)
+        {
+            std::string json = "{\"a\":";
+            AddValue(json, 1);
+            json += ",\"items\":[";
+            for (int i = 0; i < elements; ++i)
+            {
+                if (i != 0)
+                    json += ',';
+                AddValue(json, 3);
+            }
+            json += "],\"b\":";
+            AddValue(json, 1);
+            return json + "}";
+        }
+
+    private:
+        std::mt19937 random_;
+
+        void AddString(std::string& json)
+        {
+            json += '\"';
+            for (unsigned i = Next(6); i != 0; --i)
+            {
+                switch (Next(8))
+                {
+                case 0: json += "\\\""; break;
+                case 1: json += "{[,]}:"; break;
+                case 2: json += "\\u00e9"; break;
+                case 3: json += "\\\\"; break;
+                default: json += (char)('a' + Next(26)); break;
+                }
+            }
+            json += '\"';
+        }
+
+        void AddValue(std::string& json, int depth)
+        {
+            unsigned type = Next(10);
+            if (depth > 5 && type < 4)
+                type = 5;
+            switch (type)
+            {
+            case 0:
+            case 1:
+                json += "{ ";
+                for (unsigned i = 0, count = Next(4); i < count; ++i)
+                {
+                    if (i != 0)
+                        json += ", \n";
+                    AddString(json);
+                    json += " : ";
+                    AddValue(json, depth + 1);
+                }
+                json += '}';
+                break;
+            case 2:
+            case 3:
+                json += '[';
+                for (unsigned i = 0, count = Next(4); i < count; ++i)
+                {
+                    if (i != 0)
+                        json += ',';
+                    AddValue(json, depth + 1);
+                }
+                json += " ]";
+                break;
+            case 4: AddString(json); break;
+            case 5: json += std::to_string((int)Next(2000) - 1000); break;
+            case 6: json += "1.5e3"; break;
+            case 7: json += "true"; break;
+            case 8: json += "false"; break;
+            default: json += "null"; break;
+            }
+        }
+    };
+
+    // The action to ask for at each delivered event (counting from 0): Stop
+    // at one of them, and Skip at a pseudo-random share of the rest, from
+    // every kind of event (to check that it's ignored where it should be).
+    struct Policy
+    {
+        unsigned seed;
+        long stopAt; //or -1
+        unsigned skipPercent;
+
+        Parser::Action Get(long event) const
+        {
+            if (event == stopAt)
+                return Parser::Action::Stop;
+            unsigned hash = ((unsigned)event * 2654435761u) ^ seed;
+            hash ^= hash >> 13;
+            hash *= 0x5BD1E995u;
+            hash ^= hash >> 15;
+            return (hash % 100 < skipPercent ? Parser::Action::Skip : Parser::Action::Continue);
+        }
+    };
+
+    bool IsRecordEvent(const std::string& event)
+    {
+        return (event.compare(0, 7, "record ") == 0 || event.compare(0, 4, "end ") == 0 || event.compare(0, 6, "error ") == 0);
+    }
+
+    // Applies the policy to the events of a parse that took no actions,
+    // giving the events that the callbacks should see: Skip at the start of
+    // an object or array skips to its end (which is delivered), and at a key
+    // skips its value; Stop ends the parse (or the records) after its event.
+    std::vector<std::string> ApplyPolicy(const std::vector<std::string>& all, const Policy& policy, bool& stopped,
+        bool boolsContinue = false)
+    {
+        std::vector<std::string> events;
+        stopped = false;
+        long delivered = 0;
+        for (std::size_t i = 0; i < all.size(); ++i)
+        {
+            events.push_back(all[i]);
+            if (IsRecordEvent(all[i]))
+                continue;
+            Parser::Action action = policy.Get(delivered++);
+            if (boolsContinue && all[i].compare(0, 5, "bool ") == 0)
+                action = Parser::Action::Continue;
+            if (action == Parser::Action::Stop)
+            {
+                stopped = true;
+                break;
+            }
+            if (action != Parser::Action::Skip)
+                continue;
+
+            // Finds the end of the object or array starting at i (or of its
+            // record, if that comes first)...
+            auto skipContainer = [&all](std::size_t& index) {
+                for (int depth = 1; depth != 0; )
+                {
+                    if (++index == all.size() || IsRecordEvent(all[index]))
+                        return false;
+                    const char event = all[index][0];
+                    depth += ((event == '{' || event == '[') ? 1 : ((event == '}' || event == ']') ? -1 : 0));
+                }
+                return true;
+            };
+            const char event = all[i][0];
+            if (event == '{' || event == '[')
+            {
+                skipContainer(i);
+                --i; //delivering the end
+            }
+            else if (all[i].compare(0, 4, "key ") == 0 && i + 1 < all.size() && !IsRecordEvent(all[i + 1]))
+            {
+                const char value = all[++i][0];
+                if ((value == '{' || value == '[') && !skipContainer(i))
+                    --i;
+            }
+        }
+        return events;
+    }
+
+    // Asks for the policy's action at each event.
+    class ActionLog : public EventLog
+    {
+    public:
+        explicit ActionLog(const Policy& policy) : policy_(policy) { }
+
+        void ObjectStart(const char* path) override { EventLog::ObjectStart(path); Act(); }
+        void ObjectEnd(const char* path) override { EventLog::ObjectEnd(path); Act(); }
+        void ArrayStart(const char* path) override { EventLog::ArrayStart(path); Act(); }
+        void ArrayEnd(const char* path) override { EventLog::ArrayEnd(path); Act(); }
+        void Key(const char* path, const char* key, std::size_t length) override { EventLog::Key(path, key, length); Act(); }
+        void String(const char* path, const char* value, std::size_t length) override { EventLog::String(path, value, length); Act(); }
+        void Number(const char* path, const char* value, std::size_t length) override { EventLog::Number(path, value, length); Act(); }
+        void Bool(const char* path, bool value) override { EventLog::Bool(path, value); Act(); }
+        void Null(const char* path) override { EventLog::Null(path); Act(); }
+
+    private:
+        const Policy& policy_;
+        long delivered_ = 0;
+
+        void Act() { setAction(policy_.Get(delivered_++)); }
+    };
+
+    // As above, as a static handler, whose Bool returns void (so always
+    // continues).
+    class StaticActionLog
+    {
+    public:
+        std::vector<std::string> events;
+
+        explicit StaticActionLog(const Policy& policy) : policy_(policy) { }
+
+        Parser::Action ObjectStart(const char* path) { return Add("{", path); }
+        Parser::Action ObjectEnd(const char* path) { return Add("}", path); }
+        Parser::Action ArrayStart(const char* path) { return Add("[", path); }
+        Parser::Action ArrayEnd(const char* path) { return Add("]", path); }
+        Parser::Action Key(const char* path, const char* key, std::size_t length) { return Add("key", path, std::string(key, length)); }
+        Parser::Action String(const char* path, const char* value, std::size_t length) { return Add("string", path, std::string(value, length)); }
+        Parser::Action Number(const char* path, const char* value, std::size_t length) { return Add("number", path, std::string(value, length)); }
+        void Bool(const char* path, bool value) { Add("bool", path, (value ? "true" : "false")); }
+        Parser::Action Null(const char* path) { return Add("null", path); }
+
+    private:
+        const Policy& policy_;
+        long delivered_ = 0;
+
+        Parser::Action Add(const char* event, const char* path)
+        {
+            events.push_back(std::string(event) + " " + path);
+            return policy_.Get(delivered_++);
+        }
+
+        Parser::Action Add(const char* event, const char* path, const std::string& value)
+        {
+            events.push_back(std::string(event) + " " + path + " = " + value);
+            return policy_.Get(delivered_++);
+        }
+    };
+
+    // Every way of parsing takes the actions asked for by the callbacks, and
+    // stops at the same place.
+    void TestActions()
+    {
+        Generator generator(7);
+        for (int iteration = 0; iteration < 2000; ++iteration)
+        {
+            const std::string json = generator.Document((int)generator.Next(5));
+            EventLog all;
+            Parser plain;
+            Check(plain.Parse(json.c_str(), all), "actions: generated document", json);
+
+            const Policy policy = { generator.Next(1u << 31),
+                (generator.Next(3) == 0 ? -1 : (long)generator.Next((unsigned)all.events.size() + 1)),
+                (generator.Next(3) == 0 ? 0 : generator.Next(30)) };
+            bool stopped;
+            EventLog expected;
+            expected.events = ApplyPolicy(all.events, policy, stopped);
+            bool staticStopped;
+            const std::vector<std::string> staticExpected = ApplyPolicy(all.events, policy, staticStopped, true);
+
+            Outcome outcome;
+            for (int mode = 0; mode < 4; ++mode)
+            {
+                Parser parser;
+                parser.setEngine((mode & 1) ? Parser::Engine::StructuralIndex : Parser::Engine::RecursiveDescent);
+                parser.setSkipMode((mode & 2) ? Parser::SkipMode::Unchecked : Parser::SkipMode::Checked);
+                ActionLog log(policy);
+                const Outcome parsed(parser.Parse(json.data(), json.size(), log), parser);
+                CheckEvents(log, expected, "actions: events");
+                Check(parsed.success && parser.IsStopped() == stopped, "actions: stopped", json);
+                if (mode == 0)
+                    outcome = parsed;
+                else
+                    CheckOutcome(parsed, outcome, "actions: position", json.c_str());
+
+                StaticActionLog handler(policy);
+                Check(parser.Parse(json.data(), json.size(), handler) && parser.IsStopped() == staticStopped, "actions: static stopped", json);
+                Check(handler.events == staticExpected, "actions: static events", json);
+            }
+
+            ActionLog streamed(policy);
+            StreamParser stream(streamed);
+            bool success = true;
+            for (std::size_t offset = 0, size; success && offset < json.size(); offset += size)
+            {
+                size = std::min<std::size_t>(1 + generator.Next(50), json.size() - offset);
+                success = stream.Feed(json.data() + offset, size);
+            }
+            CheckOutcome(Outcome(success && stream.Finish(), stream), outcome, "actions: stream position", json.c_str());
+            Check(stream.IsStopped() == stopped, "actions: stream stopped", json);
+            CheckEvents(streamed, expected, "actions: stream events");
+
+            std::istringstream in(json);
+            StreamSource source(in);
+            Parser reader;
+            reader.setBlockSize(1 + generator.Next(100));
+            ActionLog read(policy);
+            CheckOutcome(Outcome(reader.Parse(source, read), reader), outcome, "actions: source position", json.c_str());
+            Check(reader.IsStopped() == stopped, "actions: source stopped", json);
+            CheckEvents(read, expected, "actions: source events");
+
+            EventTape tape;
+            Check(tape.Record(json.data(), json.size()), "actions: record", json);
+            ActionLog replayed(policy);
+            tape.Replay(replayed);
+            CheckEvents(replayed, expected, "actions: replayed events");
+        }
+    }
+
+    // Stopping within a large array that's parsed on several threads stops
+    // at the same event and position as on one thread.
+    void TestParallelActions()
+    {
+        Generator generator(3);
+        const std::string json = generator.Document(150000);
+        EventLog all;
+        Parser parser;
+        Check(parser.Parse(json.data(), json.size(), all), "parallel actions: generated document");
+
+        for (int iteration = 0; iteration < 6; ++iteration)
+        {
+            const Policy policy = { generator.Next(1u << 31), (long)generator.Next((unsigned)all.events.size()),
+                (iteration % 2 == 0 ? 0u : 5u) };
+            bool stopped;
+            EventLog expected;
+            expected.events = ApplyPolicy(all.events, policy, stopped);
+
+            Outcome outcome;
+            for (unsigned threads : { 1, 4 })
+            {
+                parser.setThreads(threads);
+                ActionLog log(policy);
+                const Outcome parsed(parser.Parse(json.data(), json.size(), log), parser);
+                Check(parser.IsStopped() == stopped, "parallel actions: stopped");
+                CheckEvents(log, expected, "parallel actions: events");
+                if (threads == 1)
+                    outcome = parsed;
+                else
+                    CheckOutcome(parsed, outcome, "parallel actions: position", ("stop at event " + std::to_string(policy.stopAt)).c_str());
+            }
+        }
+    }
+
+    // A parser keeps its worker threads from one parse to the next, with
+    // any number of threads, after a stop, and after releasing its buffers;
+    // and if the largest array isn't worth dividing (here, as it's skipped),
+    // the two-stage engine reuses the index that was built to find it.
+    void TestWorkerReuse()
+    {
+        Generator generator(5);
+        const std::string json = "{\"skipped\":" + generator.Document(150000) + ",\"kept\":[1,2,{\"a\":3}]}";
+
+        for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+        {
+            for (bool subscribed : { false, true })
+            {
+                Parser parser;
+                parser.setEngine(engine);
+                if (subscribed)
+                    parser.Subscribe("kept");
+                EventLog expected;
+                Check(parser.Parse(json.data(), json.size(), expected), "worker reuse: parse");
+                const Outcome outcome(true, parser);
+
+                for (unsigned threads : { 4, 2, 6, 4 })
+                {
+                    parser.setThreads(threads);
+                    EventLog actual;
+                    const Outcome parsed(parser.Parse(json.data(), json.size(), actual), parser);
+                    CheckEvents(actual, expected, "worker reuse: events");
+                    CheckOutcome(parsed, outcome, "worker reuse: position", ("threads " + std::to_string(threads)).c_str());
+                    if (threads == 2)
+                        parser.ReleaseBuffers();
+                }
+            }
+        }
+    }
+
+    // Records, some of them invalid, give the same events on one thread as
+    // on several, with and without actions.
+    void TestRecords()
+    {
+        Generator generator(11);
+        std::string text;
+        for (int i = 0; i < 20000; ++i)
+        {
+            std::string json = generator.Document((int)generator.Next(5));
+            std::replace(json.begin(), json.end(), '\n', ' ');
+            if (generator.Next(10) == 0)
+                json.insert(generator.Next((unsigned)json.size()), "x");
+            text += json + (generator.Next(20) == 0 ? "\n\n" : "\n");
+        }
+
+        EventLog all;
+        Parser parser;
+        Check(!parser.ParseRecords(text.data(), text.size(), all), "records: invalid records fail");
+
+        for (int iteration = 0; iteration < 4; ++iteration)
+        {
+            const Policy policy = { generator.Next(1u << 31),
+                (iteration < 2 ? -1 : (long)generator.Next((unsigned)all.events.size())), (iteration == 0 ? 0u : 10u) };
+            bool stopped;
+            EventLog expected;
+            expected.events = ApplyPolicy(all.events, policy, stopped);
+            bool valid = true;
+            for (const std::string& event : expected.events)
+                valid = (valid && event.compare(0, 6, "error ") != 0);
+
+            for (unsigned threads : { 1, 4 })
+            {
+                parser.setThreads(threads);
+                ActionLog log(policy);
+                Check(parser.ParseRecords(text.data(), text.size(), log) == valid, "records: outcome");
+                Check(parser.IsStopped() == stopped, "records: stopped");
+                CheckEvents(log, expected, (threads == 1 ? "records: events" : "records: threaded events"));
+            }
+        }
+    }
+
+    // Splits the events of a series of records into one string per record,
+    // noting whether each record's events were contiguous.
+    std::vector<std::string> RecordGroups(const std::vector<std::string>& events, bool& contiguous)
+    {
+        std::vector<std::string> groups;
+        bool open = false;
+        contiguous = true;
+        for (const std::string& event : events)
+        {
+            const bool start = (event.compare(0, 7, "record ") == 0);
+            if (start == open)
+                contiguous = false;
+            if (start)
+                groups.push_back(event);
+            else if (!groups.empty())
+                groups.back() += "\n" + event;
+            open = (start || !IsRecordEvent(event));
+        }
+        return groups;
+    }
+
+    // Unordered delivery gives the same records, each with its events
+    // together, though perhaps not in the same order.
+    void TestUnorderedRecords()
+    {
+        Generator generator(13);
+        std::string text;
+        for (int i = 0; i < 30000; ++i)
+        {
+            std::string json = generator.Document((int)generator.Next(5));
+            std::replace(json.begin(), json.end(), '\n', ' ');
+            if (generator.Next(10) == 0)
+                json.insert(generator.Next((unsigned)json.size()), "x");
+            text += json + "\n";
+        }
+
+        Parser parser;
+        EventLog expected;
+        Check(!parser.ParseRecords(text.data(), text.size(), expected), "unordered records: invalid records fail");
+        bool contiguous;
+        std::vector<std::string> expectedGroups = RecordGroups(expected.events, contiguous);
+        std::sort(expectedGroups.begin(), expectedGroups.end());
+
+        parser.setThreads(4);
+        parser.setDelivery(Parser::Delivery::Unordered);
+        for (int iteration = 0; iteration < 2; ++iteration)
+        {
+            EventLog actual;
+            Check(!parser.ParseRecords(text.data(), text.size(), actual), "unordered records: outcome");
+            std::vector<std::string> groups = RecordGroups(actual.events, contiguous);
+            Check(contiguous, "unordered records: each record's events together");
+            std::sort(groups.begin(), groups.end());
+            Check(groups == expectedGroups, "unordered records: the same records",
+                std::to_string(groups.size()) + " instead of " + std::to_string(expectedGroups.size()));
+        }
+    }
+
+    // Writes a file in the current directory, which the test removes.
+    void WriteFile(const char* filename, const std::string& contents)
+    {
+        std::FILE* file = std::fopen(filename, "wb");
+        Check(file != nullptr, "write file", filename);
+        if (!file)
+            return;
+        std::fwrite(contents.data(), 1, contents.size(), file);
+        std::fclose(file);
+    }
+
+    // Fails after the given number of bytes.
+    class FailingSource final : public InputSource
+    {
+    public:
+        FailingSource(const std::string& text, std::size_t failAt) : text_(text), failAt_(failAt) { }
+
+        bool Read(char* buffer, std::size_t size, std::size_t& length) override
+        {
+            length = std::min(size, failAt_ - offset_);
+            std::memcpy(buffer, text_.data() + offset_, length);
+            offset_ += length;
+            return (length != 0);
+        }
+
+    private:
+        const std::string& text_;
+        const std::size_t failAt_;
+        std::size_t offset_ = 0;
+    };
+
+    // Each kind of source, with and without read-ahead, gives the same events
+    // as Parse, whatever the block size, including numbers split across
+    // blocks and at the end of the input.
+    void TestSources()
+    {
+        Generator generator(5);
+        std::string large = "{\"n\":[";
+        for (int i = 0; i < 20000; ++i)
+            large += (i != 0 ? "," : "") + std::to_string(i * 7919) + (i % 3 == 0 ? ".25e-3" : "");
+        large += "],\"doc\":" + generator.Document(200) + ",\"end\":123456789}";
+
+        const std::string documents[] = {
+            "{\"a\":12345678,\"b\":[1.5e-300,-0.25,987654321]}",
+            "{\"a\":\"x\",\"b\":184",
+            "{\"a\":\"x\",\"b\":12.5e3",
+            "{\"a\":\"x\",\"b\":1.",
+            large,
+            large.substr(0, large.size() - 4) //ending "1234"
+        };
+        const char* const filename = "test-source.json";
+        for (const std::string& text : documents)
+        {
+            Parser parser;
+            EventLog expected;
+            const Outcome outcome(parser.Parse(text.data(), text.size(), expected), parser);
+            const std::string name = text.substr(0, 20);
+            WriteFile(filename, text);
+
+            for (std::size_t size : { 1, 3, 4, 7, 4096 })
+            {
+                if (text.size() > 1000 && size < 1000)
+                    continue;
+                for (int readAhead = 0; readAhead < 2; ++readAhead)
+                {
+                    Parser reader;
+                    reader.setBlockSize(size);
+                    reader.setReadAhead(readAhead != 0);
+
+                    std::FILE* file = std::fopen(filename, "rb");
+                    FileSource fileSource(file);
+                    EventLog fromFile;
+                    CheckOutcome(Outcome(reader.Parse(fileSource, fromFile), reader), outcome, "sources: file outcome", name.c_str());
+                    CheckEvents(fromFile, expected, "sources: file events");
+                    std::fclose(file);
+
+#ifdef _WIN32
+                    const int fd = _open(filename, _O_RDONLY | _O_BINARY);
+#else
+                    const int fd = open(filename, O_RDONLY);
+#endif
+                    FileDescriptorSource fdSource(fd);
+                    EventLog fromFd;
+                    CheckOutcome(Outcome(reader.Parse(fdSource, fromFd), reader), outcome, "sources: descriptor outcome", name.c_str());
+                    CheckEvents(fromFd, expected, "sources: descriptor events");
+#ifdef _WIN32
+                    _close(fd);
+#else
+                    close(fd);
+#endif
+
+                    std::istringstream in(text);
+                    StreamSource streamSource(in);
+                    EventLog fromStream;
+                    CheckOutcome(Outcome(reader.Parse(streamSource, fromStream), reader), outcome, "sources: stream outcome", name.c_str());
+                    CheckEvents(fromStream, expected, "sources: stream events");
+                }
+            }
+        }
+        std::remove(filename);
+
+        // A source that fails ends the parse, with or without read-ahead...
+        for (int readAhead = 0; readAhead < 2; ++readAhead)
+        {
+            Parser reader;
+            reader.setBlockSize(100);
+            reader.setReadAhead(readAhead != 0);
+            FailingSource failing(large, 1000);
+            EventLog log;
+            Check(!reader.Parse(failing, log) && !log.events.empty(), "sources: failing source");
+        }
+    }
+
+#ifndef _WIN32
+    // Writes to a named pipe (in the current directory) on another thread,
+    // while the test reads it as a file that can't be mapped.
+    class PipeWriter
+    {
+    public:
+        PipeWriter(const char* filename, const std::string& contents)
+            : filename_(filename)
+        {
+            std::signal(SIGPIPE, SIG_IGN); //if the reader gives up early
+            std::remove(filename);
+            Check(mkfifo(filename, 0600) == 0, "make pipe", filename);
+            thread_ = std::thread([filename, &contents] {
+                std::FILE* file = std::fopen(filename, "wb"); //waits for the reader
+                if (!file)
+                    return;
+                std::fwrite(contents.data(), 1, contents.size(), file);
+                std::fclose(file);
+            });
+        }
+
+        ~PipeWriter()
+        {
+            thread_.join();
+            std::remove(filename_);
+        }
+
+    private:
+        const char* const filename_;
+        std::thread thread_;
+    };
+#endif
+
+    // ParseFile gives the same events and position as Parse, whether the
+    // file is mapped (even if empty, or a whole number of pages, so the
+    // terminator is on a page of its own) or read as it can't be (a pipe),
+    // with and without subscriptions.
+    void TestFiles()
+    {
+        std::vector<std::string> documents(std::begin(c_documents), std::end(c_documents));
+        documents.push_back("{\"a\":{\"b\":[1,2]},\"c\":{\"a\":3,\"d\":[x]},\"d\":[{\"a\":1}]}");
+        documents.push_back("{\"c\":{\"a\":3,\"d\":[x]},\"a\":1}");
+#ifdef _WIN32
+        const std::size_t page = 4096;
+#else
+        const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+#endif
+        for (std::size_t pages : { 1, 2 })
+        {
+            std::string padded = "{\"a\":[1,2,\"x\"]}";
+            padded.resize(pages * page - 1, ' ');
+            documents.push_back(padded + "\n");
+            std::string truncated = "{\"a\":";
+            truncated.resize(pages * page - 4, ' ');
+            documents.push_back(truncated + "1234"); //a number that ends at the end of the page
+        }
+
+        const char* const filename = "test-file.json";
+        for (const std::string& text : documents)
+        {
+            const std::string name = text.substr(0, 20);
+            for (int subscribed = 0; subscribed < 2; ++subscribed)
+            {
+                Parser parser;
+                if (subscribed)
+                {
+                    parser.Subscribe("a");
+                    parser.Subscribe("d");
+                }
+                EventLog expected;
+                const Outcome outcome(parser.Parse(text.data(), text.size(), expected), parser);
+
+                WriteFile(filename, text);
+                EventLog mapped;
+                CheckOutcome(Outcome(parser.ParseFile(filename, mapped), parser), outcome, "files: mapped outcome", name.c_str());
+                CheckEvents(mapped, expected, "files: mapped events");
+                std::remove(filename);
+
+#ifndef _WIN32
+                EventLog piped;
+                {
+                    PipeWriter writer(filename, text);
+                    CheckOutcome(Outcome(parser.ParseFile(filename, piped), parser), outcome, "files: piped outcome", name.c_str());
+                }
+                CheckEvents(piped, expected, "files: piped events");
+#endif
+            }
+        }
+
+        Parser parser;
+        EventLog log;
+        Check(!parser.ParseFile("test-missing.json", log), "files: missing file");
+    }
+
+    // ParseRecordsFile gives the same records as ParseRecords, on one
+    // thread and on several, whether the file is mapped or read in blocks
+    // of 16 MB (from a pipe), with records cut off at the end of a block
+    // and one longer than a block.
+    void TestRecordsFile()
+    {
+        Generator generator(17);
+        std::string text;
+        while (text.size() < 20 * 1024 * 1024)
+        {
+            if (generator.Next(100) == 0)
+                text += "{\"i\":" + std::to_string(text.size()) + ",x}\n";
+            else
+                text += "{\"i\":" + std::to_string(text.size()) + ",\"s\":\"" + std::string(generator.Next(2000), 's') + "\"}\n";
+            if (text.size() > 10 * 1024 * 1024 && text.size() < 11 * 1024 * 1024)
+                text += "\n{\"long\":\"" + std::string(17 * 1024 * 1024, 'l') + "\"}\n";
+        }
+        text += "{\"last\":true}"; //with no line break
+
+        Parser parser;
+        EventLog expected;
+        Check(!parser.ParseRecords(text.data(), text.size(), expected), "records file: invalid records fail");
+
+        const char* const filename = "test-records.json";
+        for (unsigned threads : { 1, 4 })
+        {
+            parser.setThreads(threads);
+            WriteFile(filename, text);
+            EventLog mapped;
+            Check(!parser.ParseRecordsFile(filename, mapped), "records file: mapped outcome");
+            CheckEvents(mapped, expected, "records file: mapped events");
+            std::remove(filename);
+
+#ifndef _WIN32
+            EventLog piped;
+            {
+                PipeWriter writer(filename, text);
+                Check(!parser.ParseRecordsFile(filename, piped), "records file: piped outcome");
+            }
+            CheckEvents(piped, expected, "records file: piped events");
+#endif
+        }
+    }
+
+    // Paths with empty keys, or keys containing colons, are the same with
+    // and without a path table.
+    void TestEmptyKeys()
+    {
+        const char* const json = "{\"\":{\"c\":1,\"\":[2]},\"a:b\":{\"\":3}}";
+
+        EventLog expected;
+        expected.events = {
+            "{ ", "key  = ", "{ ", "key  = c", "number :c = 1", "key  = ", "[ :", "number : = 2", "] :", "} ",
+            "key  = a:b", "{ a:b", "key a:b = ", "number a:b: = 3", "} a:b", "} "
+        };
+
+        for (int engine = 0; engine < 2; ++engine)
+        {
+            for (int table = 0; table < 2; ++table)
+            {
+                PathTable pathTable;
+                Parser parser;
+                parser.setEngine(engine ? Parser::Engine::StructuralIndex : Parser::Engine::RecursiveDescent);
+                parser.setPathTable(table ? &pathTable : nullptr);
+                EventLog log;
+                Check(parser.Parse(json, log), "empty keys: parse");
+                CheckEvents(log, expected, "empty keys: paths");
+            }
+        }
+
+        EventLog streamed;
+        StreamParser stream(streamed);
+        Check(stream.Feed(json, std::strlen(json)) && stream.Finish(), "empty keys: stream");
+        CheckEvents(streamed, expected, "empty keys: stream paths");
+    }
+
+    // A large array beneath an empty key is parsed in slices on several
+    // threads, and so are large inputs of records; both must deliver the
+    // same events as one thread.
+    void TestThreadedPaths()
+    {
+        std::string json = "{\"\":{\"c\":[";
+        std::string records;
+        for (int i = 0; i < 100000; ++i)
+        {
+            const std::string element = "{\"\":" + std::to_string(i) + ",\"k:\":[\"x\",{\"\":null}]}";
+            json += (i != 0 ? "," : "") + element;
+            records += "{\"\":" + element + "}\n";
+        }
+        json += "]}}";
+
+        for (int table = 0; table < 2; ++table)
+        {
+            PathTable pathTable;
+            Parser parser;
+            parser.setPathTable(table ? &pathTable : nullptr);
+
+            EventLog expected;
+            Check(parser.Parse(json.c_str(), expected), "threaded paths: parse");
+            EventLog expectedRecords;
+            Check(parser.ParseRecords(records.data(), records.size(), expectedRecords), "threaded paths: records");
+
+            parser.setThreads(4);
+            EventLog actual;
+            Check(parser.Parse(json.c_str(), actual), "threaded paths: parallel parse");
+            CheckEvents(actual, expected, "threaded paths: parallel events");
+            EventLog actualRecords;
+            Check(parser.ParseRecords(records.data(), records.size(), actualRecords), "threaded paths: parallel records");
+            CheckEvents(actualRecords, expectedRecords, "threaded paths: parallel record events");
+        }
+    }
+
+    // A tape replays the events of a plain parse, paths and all, and a
+    // cached tape restores the position at which the parse ended.
+    void TestTapes()
+    {
+        const char* const json = "{\"\":{\"c\":[1,{\"\":\"x\"}]},\n \"a:b\":null }";
+        const std::size_t length = std::strlen(json);
+
+        Parser parser;
+        EventLog expected;
+        Check(parser.Parse(json, length, expected), "tapes: parse");
+
+        EventTape tape;
+        Check(tape.Record(json, length), "tapes: record");
+        EventLog replayed;
+        tape.Replay(replayed);
+        CheckEvents(replayed, expected, "tapes: replayed paths");
+        Check(tape.getLine() == parser.getLine() && tape.getColumn() == parser.getColumn(), "tapes: record position",
+            EventLog::Position(tape.getLine(), tape.getColumn()));
+
+        TapeCache cache(".");
+        std::remove(cache.getFilename(json, length).c_str()); //from an earlier run
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            EventLog cached;
+            Check(cache.Parse(json, length, cached), "tapes: cache parse");
+            Check(cache.IsHit() == (pass == 1), "tapes: cache hit");
+            CheckEvents(cached, expected, "tapes: cached paths");
+            Check(cache.getLine() == parser.getLine() && cache.getColumn() == parser.getColumn(), "tapes: cache position",
+                EventLog::Position(cache.getLine(), cache.getColumn()) + " instead of " + EventLog::Position(parser.getLine(), parser.getColumn()));
+        }
+        std::remove(cache.getFilename(json, length).c_str());
+    }
+
+    // Skips every object and array but the root.
+    class SkipLog : public EventLog
+    {
+    public:
+        void ObjectStart(const char* path) override
+        {
+            EventLog::ObjectStart(path);
+            if (*path)
+                setAction(Parser::Action::Skip);
+        }
+
+        void ArrayStart(const char* path) override
+        {
+            EventLog::ArrayStart(path);
+            if (*path)
+                setAction(Parser::Action::Skip);
+        }
+    };
+
+    // A skipped object or array still delivers its end, even if the text
+    // after it is invalid, and the error is at the same place.
+    void TestSkipBeforeError()
+    {
+        struct Case { const char* json; const char* end; const char* position; };
+        const Case cases[] = {
+            { "{\"a\":[true]x}", "] a", "1:12" },
+            { "{\"a\":{\"b\":[1]}x}", "} a", "1:15" }
+        };
+        for (const Case& test : cases)
+        {
+            const char* const json = test.json;
+            SkipLog expected;
+            Parser parser;
+            Check(!parser.Parse(json, expected), "skip before error: parse", json);
+            Check(!expected.events.empty() && expected.events.back() == test.end, "skip before error: end delivered", json);
+            Check(EventLog::Position(parser.getLine(), parser.getColumn()) == test.position, "skip before error: error position", json);
+
+            SkipLog actual;
+            Parser structural;
+            structural.setEngine(Parser::Engine::StructuralIndex);
+            Check(!structural.Parse(json, actual), "skip before error: structural parse", json);
+            CheckEvents(actual, expected, "skip before error: structural events");
+            Check(structural.getLine() == parser.getLine() && structural.getColumn() == parser.getColumn(), "skip before error: position",
+                EventLog::Position(structural.getLine(), structural.getColumn()) + " instead of " + EventLog::Position(parser.getLine(), parser.getColumn()));
+        }
+    }
+
+    // A reused Document parses bounded text, with either engine, and reports
+    // errors at the same place as Parser.
+    void TestDocuments()
+    {
+        const std::string text = "{\"a\":[1,\"x\"],\"b\":true}{\"c\":";
+        const std::size_t length = text.find('}') + 1;
+        for (int engine = 0; engine < 2; ++engine)
+        {
+            Document document;
+            document.setEngine(engine ? Parser::Engine::StructuralIndex : Parser::Engine::RecursiveDescent);
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                Check(document.Parse(text.data(), length), "documents: bounded parse");
+                Document::Element a = document.getRoot().Find("a");
+                Check(a.IsValid() && a.getSize() == 2 && a.getFirst().getInt64() == 1, "documents: bounded values");
+                Check(document.getRoot().Find("b").getBool(), "documents: bounded values");
+
+                Parser parser;
+                EventLog log;
+                Check(!document.Parse(text.c_str()) && !parser.Parse(text.c_str(), log), "documents: trailing text fails");
+                Check(document.getLine() == parser.getLine() && document.getColumn() == parser.getColumn(), "documents: error position",
+                    EventLog::Position(document.getLine(), document.getColumn()) + " instead of " + EventLog::Position(parser.getLine(), parser.getColumn()));
+                Check(!document.getRoot().IsValid(), "documents: cleared after an error");
+            }
+            document.ReleaseBuffers();
+            Check(document.Parse(text.data(), length) && document.getRoot().Find("b").getBool(), "documents: parse after releasing");
+        }
+    }
+
+    // A bounded LazyDocument stops at the end of its text, as if it were
+    // null-terminated there.
+    void TestLazyDocuments()
+    {
+        const std::string text = "{\"a\":\"x\",\"b\":[1,{\"c\":2}],\"d\":true}\"e\"";
+        const std::size_t length = text.rfind('}') + 1;
+        for (int checked = 0; checked < 2; ++checked)
+        {
+            const Parser::SkipMode skipMode = (checked ? Parser::SkipMode::Checked : Parser::SkipMode::Unchecked);
+            const std::vector<char> bounded(text.begin(), text.begin() + length); //not null-terminated
+            LazyDocument document(bounded.data(), bounded.size());
+            document.setSkipMode(skipMode);
+            bool value = false;
+            Check(document["d"].getBool(value) && value && !document.HasError(), "lazy documents: bounded lookup");
+            Check(!document["e"].IsValid() && !document.HasError(), "lazy documents: missing key");
+
+            // Cut short within "b", where a lookup of a later key fails...
+            const std::size_t cut = text.find("{\"c");
+            const std::vector<char> truncated(text.begin(), text.begin() + cut);
+            LazyDocument partial(truncated.data(), truncated.size());
+            partial.setSkipMode(skipMode);
+            std::int64_t number = 0;
+            Check(partial["b"].getFirst().getInt64(number) && number == 1, "lazy documents: truncated lookup");
+            Check(!partial["d"].IsValid() && partial.HasError(), "lazy documents: truncated error");
+        }
+    }
+
+    // Collects what a writer passes to its sink.
+    class StringSink final : public Writer::Sink
+    {
+    public:
+        std::string text;
+        int writes = 0;
+
+        void Write(const char* data, std::size_t length) override
+        {
+            text.append(data, length);
+            ++writes;
+        }
+    };
+
+    // Records the typed value of each number, as Double or otherwise.
+    class DoubleLog final : public Parser::Callbacks
+    {
+    public:
+        std::vector<double> doubles;
+        int others = 0;
+
+        void Double(const char*, double value, const char*, std::size_t) override { doubles.push_back(value); }
+        void Int64(const char*, std::int64_t, const char*, std::size_t) override { ++others; }
+        void UInt64(const char*, std::uint64_t, const char*, std::size_t) override { ++others; }
+    };
+
+    // The writer escapes what it must (and nothing else), writes integers
+    // at their limits, and writes doubles that read back as the same
+    // doubles (and as doubles, not integers); through a sink, the text is
+    // the same, and is flushed by the destructor, even through a pointer
+    // to Parser::Callbacks.
+    void TestWriter()
+    {
+        std::string special;
+        for (int ch = 0; ch < 0x20; ++ch)
+            special += (char)ch;
+        special += "\"\\/\x7F caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80";
+        const std::string escaped = "\"\\u0000\\u0001\\u0002\\u0003\\u0004\\u0005\\u0006\\u0007\\b\\t\\n\\u000b\\f\\r"
+            "\\u000e\\u000f\\u0010\\u0011\\u0012\\u0013\\u0014\\u0015\\u0016\\u0017\\u0018\\u0019\\u001a\\u001b\\u001c"
+            "\\u001d\\u001e\\u001f\\\"\\\\/\x7F caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80\"";
+
+        Writer writer;
+        writer.ObjectStart();
+        writer.Key("s");
+        writer.String(special.data(), special.size());
+        writer.Key(special.data(), special.size());
+        writer.Null();
+        writer.Key("limits");
+        writer.ArrayStart();
+        writer.Int64(INT64_MIN);
+        writer.Int64(INT64_MAX);
+        writer.UInt64(UINT64_MAX);
+        writer.Double(std::numeric_limits<double>::infinity());
+        writer.Double(std::nan(""));
+        writer.ArrayEnd();
+        writer.ObjectEnd();
+        const std::string text(writer.getData(), writer.getSize());
+        const std::string expected = "{\"s\":" + escaped + "," + escaped + ":null"
+            + ",\"limits\":[-9223372036854775808,9223372036854775807,18446744073709551615,null,null]}";
+        Check(text == expected, "writer: escapes and limits", text);
+
+        // The strings read back as they were...
+        Parser parser;
+        EventLog log;
+        Check(parser.Parse(text.data(), text.size(), log), "writer: parse");
+        Check(log.events.size() > 3 && log.events[2] == "string s = " + special && log.events[3] == "key  = " + special,
+            "writer: strings read back");
+
+        // Doubles read back as the same doubles: some awkward ones, and
+        // random bit patterns...
+        std::vector<double> doubles = { 0.0, -0.0, 1.0, -1.0, 0.1, 0.3, 1.0 / 3, 2.5e-3, 1e20, 1e21, 1e22, 9007199254740993.0,
+            123456789012345678.0, std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::min(), std::numeric_limits<double>::denorm_min(), 4.9406564584124654e-324,
+            2.2250738585072009e-308, 1.7976931348623157e308, 5e-324, 1e-7, 1e15, 1e16, 1e17 };
+        std::mt19937_64 random(19);
+        while (doubles.size() < 20000)
+        {
+            const std::uint64_t bits = random();
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            if (std::isfinite(value))
+                doubles.push_back(value);
+        }
+        writer.Clear();
+        writer.ObjectStart();
+        writer.Key("d");
+        writer.ArrayStart();
+        for (double value : doubles)
+            writer.Double(value);
+        writer.ArrayEnd();
+        writer.ObjectEnd();
+        DoubleLog read;
+        Check(parser.Parse(writer.getData(), writer.getSize(), read), "writer: parse doubles");
+        Check(read.others == 0 && read.doubles.size() == doubles.size(), "writer: doubles read back as doubles");
+        for (std::size_t i = 0; i < doubles.size() && i < read.doubles.size(); ++i)
+        {
+            if (std::memcmp(&read.doubles[i], &doubles[i], sizeof(double)) != 0)
+            {
+                char buffer[64];
+                std::snprintf(buffer, sizeof(buffer), "%.17g", doubles[i]);
+                Check(false, "writer: double round trip", buffer);
+                break;
+            }
+        }
+
+        // Through a sink, the text is the same, as the destructor flushes
+        // it...
+        const std::string numbers(writer.getData(), writer.getSize());
+        StringSink sink;
+        {
+            std::unique_ptr<Parser::Callbacks> callbacks(new Writer(sink));
+            Check(parser.Parse(numbers.data(), numbers.size(), *callbacks), "writer: parse into a sink");
+        }
+        Check(sink.text == numbers && sink.writes > 1, "writer: sink text");
+    }
+
+    // Removes the whitespace outside strings, a char at a time.
+    std::string MinifySlowly(const std::string& json)
+    {
+        std::string out;
+        bool inString = false, escaped = false;
+        for (char ch : json)
+        {
+            if (inString)
+            {
+                inString = (escaped || ch != '\"');
+                escaped = (!escaped && ch == '\\');
+            }
+            else if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
+            {
+                continue;
+            }
+            else
+            {
+                inString = (ch == '\"');
+            }
+            out += ch;
+        }
+        return out;
+    }
+
+    // Minify and Reformat give the expected text, keeping whitespace and
+    // escaped quotes and backslashes within strings (including across the
+    // 64-char blocks that Minify classifies); Minify also works in place.
+    // The Parser versions fail at the same position as Parse.
+    void TestTransforms()
+    {
+        const std::string json = " { \"a b\" : [ 1 , 2.5e-3 , \"x \\\" y\\\\\" ,\n\t{ } , [ ] , { \"c\" : null } ] ,\r\n \"d\" : \"\\\\\" , \"e\":true }\n";
+        const std::string minified = "{\"a b\":[1,2.5e-3,\"x \\\" y\\\\\",{},[],{\"c\":null}],\"d\":\"\\\\\",\"e\":true}";
+        const std::string reformatted = "{\n  \"a b\": [\n    1,\n    2.5e-3,\n    \"x \\\" y\\\\\",\n    {},\n    [],\n    {\n"
+            "      \"c\": null\n    }\n  ],\n  \"d\": \"\\\\\",\n  \"e\": true\n}";
+
+        std::string out;
+        Minify(json.data(), json.size(), out);
+        Check(out == minified, "transforms: minify", out);
+        Reformat(json.data(), json.size(), out, 2);
+        Check(out == reformatted, "transforms: reformat", out);
+        Reformat(minified.data(), minified.size(), out, 2);
+        Check(out == reformatted, "transforms: reformat minified", out);
+        std::string unindented;
+        Reformat(reformatted.data(), reformatted.size(), unindented, 0);
+        Minify(unindented.data(), unindented.size(), out);
+        Check(out == minified, "transforms: reformat with no indent", unindented);
+
+        // Strings of whitespace, escaped quotes and backslashes, at every
+        // offset from a block boundary...
+        for (std::size_t offset = 0; offset < 64; ++offset)
+        {
+            std::string text = "{" + std::string(offset, ' ') + "\"k\" :\"";
+            for (int i = 0; i < 70; ++i)
+                text += (i % 7 == 0 ? "\\\"" : (i % 5 == 0 ? "\\\\" : (i % 3 == 0 ? " \t" : "x")));
+            text += "\" ,  \"\\\\\": [ \" \\\\\\\" \" ] }";
+            const std::string expected = MinifySlowly(text);
+            Minify(text.data(), text.size(), out);
+            Check(out == expected, "transforms: minify strings", out);
+            std::vector<char> buffer(text.begin(), text.end());
+            const std::size_t length = Minify(buffer.data(), buffer.size(), buffer.data());
+            Check(std::string(buffer.data(), length) == expected, "transforms: minify in place");
+            Reformat(text.data(), text.size(), out);
+            Check(MinifySlowly(out) == expected, "transforms: reformat strings", out);
+        }
+
+        // Checked, they fail where Parse does, leaving nothing in out...
+        for (const char* document : c_documents)
+        {
+            const std::size_t length = std::strlen(document);
+            Parser parser;
+            EventLog log;
+            const Outcome outcome(parser.Parse(document, length, log), parser);
+            std::string checked = "x";
+            CheckOutcome(Outcome(parser.Minify(document, length, checked), parser), outcome, "transforms: checked minify", document);
+            if (outcome.success)
+            {
+                Minify(document, length, out);
+                Check(checked == out, "transforms: checked minify output", document);
+            }
+            else
+            {
+                Check(checked.empty(), "transforms: checked minify output is empty", document);
+            }
+            CheckOutcome(Outcome(parser.Reformat(document, length, checked), parser), outcome, "transforms: checked reformat", document);
+            Check(outcome.success == !checked.empty(), "transforms: checked reformat output", document);
+        }
+    }
+
+    // The offset of the first byte of the text that isn't part of a well-
+    // formed UTF-8 sequence, as given by the table of them in the Unicode
+    // standard (the size of the text if its last sequence is incomplete),
+    // or std::string::npos if it's all valid.
+    std::size_t FindInvalidUTF8Slowly(const std::string& text)
+    {
+        for (std::size_t i = 0; i < text.size(); )
+        {
+            const unsigned char lead = (unsigned char)text[i];
+            int length = 1;
+            unsigned char min = 0x80, max = 0xBF; //of the second byte
+            if (lead >= 0xC2 && lead <= 0xDF)
+                length = 2;
+            else if (lead >= 0xE0 && lead <= 0xEF)
+                length = 3;
+            else if (lead >= 0xF0 && lead <= 0xF4)
+                length = 4;
+            else if (lead >= 0x80)
+                return i;
+            if (lead == 0xE0)
+                min = 0xA0;
+            else if (lead == 0xED)
+                max = 0x9F;
+            else if (lead == 0xF0)
+                min = 0x90;
+            else if (lead == 0xF4)
+                max = 0x8F;
+
+            for (int j = 1; j < length; ++j)
+            {
+                if (i + (std::size_t)j == text.size())
+                    return text.size();
+                const unsigned char ch = (unsigned char)text[i + (std::size_t)j];
+                if (ch < (j == 1 ? min : 0x80) || ch > (j == 1 ? max : 0xBF))
+                    return i + (std::size_t)j;
+            }
+            i += (std::size_t)length;
+        }
+        return std::string::npos;
+    }
+
+    // In checked mode, every engine fails at the first byte that isn't valid
+    // UTF-8: overlong forms, surrogates, values above 0x10FFFF, stray and
+    // missing continuation bytes, wherever they fall in a vector block, and
+    // at the end of the input. So does each of the vectorised kernels. (The
+    // tests are also built without SIMD.)
+    void TestCheckedUTF8()
+    {
+        const char* const sequences[] = {
+            "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xED\x9F\xBF", "\xEE\x80\x80", "\xEF\xBF\xBF", "\xF4\x8F\xBF\xBF", //valid
+            "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF", //overlong
+            "\xED\xA0\x80", "\xED\xBF\xBF", //surrogates
+            "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF7\xBF\xBF\xBF", "\xFE", "\xFF", //above 0x10FFFF
+            "\x80", "\xBF", "\xC3\xA9\xA9", //stray continuation bytes
+            "\xC3", "\xE2\x82", "\xF0\x9F\x98", "\xE2x", "\xF0\x9F\x98x" //truncated
+        };
+        const char* const prefixes[] = { "", "\xC3\xA9", "\xE2\x82\xAC" }; //to vary the alignment of what follows
+        for (const char* sequence : sequences)
+        {
+            for (const char* prefix : prefixes)
+            {
+                for (std::size_t offset = 0; offset < 70; ++offset)
+                {
+                    for (int ending = 0; ending < 3; ++ending)
+                    {
+                        // The string continues, ends, or is cut off...
+                        const std::string value = std::string(prefix) + std::string(offset, 'a') + sequence
+                            + (ending == 0 ? "bcd" : "");
+                        const std::string text = "{\"s\":\"" + value + (ending == 2 ? "" : "\"}");
+                        const std::size_t invalid = FindInvalidUTF8Slowly(value);
+                        Outcome expected;
+                        expected.line = 1;
+                        if (invalid != std::string::npos)
+                            expected.column = 7 + (int)invalid;
+                        else if (ending == 2)
+                            expected.column = 7 + (int)value.size();
+                        else
+                        {
+                            expected.success = true;
+                            expected.column = 9 + (int)value.size();
+                        }
+                        const std::string name = EventLog::Position(0, (int)offset) + " " + sequence;
+
+                        for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+                        {
+                            Parser parser;
+                            parser.setEngine(engine);
+                            parser.setUTF8Mode(Parser::UTF8Mode::Checked);
+                            EventLog log;
+                            CheckOutcome(Outcome(parser.Parse(text.data(), text.size(), log), parser), expected, "checked UTF-8: parse", name.c_str());
+                            if (engine == Parser::Engine::RecursiveDescent)
+                                CheckOutcome(Outcome(parser.Validate(text.data(), text.size()), parser), expected, "checked UTF-8: validate", name.c_str());
+                        }
+
+                        // Each of the kernels that this CPU supports (the
+                        // parser only uses the best of them)...
+                        typedef const char* (*FindInvalid)(const char*, const char*);
+                        std::vector<FindInvalid> kernels = { detail::FindInvalidUTF8Scalar };
+#ifdef CYOJSON_SIMD_X86
+                        if (detail::HasSSE2())
+                            kernels.push_back(detail::FindInvalidUTF8SSE2);
+                        if (detail::HasAVX2())
+                            kernels.push_back(detail::FindInvalidUTF8AVX2);
+#endif
+                        for (FindInvalid kernel : kernels)
+                        {
+                            const char* const found = kernel(value.data(), value.data() + value.size());
+                            Check((found ? (std::size_t)(found - value.data()) : std::string::npos) == invalid, "checked UTF-8: kernel", name);
+                        }
+
+                        EventLog streamed;
+                        StreamParser stream(streamed);
+                        stream.setUTF8Mode(Parser::UTF8Mode::Checked);
+                        const std::size_t split = 6 + offset + std::strlen(prefix) + 1; //within the sequence
+                        const bool success = stream.Feed(text.data(), std::min(split, text.size()))
+                            && (split >= text.size() || stream.Feed(text.data() + split, text.size() - split)) && stream.Finish();
+                        CheckOutcome(Outcome(success, stream), expected, "checked UTF-8: stream", name.c_str());
+                    }
+                }
+            }
+        }
+    }
+
+    // Subscribing delivers the subscribed paths and everything beneath them,
+    // where "*" matches any one component (and an array's elements have its
+    // path), but nothing on the way to them; both engines agree.
+    void TestSubscriptions()
+    {
+        const std::string json = "{\"users\":{\"ann\":{\"name\":\"A\",\"age\":1},\"bob\":{\"name\":\"B\",\"tags\":[\"x\"]}},"
+            "\"items\":[{\"id\":1},{\"id\":2,\"name\":\"C\"}],\"name\":\"top\"}";
+        struct Case
+        {
+            std::vector<const char*> subscriptions;
+            std::vector<std::string> events;
+        };
+        const Case cases[] = {
+            { { "users:*:name", "items:id" },
+                { "string users:ann:name = A", "string users:bob:name = B", "number items:id = 1", "number items:id = 2" } },
+            { { "*:name" },
+                { "string items:name = C" } },
+            { { "users:ann" },
+                { "{ users:ann", "key users:ann = name", "string users:ann:name = A", "key users:ann = age", "number users:ann:age = 1",
+                    "} users:ann" } },
+            { { "users:ann:name", "users" },
+                { "{ users", "key users = ann", "{ users:ann", "key users:ann = name", "string users:ann:name = A", "key users:ann = age",
+                    "number users:ann:age = 1", "} users:ann", "key users = bob", "{ users:bob", "key users:bob = name",
+                    "string users:bob:name = B", "key users:bob = tags", "[ users:bob:tags", "string users:bob:tags = x",
+                    "] users:bob:tags", "} users:bob", "} users" } },
+            { { "items" },
+                { "[ items", "{ items", "key items = id", "number items:id = 1", "} items", "{ items", "key items = id",
+                    "number items:id = 2", "key items = name", "string items:name = C", "} items", "] items" } },
+            { { "users:*:*", "nothing" },
+                { "string users:ann:name = A", "number users:ann:age = 1", "string users:bob:name = B", "[ users:bob:tags",
+                    "string users:bob:tags = x", "] users:bob:tags" } }
+        };
+        for (const Case& test : cases)
+        {
+            for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+            {
+                Parser parser;
+                parser.setEngine(engine);
+                for (const char* subscription : test.subscriptions)
+                    parser.Subscribe(subscription);
+                EventLog log;
+                Check(parser.Parse(json.data(), json.size(), log), "subscriptions: parse", test.subscriptions[0]);
+                EventLog expected;
+                expected.events = test.events;
+                CheckEvents(log, expected, (std::string("subscriptions: ") + test.subscriptions[0]).c_str());
+            }
+        }
+    }
+
+    // Skipped subtrees are checked by default, so a parse fails where it
+    // would without subscriptions, but only their brackets and quotes are
+    // matched in Unchecked mode, which LazyDocument uses by default.
+    void TestSkipModes()
+    {
+        Parser defaults;
+        LazyDocument lazyDefaults("{}");
+        Check(defaults.getSkipMode() == Parser::SkipMode::Checked && lazyDefaults.getSkipMode() == Parser::SkipMode::Unchecked,
+            "skip modes: defaults");
+
+        const char* const invalid[] = { "tru", "[1,,2]", "01", "\"\\x\"", "\"a\x01\"", "{\"a\" 1}", "{\"a\":1,}", "-", "[1 2]", "nul" };
+        for (const char* value : invalid)
+        {
+            const std::string json = "{\"skip\":{\"a\":[" + std::string(value) + "]},\"keep\":1}";
+            Parser whole;
+            EventLog all;
+            const Outcome error(whole.Parse(json.data(), json.size(), all), whole);
+            Check(!error.success, "skip modes: invalid without subscriptions", json);
+
+            for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+            {
+                Parser parser;
+                parser.setEngine(engine);
+                parser.Subscribe("keep");
+                EventLog checked;
+                CheckOutcome(Outcome(parser.Parse(json.data(), json.size(), checked), parser), error, "skip modes: checked", json.c_str());
+
+                parser.setSkipMode(Parser::SkipMode::Unchecked);
+                EventLog unchecked;
+                Check(parser.Parse(json.data(), json.size(), unchecked), "skip modes: unchecked", json);
+                Check(unchecked.events == std::vector<std::string>{ "number keep = 1" }, "skip modes: unchecked events", json);
+            }
+
+            LazyDocument lazy(json.data(), json.size());
+            std::int64_t number = 0;
+            Check(lazy["keep"].getInt64(number) && number == 1 && !lazy.HasError(), "skip modes: lazy unchecked", json);
+            LazyDocument lazyChecked(json.data(), json.size());
+            lazyChecked.setSkipMode(Parser::SkipMode::Checked);
+            Check(!lazyChecked["keep"].IsValid() && lazyChecked.HasError(), "skip modes: lazy checked", json);
+            CheckOutcome(Outcome(false, lazyChecked), error, "skip modes: lazy checked position", json.c_str());
+        }
+    }
+
+    // Records the type and exact value of each number.
+    class NumberLog final : public Parser::Callbacks
+    {
+    public:
+        std::vector<std::string> numbers;
+
+        void Int64(const char*, std::int64_t value, const char*, std::size_t) override { numbers.push_back("int64 " + std::to_string(value)); }
+        void UInt64(const char*, std::uint64_t value, const char*, std::size_t) override { numbers.push_back("uint64 " + std::to_string(value)); }
+        void Double(const char*, double value, const char*, std::size_t) override { numbers.push_back(Typed(value)); }
+
+        static std::string Typed(double value)
+        {
+            char buffer[64];
+            std::snprintf(buffer, sizeof(buffer), "double %a", value);
+            return buffer;
+        }
+    };
+
+    // Integers are Int64 up to its limits, UInt64 beyond them up to its
+    // own, and Double beyond that (as are -0 and anything with a fraction
+    // or exponent); Doubles are correctly rounded, as by strtod, including
+    // overflow to infinity, subnormals, underflow to zero and mantissas
+    // of 19 digits or more; Document keeps the same types and values.
+    void TestNumberBoundaries()
+    {
+        struct Case { const char* text; const char* type; };
+        const Case cases[] =
+        {
+            { "0", "int64" },
+            { "-0", "double" },
+            { "-0.0", "double" },
+            { "0e0", "double" },
+            { "9223372036854775807", "int64" },
+            { "9223372036854775808", "uint64" },
+            { "-9223372036854775808", "int64" },
+            { "-9223372036854775809", "double" },
+            { "18446744073709551615", "uint64" },
+            { "18446744073709551616", "double" },
+            { "-18446744073709551616", "double" },
+            { "99999999999999999999999", "double" },
+            { "1e308", "double" },
+            { "1.7976931348623157e308", "double" },
+            { "1.7976931348623158e308", "double" },
+            { "1.7976931348623159e308", "double" },
+            { "1e309", "double" },
+            { "-1e309", "double" },
+            { "2.2250738585072014e-308", "double" },
+            { "2.2250738585072011e-308", "double" },
+            { "4.9406564584124654e-324", "double" },
+            { "2.4703282292062328e-324", "double" },
+            { "2.4703282292062327e-324", "double" },
+            { "1e-400", "double" },
+            { "1234567890123456789", "int64" },
+            { "9999999999999999999", "uint64" },
+            { "1234567890123456789e-10", "double" },
+            { "0.1234567890123456789", "double" },
+            { "9007199254740993.000000000000000000001", "double" },
+            { "9007199254740993000000000001e-12", "double" },
+            { "9.999999999999999999e22", "double" },
+            { "7.2057594037927933e16", "double" },
+        };
+
+        std::vector<std::string> texts;
+        for (const Case& test : cases)
+            texts.push_back(test.text);
+        // ...and random 19-digit mantissas with random exponents.
+        std::mt19937_64 random(5);
+        while (texts.size() < 2000)
+        {
+            std::string digits = std::to_string(1000000000000000000ull + random() % 9000000000000000000ull);
+            digits.insert(1 + random() % 18, ".");
+            texts.push_back(digits + "e" + std::to_string((int)(random() % 680) - 340));
+        }
+
+        for (std::size_t i = 0; i < texts.size(); ++i)
+        {
+            const std::string& text = texts[i];
+            std::string expected;
+            if (i < sizeof(cases) / sizeof(cases[0]) && std::strcmp(cases[i].type, "double") != 0)
+                expected = cases[i].type + (" " + text);
+            else
+                expected = NumberLog::Typed(std::strtod(text.c_str(), nullptr));
+
+            const std::string json = "{\"n\":" + text + "}";
+            for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+            {
+                Parser parser;
+                parser.setEngine(engine);
+                NumberLog log;
+                Check(parser.Parse(json.data(), json.size(), log), "number boundaries: parse", text);
+                Check(log.numbers == std::vector<std::string>{ expected }, "number boundaries: value", text + " is "
+                    + (log.numbers.empty() ? std::string("(none)") : log.numbers[0]) + " instead of " + expected);
+
+                Document document;
+                document.setEngine(engine);
+                Check(document.Parse(json.data(), json.size()), "number boundaries: document parse", text);
+                const Document::Element n = document.getRoot().Find("n");
+                std::string typed = "(none)";
+                if (n.IsValid() && n.getType() == Document::Type::Int64)
+                    typed = "int64 " + std::to_string(n.getInt64());
+                else if (n.IsValid() && n.getType() == Document::Type::UInt64)
+                    typed = "uint64 " + std::to_string(n.getUInt64());
+                else if (n.IsValid() && n.getType() == Document::Type::Double)
+                    typed = NumberLog::Typed(n.getDouble());
+                Check(typed == expected, "number boundaries: document value", text + " is " + typed + " instead of " + expected);
+            }
+        }
+    }
+
+    // A saved tape loads (into a tape that held another) and replays the
+    // same events, typed numbers and position as the tape that was saved;
+    // but a tape that's been truncated, extended or has any byte changed
+    // fails to load, leaving the tape empty.
+    void TestSavedTapes()
+    {
+        const std::string json = "{\"a\":[1,-2,1.5,18446744073709551615,-0,\"s\",true,false,null,{},[]],\n"
+            "  \"b\":{\"c\":\"\\u00e9\",\"\":{\"d:e\":1e400}}}";
+        Parser parser;
+        EventLog expected;
+        Check(parser.Parse(json.data(), json.size(), expected), "saved tapes: parse");
+        NumberLog expectedNumbers;
+        Check(parser.Parse(json.data(), json.size(), expectedNumbers), "saved tapes: parse numbers");
+
+        EventTape tape;
+        Check(tape.Record(json.data(), json.size()), "saved tapes: record");
+        const char* const filename = "saved-tape-test.tape";
+        Check(tape.Save(filename), "saved tapes: save");
+
+        EventTape loaded;
+        Check(loaded.Record("{\"x\":[2]}", 9), "saved tapes: record another");
+        Check(loaded.Load(filename) && !loaded.IsEmpty(), "saved tapes: load");
+        Check(loaded.getSize() == tape.getSize() && std::memcmp(loaded.getData(), tape.getData(), tape.getSize()) == 0,
+            "saved tapes: loaded data");
+        Check(loaded.getContentHash() == EventTape::HashContent(json.data(), json.size()) && loaded.getContentLength() == json.size(),
+            "saved tapes: loaded content");
+        Check(loaded.getLine() == parser.getLine() && loaded.getColumn() == parser.getColumn(), "saved tapes: loaded position",
+            EventLog::Position(loaded.getLine(), loaded.getColumn()) + " instead of " + EventLog::Position(parser.getLine(), parser.getColumn()));
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            EventLog replayed;
+            loaded.Replay(replayed);
+            CheckEvents(replayed, expected, "saved tapes: replayed events");
+            NumberLog numbers;
+            loaded.Replay(numbers);
+            Check(numbers.numbers == expectedNumbers.numbers, "saved tapes: replayed numbers");
+        }
+
+        // Damaged copies (written over the file, so it mustn't be mapped)...
+        loaded.Clear();
+        const std::string saved(tape.getData(), tape.getSize());
+        std::vector<std::string> damaged = { std::string(), saved.substr(0, 8), saved.substr(0, 71), saved.substr(0, 72),
+            saved.substr(0, saved.size() / 2), saved.substr(0, saved.size() - 1), saved + '\0', saved + saved };
+        for (std::size_t i = 0; i < saved.size(); ++i)
+        {
+            damaged.push_back(saved);
+            damaged.back()[i] ^= 0x10;
+        }
+        for (std::size_t i = 0; i < damaged.size(); ++i)
+        {
+            WriteFile(filename, damaged[i]);
+            EventTape copy;
+            Check(copy.Record("{\"x\":[2]}", 9), "saved tapes: record another");
+            const bool success = copy.Load(filename);
+            Check(!success && copy.IsEmpty() && copy.getData() == nullptr, "saved tapes: damaged tape fails to load",
+                (i < 8 ? "truncated or extended to " + std::to_string(damaged[i].size()) : "byte " + std::to_string(i - 8) + " changed"));
+            EventLog replayed;
+            copy.Replay(replayed);
+            Check(replayed.events.empty(), "saved tapes: nothing replayed");
+        }
+        Check(!loaded.Load("no-such-tape.tape") && loaded.IsEmpty(), "saved tapes: missing file");
+        std::remove(filename);
+    }
+
+    // The statistics that don't vary from one parse to another.
+    std::string Counts(const Parser::Statistics& stats)
+    {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer), "bytes %zu objects %zu arrays %zu keys %zu strings %zu numbers %zu bools %zu nulls %zu "
+            "unescaped %zu escapes %zu depth %zu", stats.bytes, stats.objects, stats.arrays, stats.keys, stats.strings, stats.numbers,
+            stats.bools, stats.nulls, stats.unescapedStrings, stats.unicodeEscapes, stats.maxDepth);
+        return buffer;
+    }
+
+    // With CYOJSON_STATISTICS (as build.sh defines for runtest-statistics),
+    // each engine and ParseInto count the same values of a known document,
+    // as do parallel parses (of an array and of records) with any number
+    // of threads, and only a parser's first parse grows its buffers;
+    // without it, the statistics are all zero.
+    void TestStatistics()
+    {
+#ifdef CYOJSON_STATISTICS
+        const bool counted = true;
+#else
+        const bool counted = false;
+#endif
+        const std::string json = "{\"a\":[1,2.5,-3],\"b\":{\"c\":\"x\\ny\",\"d\\u0065\":\"\\u00e9\\ud83d\\ude00\"},"
+            "\"e\":true,\"f\":false,\"g\":null,\"h\":[[{}]]}";
+        const std::string expected = (counted ? "bytes 103 objects 3 arrays 3 keys 8 strings 2 numbers 3 bools 2 nulls 1 unescaped 3 escapes 4 depth 4"
+            : Counts(Parser::Statistics()));
+
+        for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+        {
+            Parser parser;
+            parser.setEngine(engine);
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                Parser::Callbacks callbacks;
+                Check(parser.Parse(json.data(), json.size(), callbacks), "statistics: parse");
+                const Parser::Statistics& stats = parser.getStatistics();
+                Check(Counts(stats) == expected, "statistics: parse counts", Counts(stats));
+                Check((stats.allocations != 0 && stats.pathGrowths != 0) == (counted && pass == 0), "statistics: buffers grow once",
+                    std::to_string(stats.allocations) + " allocations, " + std::to_string(stats.pathGrowths) + " path growths");
+                Check(stats.seconds >= 0 && (counted || stats.seconds == 0), "statistics: time");
+            }
+            Check(parser.Validate(json.data(), json.size()), "statistics: validate");
+            Check(Counts(parser.getStatistics()) == expected, "statistics: validate counts", Counts(parser.getStatistics()));
+        }
+
+        const char* const fields = "{\"small\":1,\"name\":\"\\u00e9\",\"values\":[1,2],\"flag\":false,\"other\":[null,{\"x\":1}]}";
+        Ranges ranges;
+        Parser parser;
+        Check(parser.ParseInto(fields, ranges), "statistics: parse into");
+        Check(Counts(parser.getStatistics()) == (counted ? "bytes " + std::to_string(std::strlen(fields))
+            + " objects 1 arrays 1 keys 5 strings 1 numbers 3 bools 1 nulls 0 unescaped 1 escapes 1 depth 2" : expected), "statistics: parse into counts", Counts(parser.getStatistics()));
+
+        // The same document many times, as an array sliced among threads
+        // and as records (whose bytes don't include the newlines)...
+        const int c_copies = 40000;
+        std::string array = "{\"items\":[", records;
+        for (int i = 0; i < c_copies; ++i)
+        {
+            array += (i == 0 ? "" : ",") + json;
+            records += json + "\n";
+        }
+        array += "]}";
+        const std::string expectedArray = (counted ? "bytes " + std::to_string(array.size()) + " objects 120001 arrays 120001 keys 320001 "
+            "strings 80000 numbers 120000 bools 80000 nulls 40000 unescaped 120000 escapes 160000 depth 6" : expected);
+        const std::string expectedRecords = (counted ? "bytes " + std::to_string(c_copies * json.size()) + " objects 120000 arrays 120000 keys 320000 "
+            "strings 80000 numbers 120000 bools 80000 nulls 40000 unescaped 120000 escapes 160000 depth 4" : expected);
+        for (unsigned threads : { 1, 4 })
+        {
+            parser.setThreads(threads);
+            Parser::Callbacks callbacks;
+            Check(parser.Parse(array.data(), array.size(), callbacks), "statistics: parallel parse");
+            Check(Counts(parser.getStatistics()) == expectedArray, "statistics: parallel counts",
+                std::to_string(threads) + " threads: " + Counts(parser.getStatistics()));
+            Parser::RecordCallbacks recordCallbacks;
+            Check(parser.ParseRecords(records.data(), records.size(), recordCallbacks), "statistics: records");
+            Check(Counts(parser.getStatistics()) == expectedRecords, "statistics: record counts",
+                std::to_string(threads) + " threads: " + Counts(parser.getStatistics()));
+        }
+    }
+
+    // Counts what's allocated, from any thread.
+    class CountingAllocator final : public Allocator
+    {
+    public:
+        std::atomic<std::size_t> allocations{ 0 };
+        std::atomic<std::size_t> outstanding{ 0 }; //bytes
+
+        void* Allocate(std::size_t size) override
+        {
+            ++allocations;
+            outstanding += size;
+            return ::operator new(size);
+        }
+
+        void Deallocate(void* p, std::size_t size) override
+        {
+            outstanding -= size;
+            ::operator delete(p);
+        }
+    };
+
+    // Once a parser's buffers (and its worker threads' buffers) have grown to
+    // fit a document, parsing it again allocates nothing, with either engine
+    // and any number of threads, for a document, records (in either order)
+    // or Validate; and everything is given back by ReleaseBuffers() or the
+    // destructor.
+    void TestAllocations()
+    {
+        Generator generator(7);
+        const std::string json = "{\"items\":" + generator.Document(150000) + ",\"b\":\"\\u00e9\\n\"}";
+        std::string records;
+        for (int i = 0; i < 40000; ++i)
+        {
+            std::string record = generator.Document((int)generator.Next(5));
+            std::replace(record.begin(), record.end(), '\n', ' ');
+            records += record + "\n";
+        }
+
+        CountingAllocator allocator;
+        for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+        {
+            for (unsigned threads : { 1, 4 })
+            {
+                for (Parser::Delivery delivery : { Parser::Delivery::Ordered, Parser::Delivery::Unordered })
+                {
+                    const std::string what = std::string(engine == Parser::Engine::StructuralIndex ? "structural" : "recursive")
+                        + ", " + std::to_string(threads) + " threads" + (delivery == Parser::Delivery::Unordered ? ", unordered" : "");
+                    {
+                        Parser parser;
+                        parser.setAllocator(&allocator);
+                        parser.setEngine(engine);
+                        parser.setThreads(threads);
+                        parser.setDelivery(delivery);
+                        for (int pass = 0; pass < 6; ++pass)
+                        {
+                            // The first few passes may grow the buffers...
+                            const std::size_t allocations = allocator.allocations;
+                            Parser::Callbacks callbacks;
+                            Check(parser.Parse(json.data(), json.size(), callbacks), "allocations: parse", what);
+                            Parser::RecordCallbacks recordCallbacks;
+                            Check(parser.ParseRecords(records.data(), records.size(), recordCallbacks), "allocations: records", what);
+                            Check(parser.Validate(json.data(), json.size()), "allocations: validate", what);
+                            Check(pass < 3 || allocator.allocations == allocations, "allocations: reparse allocates",
+                                what + ": " + std::to_string(allocator.allocations - allocations) + " allocations on pass " + std::to_string(pass));
+                        }
+                        parser.ReleaseBuffers();
+                        Check(allocator.outstanding == 0, "allocations: released", what);
+
+                        Parser::Callbacks callbacks;
+                        Check(parser.Parse(json.data(), json.size(), callbacks) && allocator.outstanding != 0, "allocations: parse after releasing", what);
+                    }
+                    Check(allocator.outstanding == 0, "allocations: destroyed", what);
+                }
+            }
+        }
+    }
+
+    // Records the path and path id of each event.
+    class PathIdLog final : public Parser::Callbacks
+    {
+    public:
+        std::vector<std::pair<std::string, PathTable::Id>> ids;
+
+        void ObjectStart(const char* path) override { Add(path); }
+        void ObjectEnd(const char* path) override { Add(path); }
+        void ArrayStart(const char* path) override { Add(path); }
+        void ArrayEnd(const char* path) override { Add(path); }
+        void Key(const char* path, const char*, std::size_t) override { Add(path); }
+        void String(const char* path, const char*, std::size_t) override { Add(path); }
+        void Number(const char* path, const char*, std::size_t) override { Add(path); }
+        void Bool(const char* path, bool) override { Add(path); }
+        void Null(const char* path) override { Add(path); }
+
+    private:
+        void Add(const char* path) { ids.emplace_back(path, getPathId()); }
+    };
+
+    // The same, as a static handler that's given the ids by setPathId.
+    class StaticPathIdLog
+    {
+    public:
+        std::vector<std::pair<std::string, PathTable::Id>> ids;
+
+        void setPathId(PathTable::Id id) { id_ = id; }
+
+        void ObjectStart(const char* path) { Add(path); }
+        void ObjectEnd(const char* path) { Add(path); }
+        void ArrayStart(const char* path) { Add(path); }
+        void ArrayEnd(const char* path) { Add(path); }
+        void Key(const char* path, const char*, std::size_t) { Add(path); }
+        void String(const char* path, const char*, std::size_t) { Add(path); }
+        void Number(const char* path, const char*, std::size_t) { Add(path); }
+        void Bool(const char* path, bool) { Add(path); }
+        void Null(const char* path) { Add(path); }
+
+    private:
+        PathTable::Id id_ = PathTable::c_rootId;
+
+        void Add(const char* path) { ids.emplace_back(path, id_); }
+    };
+
+    // Checks that each id is that of its path, interning it anew.
+    void CheckPathIds(PathTable& table, const std::vector<std::pair<std::string, PathTable::Id>>& ids, const char* what)
+    {
+        for (const auto& id : ids)
+        {
+            if (id.second >= table.getCount() || table.getPath(id.second) != id.first || table.Intern(id.first.c_str()) != id.second)
+            {
+                Check(false, what, "\"" + id.first + "\" has id " + std::to_string(id.second));
+                return;
+            }
+        }
+    }
+
+    // A path table gives each path its own id, the same for a colon-joined
+    // path as key by key, which stays the same as the table grows; and
+    // parsing (with either engine, on any number of threads, with a static
+    // handler or a StreamParser) gives each event the id of its path, where
+    // the elements of an array share the array's id, which are the same
+    // ids as were interned before the parse, and in later parses.
+    void TestPathTable()
+    {
+        PathTable table;
+        Check(table.getCount() == 1 && table.Intern("") == PathTable::c_rootId && *table.getPath(PathTable::c_rootId) == '\0',
+            "path table: root");
+        const PathTable::Id a = table.Intern(PathTable::c_rootId, "ab", 1);
+        const PathTable::Id ab = table.Intern("a:b");
+        const PathTable::Id empty = table.Intern(PathTable::c_rootId, "", 0);
+        Check(a != PathTable::c_rootId && ab != a && empty != PathTable::c_rootId && empty != a && table.getCount() == 4, "path table: distinct ids");
+        Check(table.Intern("a") == a && table.Intern(a, "b", 1) == ab && table.Intern(PathTable::c_rootId, "", 0) == empty && table.getCount() == 4,
+            "path table: same ids");
+        Check(std::string(table.getPath(ab)) == "a:b" && table.getPathLength(ab) == 3 && table.getParent(ab) == a
+            && std::string(table.getKey(ab), table.getKeyLength(ab)) == "b" && table.getParent(a) == PathTable::c_rootId,
+            "path table: paths and keys");
+
+        // Many more paths (so the table grows many times), which keep their
+        // ids...
+        std::vector<PathTable::Id> ids;
+        for (int i = 0; i < 20000; ++i)
+            ids.push_back(table.Intern(("p" + std::to_string(i % 100) + ":" + std::to_string(i)).c_str()));
+        Check(table.Intern("a:b") == ab && table.Intern("a") == a && table.Intern(PathTable::c_rootId, "", 0) == empty,
+            "path table: ids after growing");
+        for (int i = 0; i < 20000; ++i)
+        {
+            const std::string path = "p" + std::to_string(i % 100) + ":" + std::to_string(i);
+            if (table.Intern(path.c_str()) != ids[i] || table.getPath(ids[i]) != path)
+            {
+                Check(false, "path table: ids after growing", path);
+                break;
+            }
+        }
+        Check(table.getCount() == 4 + 100 + 20000, "path table: count");
+        table.Clear();
+        Check(table.getCount() == 1 && table.Intern("x") == 1, "path table: clear");
+
+        // Ids in callbacks...
+        std::string json = "{\"a\":[1,{\"b\":[2,[3,{\"c\":\"x\"}]],\"\":null},[true]],\"d\":{\"e\":{}},\"big\":[";
+        for (int i = 0; i < 100000; ++i)
+            json += (i == 0 ? "{\"f\":" : ",{\"f\":") + std::to_string(i) + ",\"g\":[{\"h\":false}]}";
+        json += "]}";
+
+        PathTable parsed;
+        const PathTable::Id c = parsed.Intern("a:b:c");
+        const PathTable::Id big = parsed.Intern("big");
+        PathIdLog first;
+        for (Parser::Engine engine : { Parser::Engine::RecursiveDescent, Parser::Engine::StructuralIndex })
+        {
+            for (unsigned threads : { 1, 4 })
+            {
+                Parser parser;
+                parser.setEngine(engine);
+                parser.setThreads(threads);
+                parser.setPathTable(&parsed);
+                PathIdLog log;
+                Check(parser.Parse(json.data(), json.size(), log), "path table: parse");
+                if (first.ids.empty())
+                {
+                    first.ids = log.ids;
+                    CheckPathIds(parsed, log.ids, "path table: callback ids");
+                }
+                Check(log.ids == first.ids, "path table: same ids in each parse");
+
+                StaticPathIdLog handler;
+                Check(parser.Parse(json.data(), json.size(), handler), "path table: static parse");
+                Check(handler.ids == first.ids, "path table: static handler ids");
+            }
+        }
+        const auto found = std::find(first.ids.begin(), first.ids.end(), std::make_pair(std::string("a:b:c"), c));
+        Check(found != first.ids.end() && first.ids[2].second == parsed.Intern("a") && first.ids[3].second == parsed.Intern("a"),
+            "path table: interned before parsing");
+        Check(std::count(first.ids.begin(), first.ids.end(), std::make_pair(std::string("big"), big)) == 4 * 100000 + 2,
+            "path table: array elements");
+
+        PathIdLog streamed;
+        StreamParser stream(streamed);
+        stream.setPathTable(&parsed);
+        Check(stream.Feed(json.data(), json.size()) && stream.Finish(), "path table: stream");
+        Check(streamed.ids == first.ids, "path table: stream ids");
+
+        // ...and without a table, the root's...
+        Parser parser;
+        PathIdLog unset;
+        Check(parser.Parse("{\"a\":[1]}", unset) && unset.ids.size() == 6, "path table: parse without a table");
+        for (const auto& id : unset.ids)
+            Check(id.second == PathTable::c_rootId, "path table: ids without a table", id.first);
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 int main()
 {
-    //TODO
+    TestEngines();
+    TestUnicodeEscapes();
+    TestParseInto();
+    TestActions();
+    TestParallelActions();
+    TestWorkerReuse();
+    TestRecords();
+    TestUnorderedRecords();
+    TestSources();
+    TestFiles();
+    TestRecordsFile();
+    TestEmptyKeys();
+    TestThreadedPaths();
+    TestTapes();
+    TestSkipBeforeError();
+    TestDocuments();
+    TestLazyDocuments();
+    TestWriter();
+    TestTransforms();
+    TestCheckedUTF8();
+    TestSubscriptions();
+    TestSkipModes();
+    TestNumberBoundaries();
+    TestSavedTapes();
+    TestStatistics();
+    TestAllocations();
+    TestPathTable();
 
+    if (g_failures != 0)
+    {
+        std::printf("%d failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All passed\n");
     return 0;
 }